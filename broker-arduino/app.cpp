@@ -2,6 +2,8 @@
 
 #include "mqttHandler.h"
 #include "networkHandler.h"
+#include "rtcLog.h"
+#include "settingsStore.h"
 #include "stateGpioHandler.h"
 #include "timing.h"
 
@@ -23,6 +25,18 @@ StateGpioHandler& createStateGpioHandler(App* app)
     return stateGpioHandler;
 }
 
+RtcLog& createRtcLog()
+{
+    static RtcLog rtcLog;
+    return rtcLog;
+}
+
+SettingsStore& createSettingsStore()
+{
+    static SettingsStore settingsStore;
+    return settingsStore;
+}
+
 App::App()
 {}
 
@@ -41,27 +55,94 @@ StateGpioHandler* App::getStateGpioHandler()
     return stateGpioHandler;
 }
 
+RtcLog* App::getRtcLog()
+{
+    return rtcLog;
+}
+
+SettingsStore* App::getSettingsStore()
+{
+    return settingsStore;
+}
+
 void App::setup()
 {
     networkHandler = &createNetworkHandler(this);
     mqttHandler = &createMqttHandler(this);
     stateGpioHandler = &createStateGpioHandler(this);
+    rtcLog = &createRtcLog();
+    settingsStore = &createSettingsStore();
+
+    // Forensics of the previous boot are needed by all other components
+    rtcLog->setup();
 
     Serial.begin(115200);
     Serial.println("");
     Serial.println("Starting doorbell broker...");
 
+    settingsStore->setup();
+    loopMs = settingsStore->getInt(Setting::LoopMs);
+
     // LEDs are already needed for WIFI setup (blinking!)
     stateGpioHandler->setup();
-    stateGpioHandler->waitSeconds(1); // ensures we see all LEDs at least once
+    if (!rtcLog->hasPreviousBoot()) {
+        stateGpioHandler->waitSeconds(1); // ensures we see all LEDs at least once, not needed after a reboot
+    }
     networkHandler->setup();
     mqttHandler->setup();
 }
 
+void App::applyParams()
+{
+    loopMs = settingsStore->getInt(Setting::LoopMs);
+    networkHandler->applyParams();
+    mqttHandler->applyParams();
+    stateGpioHandler->applyParams();
+
+    // Start a new window, so the logged load belongs to the new parameters only.
+    loadWindowStartUs = micros();
+    loadBusyUs = 0;
+    logLoopLoad = true;
+}
+
+int App::getLoopMs() const
+{
+    return loopMs;
+}
+
+String App::getLoopLoadStr() const
+{
+    return String(loopLoadPercent, 1) + " %";
+}
+
+void App::measureLoopLoad(uint32_t busyUs)
+{
+    loadBusyUs += busyUs;
+    const uint32_t nowUs = micros();
+    const uint32_t windowUs = nowUs - loadWindowStartUs;
+    if (windowUs < uint32_t(LoopLoadWindowMs) * 1000) return;
+
+    loopLoadPercent = 100.0f * loadBusyUs / windowUs;
+    loadWindowStartUs = nowUs;
+    loadBusyUs = 0;
+
+    if (logLoopLoad) {
+        logLoopLoad = false;
+        mqttHandler->addToActionLog("Loop load with loop period " + String(loopMs) + " ms: " + getLoopLoadStr());
+    }
+}
+
 void App::loop()
 {
-    delay(MainLoopSampleTimeMs);
+    delay(loopMs);
+    const uint32_t busyStartUs = micros();
+    rtcLog->markStage(LoopStage::Network);
     networkHandler->loop();
+    rtcLog->markStage(LoopStage::Mqtt);
     mqttHandler->loop();
+    rtcLog->markStage(LoopStage::StateGpio);
     stateGpioHandler->loop();
+    rtcLog->markStage(LoopStage::Settings);
+    settingsStore->loop(stateGpioHandler->getRelaysIdle());
+    measureLoopLoad(micros() - busyStartUs);
 }
\ No newline at end of file
@@ -2,6 +2,8 @@
 
 #include <Arduino.h>
 
+class RtcLog;
+class SettingsStore;
 class StateGpioHandler;
 class MqttHandler;
 class NetworkHandler;
@@ -14,14 +16,32 @@ public:
     void setup();
     void loop();
 
+    // Runtime-tunable parameters (params.h) changed, apply them to all components
+    void applyParams();
+    int getLoopMs() const;
+    String getLoopLoadStr() const;
+
     NetworkHandler* getNetworkHandler();
     MqttHandler* getMqttHandler();
     StateGpioHandler* getStateGpioHandler();
+    RtcLog* getRtcLog();
+    SettingsStore* getSettingsStore();
 
 private:
+    void measureLoopLoad(uint32_t busyUs);
+
     NetworkHandler* networkHandler;
     MqttHandler* mqttHandler;
     StateGpioHandler* stateGpioHandler;
+    RtcLog* rtcLog;
+    SettingsStore* settingsStore;
 
     bool startupCycleCompleted = false;
+
+    // Loop load: busy time of the loop (without the delay) per measurement window
+    int loopMs = 0;
+    uint32_t loadWindowStartUs = 0;
+    uint32_t loadBusyUs = 0;
+    float loopLoadPercent = 0;
+    bool logLoopLoad = false;
 };
\ No newline at end of file
@@ -1,30 +1,72 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <cstdint>
+#include <utility>
 
+// Ring buffer which overwrites the oldest element when full.
+// For a power-of-two size, indices are wrapped by a mask, otherwise by a conditional subtraction.
+// Indices are not bounds-checked, at() requires 0 <= index < size().
 template<typename T, int maxSize>
 class CircularArray final
 {
+    static_assert(maxSize > 0, "CircularArray needs a positive size");
+
 public:
-    CircularArray()
+    static constexpr bool IsPowerOfTwo = (maxSize & (maxSize - 1)) == 0;
+
+    void push(const T& value)
     {
-        data.fill(T{});
+        data[head] = value;
+        advance();
     }
 
-    void push(const T& value)
+    void push(T&& value)
     {
-        data.at(head) = value;
-        head = (head + 1) % maxSize;
-        if (count < maxSize) {
-            ++count;
-        } else {
-            tail = (tail + 1) % maxSize;
+        data[head] = std::move(value);
+        advance();
+    }
+
+    // Push n values, if n exceeds the size, only the last values are kept.
+    void pushN(const T* values, int n)
+    {
+        if (n > maxSize) {
+            values += n - maxSize;
+            n = maxSize;
+        }
+        // At most two contiguous runs: up to the end of the storage and from its start.
+        const int firstRun = n < maxSize - head ? n : maxSize - head;
+        std::copy(values, values + firstRun, data.begin() + head);
+        std::copy(values + firstRun, values + n, data.begin());
+
+        head = wrap(head + n);
+        count += n;
+        if (count > maxSize) {
+            tail = head;
+            count = maxSize;
         }
     }
 
+    // Copy up to maxCount values (oldest first) to out, returns the number of copied values.
+    int copyOut(T* out, int maxCount) const
+    {
+        const int n = maxCount < count ? maxCount : count;
+        const int firstRun = n < maxSize - tail ? n : maxSize - tail;
+        std::copy(data.begin() + tail, data.begin() + tail + firstRun, out);
+        std::copy(data.begin(), data.begin() + (n - firstRun), out + firstRun);
+        return n;
+    }
+
     const T& at(int index) const
     {
-        return data.at((tail + index) % maxSize);
+        return data[wrap(tail + index)];
+    }
+
+    const T& operator[](int index) const
+    {
+        return at(index);
     }
 
     int size() const
@@ -32,9 +74,9 @@ public:
         return count;
     }
 
+    // O(1): old elements are not destroyed, they are overwritten by later pushes.
     void clear()
     {
-        data.fill(T{});
         head = 0;
         tail = 0;
         count = 0;
@@ -83,8 +125,102 @@ public:
     }
 
 private:
-    std::array<T, maxSize> data;
+    // index must be smaller than 2 * maxSize
+    static int wrap(int index)
+    {
+        if constexpr (IsPowerOfTwo) {
+            return index & (maxSize - 1);
+        } else {
+            return index >= maxSize ? index - maxSize : index;
+        }
+    }
+
+    void advance()
+    {
+        head = wrap(head + 1);
+        if (count < maxSize) {
+            ++count;
+        } else {
+            tail = wrap(tail + 1);
+        }
+    }
+
+    std::array<T, maxSize> data{};
     int head = 0;
     int tail = 0;
     int count = 0;
-};
\ No newline at end of file
+};
+
+// --------------------------------------------------------------
+
+// Wait-free ring buffer for exactly one producer and one consumer,
+// e.g. the esp_timer task, an interrupt or the other core producing and the main loop consuming.
+// In contrast to CircularArray, a push to a full buffer fails instead of overwriting, so the producer
+// never writes the consumer index.
+template<typename T, int maxSize>
+class SpscCircularArray final
+{
+    static_assert(maxSize > 0 && (maxSize & (maxSize - 1)) == 0, "SpscCircularArray needs a power-of-two size");
+
+public:
+    // Producer side
+    bool push(const T& value)
+    {
+        const uint32_t currentHead = head.load(std::memory_order_relaxed);
+        if (currentHead - tail.load(std::memory_order_acquire) == maxSize) return false;
+        data[currentHead & Mask] = value;
+        head.store(currentHead + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Producer side: pushes as many of the n values as fit, published at once, returns their number.
+    int pushN(const T* values, int n)
+    {
+        const uint32_t currentHead = head.load(std::memory_order_relaxed);
+        const int free = maxSize - static_cast<int>(currentHead - tail.load(std::memory_order_acquire));
+        if (n > free) n = free;
+        for (int i = 0; i < n; ++i) data[(currentHead + i) & Mask] = values[i];
+        head.store(currentHead + n, std::memory_order_release);
+        return n;
+    }
+
+    // Consumer side
+    bool pop(T& value)
+    {
+        const uint32_t currentTail = tail.load(std::memory_order_relaxed);
+        if (currentTail == head.load(std::memory_order_acquire)) return false;
+        value = std::move(data[currentTail & Mask]);
+        tail.store(currentTail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side: pops up to maxCount values (oldest first) to out, returns their number.
+    int popN(T* out, int maxCount)
+    {
+        const uint32_t currentTail = tail.load(std::memory_order_relaxed);
+        const int available = static_cast<int>(head.load(std::memory_order_acquire) - currentTail);
+        const int n = maxCount < available ? maxCount : available;
+        for (int i = 0; i < n; ++i) out[i] = std::move(data[(currentTail + i) & Mask]);
+        tail.store(currentTail + n, std::memory_order_release);
+        return n;
+    }
+
+    // Only a snapshot while the other side runs: a lower bound for the consumer, an upper bound for the producer.
+    int size() const
+    {
+        return static_cast<int>(head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire));
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+private:
+    static constexpr uint32_t Mask = maxSize - 1;
+
+    // Free running counters, the difference is the number of elements.
+    std::array<T, maxSize> data{};
+    std::atomic<uint32_t> head{0};
+    std::atomic<uint32_t> tail{0};
+};
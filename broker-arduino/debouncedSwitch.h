@@ -1,44 +1,356 @@
 #pragma once
 
 #include <Arduino.h>
+#include <esp_attr.h>
 
 #include "circularArray.h"
 
 constexpr int MaxRawDataLength = 100; // 10sec
 constexpr int MaxRawDataStrings = 20;
+constexpr int MaxTraceSamples = 128;
+constexpr int PressEdgeQuietCycles = 3; // released samples before a raw edge counts as start of a press
 
 class App;
-class NetworkHandler;
 
-class DebouncedSwitch final
+// DebouncedSwitch is configured by compile-time policies, disabled features compile to nothing:
+// - DebouncePolicy: debounce strategy, update() gets the raw state per sample and the loop cycles it stands for
+//   and returns the debounced state
+// - RawLogPolicy: raw data logging (NoRawLog or RawLog with buffer sizes)
+// - Polarity: level of a pressed switch
+
+// --------------------------------------------------------------
+// Polarity
+
+// All switches/inputs are grounded, so LOW means pressed.
+struct ActiveLow final
+{
+    static bool isPressed(int level)
+    {
+        return level == LOW;
+    }
+};
+
+struct ActiveHigh final
+{
+    static bool isPressed(int level)
+    {
+        return level == HIGH;
+    }
+};
+
+// --------------------------------------------------------------
+// Debounce strategies
+
+// A new state is taken over after it was read for debounceCycles cycles in a row.
+class CounterDebounce
 {
 public:
-    DebouncedSwitch(int pin, int debounceCycles, App* app, bool rawDataLoggingEnabled = false);
-    void setup();
+    explicit CounterDebounce(int debounceCycles)
+        : debounceCycles(debounceCycles)
+    {}
 
-    bool checkRaise();
+    bool update(bool isPressed, int cycles)
+    {
+        if (isPressed != state) {
+            debounceCounter += cycles;
+            if (debounceCounter >= debounceCycles) {
+                state = isPressed;
+                debounceCounter = 0;
+            }
+        } else {
+            debounceCounter = 0;
+        }
+        return state;
+    }
 
-    const CircularArray<String, MaxRawDataStrings>& getArchivedRawDataStrings() const;
-    String getCurrentRawDataStr() const;
+    void setDebounceCycles(int cycles)
+    {
+        debounceCycles = cycles;
+    }
 
 private:
-    void collectRawData(bool isPressed);
-    String getRawDataStr() const;
-    void readState();
+    int debounceCycles;
+    int debounceCounter = 0;
+    bool state = false;
+};
+
+// Integrates the raw state (up when pressed, down when released), single bounces only delay the detection.
+class IntegratorDebounce
+{
+public:
+    explicit IntegratorDebounce(int debounceCycles)
+        : debounceCycles(debounceCycles)
+    {}
+
+    bool update(bool isPressed, int cycles)
+    {
+        if (isPressed) {
+            integrator = min(integrator + cycles, debounceCycles);
+            if (integrator == debounceCycles) state = true;
+        } else {
+            integrator = max(integrator - cycles, 0);
+            if (integrator == 0) state = false;
+        }
+        return state;
+    }
+
+    void setDebounceCycles(int cycles)
+    {
+        // A lower limit ends an integration above it right away.
+        debounceCycles = cycles;
+        if (integrator > debounceCycles) integrator = debounceCycles;
+    }
 
 private:
-    App* const app;
-    NetworkHandler* networkHandler = nullptr;
+    int debounceCycles;
+    int integrator = 0;
+    bool state = false;
+};
 
-    const int pin;
-    const int debounceCycles;
-    const bool rawDataLoggingEnabled;
-    bool lastState = false;
-    bool lastDebounceState = false;
-    int debounceCounter = 0;
+// --------------------------------------------------------------
+// Raw data logging
+
+class NoRawLog
+{
+public:
+    explicit NoRawLog(App*)
+    {}
+
+    void setup()
+    {}
+
+    void collectRawData(bool)
+    {}
+};
+
+// Edge of the raw (not debounced) input, recorded in trace mode.
+struct TraceSample final
+{
+    uint32_t tsMs;
+    bool pressed;
+};
+
+// Date/time prefix of a raw data string (empty without network handler)
+String getRawDataDateTimePrefix(App* app);
+
+// Collects raw data after a press (one sample per cycle) and, in trace mode, all raw edges with timestamps.
+template<int rawDataLength = MaxRawDataLength, int rawDataStrings = MaxRawDataStrings, int traceSamples = MaxTraceSamples>
+class RawLog
+{
+public:
+    explicit RawLog(App* app)
+        : app(app)
+    {}
+
+    void setup()
+    {
+        Serial.println("Setup raw data logging");
+    }
+
+    const CircularArray<String, rawDataStrings>& getArchivedRawDataStrings() const
+    {
+        return archivedRawDataStrings;
+    }
 
+    String getCurrentRawDataStr() const
+    {
+        return getRawDataStr();
+    }
+
+    // Trace mode: record all raw input edges with timestamps, for the replay in broker-sim
+    void setTraceEnabled(bool enabled)
+    {
+        if (enabled && !traceEnabled) {
+            trace.clear();
+            // Start with the current level, so the trace is complete.
+            trace.push(TraceSample{static_cast<uint32_t>(millis()), lastRawState});
+        }
+        traceEnabled = enabled;
+    }
+
+    bool getTraceEnabled() const
+    {
+        return traceEnabled;
+    }
+
+    const CircularArray<TraceSample, traceSamples>& getTrace() const
+    {
+        return trace;
+    }
+
+    void collectRawData(bool isPressed)
+    {
+        // If pressed, start new raw data monitoring.
+        if (isPressed) {
+            currentlyCollectingRawData = true;
+        }
+
+        // Collect raw data if started, until max length is reached.
+        if (currentlyCollectingRawData) {
+            rawData.push(isPressed);
+            if (rawData.full()) {
+                archivedRawDataStrings.push(getRawDataStr());
+                rawData.clear();
+                currentlyCollectingRawData = false;
+            }
+        }
+
+        if (traceEnabled && isPressed != lastRawState) {
+            trace.push(TraceSample{static_cast<uint32_t>(millis()), isPressed});
+        }
+        lastRawState = isPressed;
+    }
+
+private:
+    String getRawDataStr() const
+    {
+        if (!currentlyCollectingRawData) return "";
+
+        String rawDataStr = getRawDataDateTimePrefix(app);
+        rawDataStr.reserve(rawDataStr.length() + rawDataLength);
+        for (const bool data : rawData) {
+            rawDataStr += data ? '1' : '0';
+        }
+        return rawDataStr;
+    }
+
+    App* const app;
     bool currentlyCollectingRawData = false;
+    bool traceEnabled = false;
+    bool lastRawState = false;
 
-    CircularArray<int, MaxRawDataLength> rawData;
-    CircularArray<String, MaxRawDataStrings> rawDataStrings;
+    CircularArray<bool, rawDataLength> rawData;
+    CircularArray<String, rawDataStrings> archivedRawDataStrings;
+    CircularArray<TraceSample, traceSamples> trace;
 };
+
+// --------------------------------------------------------------
+
+template<typename DebouncePolicy = CounterDebounce, typename RawLogPolicy = NoRawLog, typename Polarity = ActiveLow>
+class DebouncedSwitch final
+    : private DebouncePolicy
+    , public RawLogPolicy
+{
+public:
+    DebouncedSwitch(int pin, int debounceCycles, App* app = nullptr)
+        : DebouncePolicy(debounceCycles)
+        , RawLogPolicy(app)
+        , pin(pin)
+    {}
+
+    void setup()
+    {
+        RawLogPolicy::setup();
+    }
+
+    // Counts the edges of the input in an interrupt, after the pin mode is set.
+    void attachEdgeInterrupt()
+    {
+        attachInterruptArg(pin, onEdge, this, CHANGE);
+        edgeInterrupt = true;
+    }
+
+    // elapsedCycles: loop cycles since the last sample, more than one after a stalled loop
+    // nowMs: time of the sample, the loop passes its start time to all switches
+    bool checkRaise(int elapsedCycles = 1, uint32_t nowMs = millis())
+    {
+        const bool isPressed = Polarity::isPressed(digitalRead(pin));
+        RawLogPolicy::collectRawData(isPressed);
+        const bool wasPressed = lastRawPressed;
+        const GapCycles gap = getGapCycles(isPressed, elapsedCycles, nowMs);
+
+        // The previous state up to the edge in the gap, e.g. a press that ended during a stall
+        bool raise = gap.before > 0 && updateState(wasPressed, gap.before);
+
+        // A press starts with the first raw edge after a quiet phase, bounces keep that edge.
+        if (!isPressed) {
+            releasedCycles = min(releasedCycles + gap.current, PressEdgeQuietCycles);
+        } else {
+            if (releasedCycles >= PressEdgeQuietCycles && !lastDebounceState) pressEdgeMs = nowMs;
+            releasedCycles = 0;
+        }
+
+        raise = updateState(isPressed, gap.current) || raise;
+        return raise;
+    }
+
+    // Time of the raw edge that started the current (or last) press, resolution is one sample (loop cycle)
+    uint32_t getPressEdgeMs() const
+    {
+        return pressEdgeMs;
+    }
+
+    // Applies from the next sample, the debounced state is kept.
+    void setDebounceCycles(int debounceCycles)
+    {
+        DebouncePolicy::setDebounceCycles(debounceCycles);
+    }
+
+private:
+    static void IRAM_ATTR onEdge(void* arg)
+    {
+        auto* self = static_cast<DebouncedSwitch*>(arg);
+        self->lastEdgeMs = millis();
+        self->numEdges = self->numEdges + 1;
+    }
+
+    // Cycles of the gap since the last sample: the current raw state counts from the last edge in the gap, the
+    // previous one up to the edge if it was the only one. Without the edge interrupt, a state read at both ends
+    // counts for the whole gap, a changed one for one cycle.
+    struct GapCycles
+    {
+        int before;
+        int current;
+    };
+
+    GapCycles getGapCycles(bool isPressed, int elapsedCycles, uint32_t nowMs)
+    {
+        const uint32_t gapMs = nowMs - lastSampleMs;
+        lastSampleMs = nowMs;
+        const bool changed = isPressed != lastRawPressed;
+        lastRawPressed = isPressed;
+
+        // Without a gap (the normal case) the edges are only consumed.
+        if (elapsedCycles <= 1 || gapMs == 0 || !edgeInterrupt) {
+            lastNumEdges = numEdges;
+            if (elapsedCycles <= 1 || gapMs == 0) return {0, 1};
+            return {0, changed ? 1 : elapsedCycles};
+        }
+
+        // The interrupt writes the time before the count, a changed count means another edge came in between.
+        uint32_t edges;
+        uint32_t edgeMs;
+        do {
+            edges = numEdges;
+            edgeMs = lastEdgeMs;
+        } while (edges != numEdges);
+        const uint32_t numGapEdges = edges - lastNumEdges;
+        lastNumEdges = edges;
+
+        if (numGapEdges == 0) return {0, elapsedCycles};
+        const int current = constrain(static_cast<int>(elapsedCycles * (nowMs - edgeMs) / gapMs), 1, elapsedCycles);
+        return {numGapEdges == 1 && changed ? elapsedCycles - current : 0, current};
+    }
+
+    bool updateState(bool isPressed, int cycles)
+    {
+        const bool state = DebouncePolicy::update(isPressed, cycles);
+        const bool raise = state && !lastDebounceState;
+        lastDebounceState = state;
+        return raise;
+    }
+
+    const int pin;
+    bool lastDebounceState = false;
+    bool lastRawPressed = false;
+    uint32_t lastSampleMs = 0;
+    bool edgeInterrupt = false;
+    uint32_t lastNumEdges = 0;
+    volatile uint32_t numEdges = 0;
+    volatile uint32_t lastEdgeMs = 0;
+    int releasedCycles = PressEdgeQuietCycles;
+    uint32_t pressEdgeMs = 0;
+};
+
+using PlainSwitch = DebouncedSwitch<CounterDebounce, NoRawLog, ActiveLow>;
+using RawLoggedSwitch = DebouncedSwitch<CounterDebounce, RawLog<>, ActiveLow>;
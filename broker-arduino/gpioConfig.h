@@ -1,5 +1,7 @@
 #pragma once
 
+#include "ledPattern.h"
+
 constexpr int LedOn = 2;
 constexpr int LedAckAutobuzz = 3;
 constexpr int Led3Unused = 4;
@@ -9,13 +11,36 @@ constexpr int LedDoorbell = 6;
 constexpr int FirstLed = LedOn;
 constexpr int LastLed = LedDoorbell;
 
+// LED patterns (see ledPattern.h)
+constexpr LedPattern LedPatternWait = LedPatterns::chase(LastLed - FirstLed + 1); // while waiting, e.g. for WiFi
+constexpr LedPattern LedPatternWaitBuiltin = LedPatterns::Breathe;
+constexpr LedPattern LedPatternAutoBuzz = LedPatterns::Blink;
+constexpr LedPattern LedPatternRingBlink = LedPatterns::Blink; // in opposite phase of the auto buzzer LED
+constexpr LedPattern LedPatternRebootPending = LedPatterns::DoubleBlink;
+
 constexpr int SwitchBuzzmode = 7;
 constexpr int SwitchAckBuzz = 8;
 constexpr int SwitchAck = 9;
 
-constexpr int InputRing = 10;
+// Ring inputs, all grounded (LOW means ringing). Each one publishes on doorRing/<name> and is
+// acknowledged by "ackRing <name>", the ack switches acknowledge all inputs.
+struct RingInputConfig final
+{
+    const char* name;
+    int pin;
+    bool externalPullUp; // otherwise the internal pull up is enabled
+};
+
+// Only list inputs which are wired, an open pin may read as ringing.
+constexpr RingInputConfig RingInputs[] = {
+    {"street", 10, true},
+    // {"apartment", 14, false}, // e.g. the bell button at the apartment door
+};
+
+constexpr int NumRingInputs = sizeof(RingInputs) / sizeof(RingInputs[0]);
+
 constexpr int RelayBuzzer = 11;
 constexpr int RelayExtBell = 12;
 
-constexpr int SwitchDebounceCycles = 2; // 200ms
-constexpr int InputDebounceCycles = 5;  // 500ms
\ No newline at end of file
+constexpr int SwitchDebounceMs = 200;
+constexpr int InputDebounceMs = 500;
\ No newline at end of file
@@ -0,0 +1,93 @@
+#include "ledEngine.h"
+
+constexpr uint32_t LedPwmFrequency = 5000;
+constexpr uint8_t LedPwmResolution = 8;
+constexpr int LedMaxDuty = (1 << LedPwmResolution) - 1;
+
+void LedEngine::addLed(uint8_t pin)
+{
+    if (numLeds == MaxLeds) {
+        Serial.println("Too many LEDs for the LED engine");
+        return;
+    }
+    if (!ledcAttach(pin, LedPwmFrequency, LedPwmResolution)) {
+        Serial.println("Failed to attach LED " + String(pin) + " to LEDC");
+        return;
+    }
+    leds[numLeds++].pin = pin;
+}
+
+void LedEngine::setup()
+{
+    Serial.println("Setup LED engine");
+
+    const esp_timer_create_args_t timerArgs = {
+        .callback = &LedEngine::onStep,
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "ledEngine",
+        .skip_unhandled_events = true,
+    };
+    if (esp_timer_create(&timerArgs, &timer) != ESP_OK
+        || esp_timer_start_periodic(timer, uint64_t(LedStepMs) * 1000) != ESP_OK) {
+        Serial.println("Failed to start LED engine timer");
+    }
+}
+
+void LedEngine::setPattern(uint8_t pin, const LedPattern& pattern, uint8_t phaseSteps)
+{
+    for (int i = 0; i < numLeds; ++i) {
+        Led& led = leds[i];
+        if (led.pin != pin) continue;
+
+        // Only the main loop writes patterns, so it can compare without lock.
+        if (led.pattern == pattern && led.phaseSteps == phaseSteps) return;
+        portENTER_CRITICAL(&mux);
+        led.pattern = pattern;
+        led.phaseSteps = phaseSteps;
+        portEXIT_CRITICAL(&mux);
+        return;
+    }
+}
+
+void LedEngine::onStep(void* arg)
+{
+    // Runs in the esp_timer task
+    static_cast<LedEngine*>(arg)->step();
+}
+
+void LedEngine::step()
+{
+    for (int i = 0; i < numLeds; ++i) {
+        Led& led = leds[i];
+
+        portENTER_CRITICAL(&mux);
+        const LedPattern pattern = led.pattern;
+        const uint8_t phaseSteps = led.phaseSteps;
+        portEXIT_CRITICAL(&mux);
+
+        const uint32_t period = pattern.periodSteps;
+        const uint32_t pos = (stepCount + period - phaseSteps % period) % period;
+
+        if (pattern.breathe) {
+            // The fades run in the LEDC hardware, one update per half period.
+            const uint32_t halfPeriod = period / 2;
+            if (pos == 0 || pos == halfPeriod) {
+                ledcFade(led.pin, pos == 0 ? 0 : LedMaxDuty, pos == 0 ? LedMaxDuty : 0, halfPeriod * LedStepMs);
+                led.fadeEndStep = stepCount + halfPeriod;
+            }
+            led.renderedDuty = -1;
+            continue;
+        }
+
+        // A running fade would overwrite the duty, so a new pattern starts after it.
+        if (static_cast<int32_t>(stepCount - led.fadeEndStep) <= 0) continue;
+
+        const int duty = (pattern.onMask >> pos) & 1 ? LedMaxDuty : 0;
+        if (duty != led.renderedDuty) {
+            ledcWrite(led.pin, duty);
+            led.renderedDuty = duty;
+        }
+    }
+    ++stepCount;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "ledPattern.h"
+
+#include <Arduino.h>
+#include <esp_timer.h>
+
+// Renders LED patterns with the LEDC peripheral, stepped by a periodic esp_timer.
+// The main loop only assigns patterns, so blinking neither depends on nor costs the main loop.
+// A new pattern is rendered from the next step on.
+class LedEngine final
+{
+public:
+    static constexpr int MaxLeds = 8;
+
+    // All LEDs are added before setup()
+    void addLed(uint8_t pin);
+    void setup();
+
+    // The phase delays the pattern by the given number of steps.
+    void setPattern(uint8_t pin, const LedPattern& pattern, uint8_t phaseSteps = 0);
+
+private:
+    struct Led
+    {
+        uint8_t pin = 0;
+        LedPattern pattern = LedPatterns::Off;
+        uint8_t phaseSteps = 0;
+        // Only accessed by the timer task
+        int renderedDuty = -1;
+        uint32_t fadeEndStep = 0;
+    };
+
+    static void onStep(void* arg);
+    void step();
+
+    Led leds[MaxLeds];
+    int numLeds = 0;
+    uint32_t stepCount = 0;
+    esp_timer_handle_t timer = nullptr;
+
+    // Protects pattern and phase of the LEDs, which are set by the main loop and read by the timer task
+    portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+
+constexpr int LedStepMs = 100;
+
+// Declarative LED pattern, rendered by the LedEngine in steps of LedStepMs.
+// The LED is on in step n of the period if bit n of onMask is set.
+struct LedPattern final
+{
+    uint8_t periodSteps;
+    uint32_t onMask;
+    bool breathe; // fade up in the first and down in the second half of the period, onMask is ignored
+
+    constexpr bool operator==(const LedPattern& other) const
+    {
+        return periodSteps == other.periodSteps && onMask == other.onMask && breathe == other.breathe;
+    }
+    constexpr bool operator!=(const LedPattern& other) const
+    {
+        return !(*this == other);
+    }
+};
+
+namespace LedPatterns {
+
+constexpr LedPattern Off{1, 0b0, false};
+constexpr LedPattern Solid{1, 0b1, false};
+constexpr LedPattern Blink{2, 0b01, false};
+constexpr LedPattern DoubleBlink{8, 0b0101, false};
+constexpr LedPattern Breathe{20, 0b0, true};
+
+// One LED after the other, two steps each. The LED with index i is started with the phase 2 * i.
+constexpr LedPattern chase(int numLeds)
+{
+    return LedPattern{static_cast<uint8_t>(2 * numLeds), 0b11, false};
+}
+
+} // namespace LedPatterns
@@ -0,0 +1,369 @@
+#include "mqttBridge.h"
+
+#include "app.h"
+#include "mqttHandler.h"
+#include "networkHandler.h"
+#include "timing.h"
+
+#include <esp_attr.h>
+#include <esp_random.h>
+#include <esp_system.h>
+
+constexpr uint32_t BridgeQueueMagic = 0xB41D6E02; // changes with the layout of BridgeQueueData
+constexpr uint16_t UpstreamBrokerPort = 1883;
+constexpr uint16_t UpstreamBrokerTlsPort = 8883;
+constexpr int UpstreamClientBufferSize = 512;
+// A connect attempt blocks the loop, so the TCP connect and the wait for the CONNACK are kept short.
+constexpr int UpstreamConnectTimeoutSec = 1;
+
+// Queued events published per loop cycle, so GPIO handling is not starved.
+constexpr int MaxBridgePublishesPerLoop = 3;
+
+const char* UpstreamClientId = "DoorbellBridgeESP32";
+const char* UpstreamTopicPrefix = "doorbell/";
+const char* UpstreamCommandTopic = "cmd";
+const char* UpstreamResponseTopic = "response";
+const char* UpstreamEchoTopic = "doorRing/#";
+
+const char* NvsNamespaceBridge = "bridge";
+const char* NvsKeyUpstreamHost = "upstreamHost";
+const char* NvsKeyUpstreamPort = "upstreamPort";
+const char* NvsKeyUpstreamUser = "upstreamUser";
+const char* NvsKeyUpstreamPassword = "upstreamPass";
+const char* NvsKeyTlsFingerprint = "upstreamTlsFp";
+const char* NvsKeyBuzzAllowed = "upstreamBuzz";
+
+// Options of setUpstream
+const char* OptPort = "port=";
+const char* OptUser = "user=";
+const char* OptPassword = "password=";
+const char* OptTls = "tls=";
+const char* OptBuzz = "buzz";
+
+RTC_NOINIT_ATTR static BridgeQueueData queue;
+
+MqttBridge::MqttBridge(App* app)
+    : app(app)
+    , client(wifiClient)
+{}
+
+void MqttBridge::setup()
+{
+    Serial.println("Setup MqttBridge");
+    mqttHandler = app->getMqttHandler();
+    networkHandler = app->getNetworkHandler();
+
+    setupQueue();
+    loadConfig();
+
+    wifiClient.setTimeout(UpstreamConnectTimeoutSec);
+    secureClient.setTimeout(UpstreamConnectTimeoutSec);
+    client.setSocketTimeout(UpstreamConnectTimeoutSec);
+    client.setBufferSize(UpstreamClientBufferSize);
+    client.setCallback([this](char* topic, byte* payload, unsigned int length) { callback(topic, payload, length); });
+}
+
+void MqttBridge::setupQueue()
+{
+    // After power-on the RTC memory contains garbage, only trust it after a soft reset.
+    const esp_reset_reason_t resetReason = esp_reset_reason();
+    const bool valid = resetReason != ESP_RST_POWERON && resetReason != ESP_RST_BROWNOUT && queue.magic == BridgeQueueMagic
+                       && queue.count <= BridgeQueueSize && queue.tail < BridgeQueueSize;
+    if (valid) {
+        if (queue.count > 0) mqttHandler->addToActionLog("Upstream bridge: restored " + String(queue.count) + " queued events");
+        return;
+    }
+
+    memset(&queue, 0, sizeof(queue));
+    queue.magic = BridgeQueueMagic;
+    queue.epoch = esp_random();
+    queue.nextSeq = 1;
+}
+
+void MqttBridge::loop()
+{
+    if (upstreamHost.isEmpty()) return;
+
+    if (!client.connected()) {
+        if (connected) {
+            connected = false;
+            mqttHandler->addToActionLog("Upstream broker connection lost, " + String(queue.count) + " events queued");
+        }
+        if (!networkHandler->getWifiConnected()) return;
+        if (retryDelayMs > 0 && static_cast<int32_t>(millis() - nextRetryMs) < 0) return;
+        if (!connect()) {
+            retryDelayMs = retryDelayMs == 0 ? BridgeRetryMinMs : min(2 * retryDelayMs, static_cast<uint32_t>(BridgeRetryMaxMs));
+            nextRetryMs = millis() + retryDelayMs;
+            return;
+        }
+    }
+
+    client.loop();
+    publishQueued();
+}
+
+bool MqttBridge::connect()
+{
+    // A DNS lookup blocks as well, so the host is resolved once (a numeric host needs no lookup).
+    if (!upstreamIpResolved) {
+        if (!upstreamIp.fromString(upstreamHost) && !WiFi.hostByName(upstreamHost.c_str(), upstreamIp)) return false;
+        upstreamIpResolved = true;
+        client.setServer(upstreamIp, upstreamPort);
+    }
+
+    // Without credentials, PubSubClient sends none.
+    const char* user = upstreamUser.isEmpty() ? nullptr : upstreamUser.c_str();
+    const char* password = upstreamPassword.isEmpty() ? nullptr : upstreamPassword.c_str();
+    if ((!tlsFingerprint.isEmpty() && !connectSecure()) || !client.connect(UpstreamClientId, user, password)) {
+        // Resolved again at the longest backoff, in case the address of the host changed.
+        if (retryDelayMs >= static_cast<uint32_t>(BridgeRetryMaxMs)) upstreamIpResolved = false;
+        return false;
+    }
+
+    client.subscribe(getUpstreamTopic(UpstreamCommandTopic).c_str());
+    client.subscribe(getUpstreamTopic(UpstreamEchoTopic).c_str());
+
+    // Nothing is confirmed on a new connection, all queued events are sent (again) in order.
+    connected = true;
+    retryDelayMs = 0;
+    numSent = 0;
+    mqttHandler->addToActionLog("Upstream broker " + upstreamHost + " connected, " + String(queue.count) + " events queued");
+    return true;
+}
+
+bool MqttBridge::connectSecure()
+{
+    // The TLS connection is set up before the MQTT connect (PubSubClient takes over a connected client),
+    // so the credentials only go to a server with the pinned certificate.
+    secureClient.setInsecure();
+    if (!secureClient.connect(upstreamIp, upstreamPort)) return false;
+    if (!secureClient.verify(tlsFingerprint.c_str(), nullptr)) {
+        secureClient.stop();
+        mqttHandler->addToActionLog("Upstream broker " + upstreamHost + ": TLS certificate does not match the fingerprint");
+        return false;
+    }
+    return true;
+}
+
+void MqttBridge::publishQueued()
+{
+    // Without an echo in time, the event or its echo got lost, the unconfirmed events are sent again.
+    if (numSent > 0 && millis() - firstSentMs >= static_cast<uint32_t>(BridgeConfirmTimeoutMs)) numSent = 0;
+
+    for (int i = 0; i < MaxBridgePublishesPerLoop && numSent < queue.count; ++i) {
+        const BridgeMessage& message = messageAt(numSent);
+
+        char id[24];
+        snprintf(id, sizeof(id), "%08lx.%lu ", static_cast<unsigned long>(queue.epoch), static_cast<unsigned long>(message.seq));
+        if (!client.publish(getUpstreamTopic(message.topic).c_str(), (String(id) + message.payload).c_str())) break;
+
+        if (message.seq <= highestSentSeq) ++numResent;
+        highestSentSeq = max(highestSentSeq, message.seq);
+        if (numSent == 0) firstSentMs = millis();
+        ++numSent;
+    }
+}
+
+void MqttBridge::callback(char* topic, byte* payload, unsigned int length)
+{
+    String payloadStr = "";
+    for (unsigned int i = 0; i < length; i++) {
+        payloadStr += (char) payload[i];
+    }
+
+    if (String(topic) == getUpstreamTopic(UpstreamCommandTopic)) {
+        ++numCommands;
+        mqttHandler->handleCommand(payloadStr, CommandSource::Upstream);
+    } else {
+        confirm(payloadStr.c_str());
+    }
+}
+
+void MqttBridge::confirm(const char* payload)
+{
+    // The echo of an event only confirms this event, the publishes and echoes are QoS 0 and may get lost.
+    char* end = nullptr;
+    const uint32_t epoch = strtoul(payload, &end, 16);
+    if (*end != '.' || epoch != queue.epoch) return; // not from us (e.g. another device or a previous epoch)
+    const uint32_t seq = strtoul(end + 1, &end, 10);
+    if (*end != ' ') return;
+
+    for (int i = 0; i < numSent; ++i) {
+        if (messageAt(i).seq != seq) continue;
+
+        removeAt(i);
+        ++numForwarded;
+        if (i == 0) {
+            firstSentMs = millis();
+        } else {
+            // MQTT keeps the order, so the events sent before it (or their echoes) got lost.
+            numSent = 0;
+        }
+        return;
+    }
+}
+
+void MqttBridge::enqueue(PublishKind kind, const char* topic, const char* payload)
+{
+    if (upstreamHost.isEmpty()) return;
+
+    if (queue.count == BridgeQueueSize) {
+        // Make room by dropping the least important event, rings are only dropped for newer rings.
+        const bool dropped = dropOldest(PublishKind::AckRing) || dropOldest(PublishKind::AutoBuzzState)
+                             || (kind == PublishKind::Ring && dropOldest(PublishKind::Ring));
+        if (!dropped) {
+            ++numDropped;
+            return;
+        }
+    }
+
+    BridgeMessage& message = messageAt(queue.count);
+    message.seq = queue.nextSeq++;
+    message.kind = kind;
+    strncpy(message.topic, topic, BridgeTopicLength - 1);
+    message.topic[BridgeTopicLength - 1] = '\0';
+    strncpy(message.payload, payload, BridgePayloadLength - 1);
+    message.payload[BridgePayloadLength - 1] = '\0';
+    ++queue.count;
+
+    if (connected) publishQueued();
+}
+
+bool MqttBridge::dropOldest(PublishKind kind)
+{
+    for (int i = 0; i < queue.count; ++i) {
+        if (messageAt(i).kind != kind) continue;
+
+        removeAt(i);
+        ++numDropped;
+        return true;
+    }
+    return false;
+}
+
+void MqttBridge::removeAt(int index)
+{
+    // Close the gap, keeps the order of the remaining events.
+    for (int i = index; i < queue.count - 1; ++i) {
+        messageAt(i) = messageAt(i + 1);
+    }
+    --queue.count;
+    if (index < numSent) --numSent;
+}
+
+void MqttBridge::publishResponse(const char* response)
+{
+    // Responses are not queued, after a lost connection the command has to be sent again anyway.
+    if (connected) client.publish(getUpstreamTopic(UpstreamResponseTopic).c_str(), response);
+}
+
+bool MqttBridge::setUpstream(const String& config)
+{
+    String host;
+    uint16_t port = 0;
+    String user;
+    String password;
+    String fingerprint;
+    bool buzz = false;
+
+    int pos = 0;
+    while (pos < static_cast<int>(config.length())) {
+        int end = config.indexOf(' ', pos);
+        if (end < 0) end = config.length();
+        const String option = config.substring(pos, end);
+        pos = end + 1;
+
+        if (option.isEmpty()) continue;
+        if (option.startsWith(OptPort)) {
+            port = option.substring(strlen(OptPort)).toInt();
+            if (port == 0) return false;
+        } else if (option.startsWith(OptUser)) {
+            user = option.substring(strlen(OptUser));
+        } else if (option.startsWith(OptPassword)) {
+            password = option.substring(strlen(OptPassword));
+        } else if (option.startsWith(OptTls)) {
+            fingerprint = option.substring(strlen(OptTls));
+            if (fingerprint.isEmpty()) return false;
+        } else if (option == OptBuzz) {
+            buzz = true;
+        } else if (host.isEmpty()) {
+            host = option;
+        } else {
+            return false;
+        }
+    }
+    if (host.isEmpty() && (port != 0 || !user.isEmpty() || !password.isEmpty() || !fingerprint.isEmpty() || buzz)) return false;
+
+    if (connected) client.disconnect();
+    if (secureClient.connected()) secureClient.stop();
+    connected = false;
+    retryDelayMs = 0;
+    upstreamIpResolved = false;
+
+    upstreamHost = host;
+    upstreamPort = port != 0 ? port : (fingerprint.isEmpty() ? UpstreamBrokerPort : UpstreamBrokerTlsPort);
+    upstreamUser = user;
+    upstreamPassword = password;
+    tlsFingerprint = fingerprint;
+    buzzAllowed = buzz;
+    client.setClient(tlsFingerprint.isEmpty() ? static_cast<Client&>(wifiClient) : static_cast<Client&>(secureClient));
+    storeConfig();
+
+    mqttHandler->addToActionLog("Upstream broker: " + getStatusStr());
+    return true;
+}
+
+void MqttBridge::loadConfig()
+{
+    preferences.begin(NvsNamespaceBridge, true);
+    upstreamHost = preferences.getString(NvsKeyUpstreamHost, "");
+    upstreamPort = preferences.getInt(NvsKeyUpstreamPort, UpstreamBrokerPort);
+    upstreamUser = preferences.getString(NvsKeyUpstreamUser, "");
+    upstreamPassword = preferences.getString(NvsKeyUpstreamPassword, "");
+    tlsFingerprint = preferences.getString(NvsKeyTlsFingerprint, "");
+    buzzAllowed = preferences.getInt(NvsKeyBuzzAllowed, 0) != 0;
+    preferences.end();
+
+    client.setClient(tlsFingerprint.isEmpty() ? static_cast<Client&>(wifiClient) : static_cast<Client&>(secureClient));
+}
+
+void MqttBridge::storeConfig()
+{
+    preferences.begin(NvsNamespaceBridge, false);
+    preferences.putString(NvsKeyUpstreamHost, upstreamHost);
+    preferences.putInt(NvsKeyUpstreamPort, upstreamPort);
+    preferences.putString(NvsKeyUpstreamUser, upstreamUser);
+    preferences.putString(NvsKeyUpstreamPassword, upstreamPassword);
+    preferences.putString(NvsKeyTlsFingerprint, tlsFingerprint);
+    preferences.putInt(NvsKeyBuzzAllowed, buzzAllowed ? 1 : 0);
+    preferences.end();
+}
+
+String MqttBridge::getStatusStr() const
+{
+    if (upstreamHost.isEmpty()) return "upstream off";
+
+    // The password is never shown.
+    String status = "upstream " + upstreamHost + ":" + String(upstreamPort);
+    if (!tlsFingerprint.isEmpty()) status += " tls";
+    if (!upstreamUser.isEmpty()) status += " user " + upstreamUser;
+    if (buzzAllowed) status += " buzz";
+    return status + (connected ? " connected" : " not connected") + ", queued: " + String(queue.count)
+           + ", forwarded: " + String(numForwarded) + ", resent: " + String(numResent) + ", dropped: " + String(numDropped)
+           + ", commands: " + String(numCommands);
+}
+
+bool MqttBridge::getBuzzAllowed() const
+{
+    return buzzAllowed;
+}
+
+BridgeMessage& MqttBridge::messageAt(int index)
+{
+    return queue.messages[(queue.tail + index) % BridgeQueueSize];
+}
+
+String MqttBridge::getUpstreamTopic(const char* topic) const
+{
+    return String(UpstreamTopicPrefix) + topic;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "publishQueue.h"
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <PubSubClient.h>
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+
+constexpr int BridgeQueueSize = 16;
+constexpr int BridgeTopicLength = 32;
+constexpr int BridgePayloadLength = 96;
+
+class App;
+class MqttHandler;
+class NetworkHandler;
+
+// Event for the upstream broker, numbered by the bridge
+struct BridgeMessage final
+{
+    uint32_t seq;
+    PublishKind kind;
+    char topic[BridgeTopicLength]; // below the upstream topic prefix
+    char payload[BridgePayloadLength];
+};
+
+// Outbound queue in RTC memory, survives a soft reset (but not a power cycle).
+struct BridgeQueueData final
+{
+    uint32_t magic;
+    uint32_t epoch; // random per power cycle, sequence numbers restart with a new epoch
+    uint32_t nextSeq;
+    uint8_t tail;
+    uint8_t count;
+    BridgeMessage messages[BridgeQueueSize];
+};
+
+// Optional store-and-forward bridge to an upstream MQTT broker (off until an upstream host is set).
+// Ring events are published below UpstreamTopicPrefix with the id "<epoch>.<seq>" as first word of the payload.
+// Each stays queued until the upstream broker echoes it back (we subscribe to our own topics). Unconfirmed
+// events are sent again in order after a reconnect, a missing echo or an echo of a later event, so consumers
+// drop ids they already got.
+// Commands on <prefix>/cmd are executed like local ones (only those allowed from upstream, see MqttHandler),
+// their responses go to <prefix>/response.
+// The connection can use credentials and TLS, the server certificate is pinned by its SHA-256 fingerprint.
+class MqttBridge final
+{
+public:
+    MqttBridge(App* app);
+
+    void setup();
+    void loop();
+
+    // "<host> [port=<port>] [user=<name>] [password=<password>] [tls=<fingerprint>] [buzz]", kept in NVS.
+    // Empty switches the bridge off, buzz allows the door buzzer from upstream. Returns false for invalid options.
+    bool setUpstream(const String& config);
+    String getStatusStr() const;
+    bool getBuzzAllowed() const;
+
+    // If the queue is full, events are dropped like in the PublishQueue, never a ring for another kind.
+    void enqueue(PublishKind kind, const char* topic, const char* payload);
+    void publishResponse(const char* response);
+
+private:
+    void setupQueue();
+    void loadConfig();
+    void storeConfig();
+    bool connect();
+    bool connectSecure();
+    void publishQueued();
+    void callback(char* topic, byte* payload, unsigned int length);
+    void confirm(const char* payload);
+    bool dropOldest(PublishKind kind);
+    void removeAt(int index);
+
+    BridgeMessage& messageAt(int index);
+    String getUpstreamTopic(const char* topic) const;
+
+    // Connection to other components
+    App* const app;
+    MqttHandler* mqttHandler = nullptr;
+    NetworkHandler* networkHandler = nullptr;
+
+    WiFiClient wifiClient;
+    WiFiClientSecure secureClient;
+    PubSubClient client;
+    Preferences preferences;
+    IPAddress upstreamIp;
+    bool upstreamIpResolved = false;
+
+    // Configuration (setUpstream)
+    String upstreamHost;
+    uint16_t upstreamPort = 0;
+    String upstreamUser;
+    String upstreamPassword;
+    String tlsFingerprint; // empty without TLS
+    bool buzzAllowed = false;
+
+    // Connection with backoff between failed attempts, as a connect blocks the loop
+    bool connected = false;
+    uint32_t retryDelayMs = 0;
+    uint32_t nextRetryMs = 0;
+
+    // Queue entries [0, numSent) are published on the current connection and wait for their echo,
+    // the first one since firstSentMs
+    int numSent = 0;
+    uint32_t firstSentMs = 0;
+    uint32_t highestSentSeq = 0;
+
+    // Counters
+    uint32_t numForwarded = 0;
+    uint32_t numResent = 0;
+    uint32_t numDropped = 0;
+    uint32_t numCommands = 0;
+};
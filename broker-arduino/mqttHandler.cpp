@@ -1,8 +1,13 @@
 #include "mqttHandler.h"
 
 #include "app.h"
+#include "gpioConfig.h"
 #include "networkHandler.h"
+#include "params.h"
+#include "rtcLog.h"
+#include "settingsStore.h"
 #include "stateGpioHandler.h"
+#include "timing.h"
 
 using namespace mqttBrokerName;
 
@@ -10,10 +15,29 @@ using namespace mqttBrokerName;
 const char* MqttServerAddr = "localhost";
 constexpr int MqttBrokerPort = 1883;
 
-// Topics
+// Broker capacity. Every broker client costs a task, a socket and its buffers
+// inside the embedded broker, so the limit is derived from the free heap.
+// The sockets bound it as well: lwIP has CONFIG_LWIP_MAX_SOCKETS of them (16 in the prebuilt Arduino core,
+// 32+ clients need a build with more), the listening socket, the local client and the bridge take one each.
+constexpr int MqttOtherSockets = 3;
+constexpr int MqttMaxNumClients = CONFIG_LWIP_MAX_SOCKETS - MqttOtherSockets;
+constexpr int MqttMinNumClients = 2;                // local client + one subscriber
+constexpr uint32_t MqttEstimatedClientHeap = 6144;  // until measured with the local client
+constexpr uint32_t MqttHeapReserve = 32 * 1024;     // kept free for WiFi, NTP and logs
+constexpr int MqttHeapCostSamples = 4;              // sessions of the local client the heap cost is averaged over
+constexpr int MqttClientBufferSize = 1024;
+
+// Queued events published per loop cycle, so GPIO handling is not starved.
+constexpr int MaxPublishesPerLoop = 3;
+
+// Failed in-place recovery attempts (MqttRetryMs apart) until the device is rebooted
+constexpr int MqttMaxRecoveryAttempts = 5;
+
+// Topics, ring and ack events are published on doorRing/<ring input name>
 const char* CommandTopic = "cmd";
 const char* RingTopic = "doorRing";
 const char* ResponseTopic = "response";
+const char* SessionProbeTopic = "sessionProbe"; // the local client sends itself a message to see that its session is set up
 
 // Commands
 const char* CmdBuzz = "buzz";
@@ -22,10 +46,20 @@ const char* CmdAutoBuzzOff = "autoBuzzOff";
 const char* CmdGetActionLog = "getActionLog";
 const char* CmdGetAutoBuzz = "getAutoBuzz";
 const char* CmdGetStartTime = "getStartTime";
-const char* CmdTestRing = "testRing";
-const char* CmdPing = "ping";
-const char* CmdAckRing = "ackRing";
-const char* CmdRawData = "getRawData";
+const char* CmdTestRing = "testRing";     // testRing [<ring input>]
+const char* CmdPing = "ping";             // ping [<token>], the pong echoes the token with the device time
+const char* CmdAckRing = "ackRing";       // ackRing [<ring input>], all inputs without a name
+const char* CmdRawData = "getRawData";    // getRawData [<ring input>]
+const char* CmdStartTrace = "startTrace"; // startTrace [<ring input>]
+const char* CmdStopTrace = "stopTrace";   // stopTrace [<ring input>]
+const char* CmdGetTrace = "getTrace";     // getTrace [<ring input>]
+const char* CmdGetParams = "getParams";
+const char* CmdSetParam = "setParam ";      // setParam <name> <value>
+const char* CmdSetUpstream = "setUpstream"; // setUpstream [<host> <options>], without a host the bridge is off (see MqttBridge)
+const char* CmdGetUpstream = "getUpstream";
+
+// Commands may start with a correlation id, "#<id> <command>", which is echoed in front of each response.
+const char* CorrelationIdMarker = "#";
 
 // Messages
 const char* MsgRing = "ring";
@@ -36,44 +70,129 @@ const char* MsgAutoBuzzOff = "autoBuzzOff";
 const char* MsgPong = "pong";
 const char* MsgBuzzAck = "buzzAck";
 const char* MsgEndMultiResponse = "endMultiResponse";
+const char* MsgTiming = "t=";
+
+// Matches "<cmd>" and "<cmd> <arg>", arg is empty for the first form.
+bool matchCommand(const String& payload, const char* cmd, String& arg)
+{
+    const unsigned int cmdLength = strlen(cmd);
+    if (!payload.startsWith(cmd)) return false;
+    if (payload.length() == cmdLength) {
+        arg = "";
+        return true;
+    }
+    if (payload[cmdLength] != ' ') return false;
+    arg = payload.substring(cmdLength + 1);
+    return true;
+}
 
 MqttHandler::MqttHandler(App* app)
     : app(app)
     , broker(MqttBrokerPort)
     , espClient()
     , client(espClient)
+    , bridge(app)
+    , recoveryTimer(msToCycles(MqttRetryMs, MainLoopSampleTimeMs), true)
 {}
 
-void MqttHandler::reconnectMqttClient()
-{
-    while (!client.connected()) {
-        Serial.print("[MQTT] Connect...");
-        if (client.connect("DoorbellBrokerESP32")) {
-            Serial.println("[MQTT] connected");
-            client.subscribe(CommandTopic);
-            Serial.print("[MQTT] subscribed to topic: ");
-            Serial.println(CommandTopic);
-        } else {
-            Serial.print("[MQTT] error, rc=");
-            Serial.println(client.state());
-            stateGpioHandler->waitSeconds(3);
-        }
+bool MqttHandler::connectMqttClient()
+{
+    Serial.print("[MQTT] Connect...");
+    const uint32_t freeHeapBeforeConnect = ESP.getFreeHeap();
+    if (!client.connect("DoorbellBrokerESP32")) {
+        Serial.print("[MQTT] error, rc=");
+        Serial.println(client.state());
+        return false;
+    }
+
+    Serial.println("[MQTT] connected");
+    client.subscribe(CommandTopic);
+    Serial.print("[MQTT] subscribed to topic: ");
+    Serial.println(CommandTopic);
+
+    // The broker task sets up the session after the connect, the heap is measured when the probe came back.
+    if (numHeapCostSamples < MqttHeapCostSamples) {
+        freeHeapBeforeSession = freeHeapBeforeConnect;
+        sessionProbePending = client.subscribe(SessionProbeTopic) && client.publish(SessionProbeTopic, "");
     }
+    return true;
+}
+
+void MqttHandler::restartMqttBroker()
+{
+    Serial.println("[MQTT] Restart broker");
+    client.disconnect();
+    broker.stopBroker();
+    broker.startBroker();
+}
+
+void MqttHandler::recoverMqttConnection()
+{
+    // Escalation: reconnect the client, restart the broker in place if that fails,
+    // reboot only after MqttMaxRecoveryAttempts failed attempts.
+    if (recoveryAttempts >= MqttMaxRecoveryAttempts) {
+        addToActionLog("MQTT recovery failed after " + String(recoveryAttempts) + " attempts, reboot");
+        stateGpioHandler->reboot(RebootCause::MqttRecoveryFailed);
+        return;
+    }
+
+    ++recoveryAttempts;
+    if (!connectMqttClient()) {
+        restartMqttBroker();
+        if (!connectMqttClient()) return;
+    }
+
+    if (recovering) {
+        const uint32_t recoveryMs = millis() - connectionLostMs;
+        ++numRecoveries;
+        maxRecoveryMs = max(maxRecoveryMs, recoveryMs);
+        addToActionLog("MQTT recovered in place after " + String(recoveryMs) + " ms, " + String(recoveryAttempts)
+                       + " attempt(s) (recoveries: " + String(numRecoveries) + ", max: " + String(maxRecoveryMs) + " ms)");
+        recovering = false;
+    }
+    recoveryAttempts = 0;
 }
 
 void MqttHandler::setupMqttBroker()
 {
     // Start the mqtt broker.
     // Does not need anything in the "loop" part!
-    broker.setMaxNumClients(9); // set according to your system.
+    maxNumClients = getMaxNumClientsForHeap(ESP.getFreeHeap(), MqttEstimatedClientHeap);
+    broker.setMaxNumClients(maxNumClients);
     broker.startBroker();
-    Serial.println("MQTT broker started");
+    Serial.println("MQTT broker started, max clients: " + String(maxNumClients));
+}
+
+int MqttHandler::getMaxNumClientsForHeap(uint32_t freeHeap, uint32_t heapPerClient) const
+{
+    if (freeHeap <= MqttHeapReserve || heapPerClient == 0) return MqttMinNumClients;
+    const int numClients = (freeHeap - MqttHeapReserve) / heapPerClient;
+    return constrain(numClients, MqttMinNumClients, MqttMaxNumClients);
+}
+
+void MqttHandler::measureClientHeapCost()
+{
+    // The local client is a broker client like every other subscriber, so the heap its session consumes
+    // is the cost of one client (both ends). A sample after a recovery may include reconnecting subscribers,
+    // that only lowers the limit.
+    const uint32_t freeHeap = ESP.getFreeHeap();
+    if (freeHeap >= freeHeapBeforeSession) return;
+
+    clientHeapCostSum += freeHeapBeforeSession - freeHeap;
+    ++numHeapCostSamples;
+    clientHeapCost = clientHeapCostSum / numHeapCostSamples;
+    maxNumClients = getMaxNumClientsForHeap(freeHeap, clientHeapCost) + 1; // +1: the local client is already connected
+    maxNumClients = min(maxNumClients, MqttMaxNumClients);
+    broker.setMaxNumClients(maxNumClients);
+
+    addToActionLog("MQTT client heap cost: " + String(clientHeapCost) + " bytes (" + String(numHeapCostSamples)
+                   + " session(s)), free heap: " + String(freeHeap) + " bytes, max clients: " + String(maxNumClients));
 }
 
 void MqttHandler::setupMqttClient()
 {
-    client.setBufferSize(1024);
-    client.setServer(MqttServerAddr, 1883);
+    client.setBufferSize(MqttClientBufferSize);
+    client.setServer(MqttServerAddr, MqttBrokerPort);
     client.setCallback([this](char* topic, byte* payload, unsigned int length) { callbackMqtt(topic, payload, length); });
     Serial.println("MQTT Client started.");
 }
@@ -83,15 +202,25 @@ void MqttHandler::setup()
     Serial.println("Setup MqttHandler");
     stateGpioHandler = app->getStateGpioHandler();
     networkHandler = app->getNetworkHandler();
+    rtcLog = app->getRtcLog();
 
     startTime = networkHandler->getDateTime();
+    replayRtcLog();
     addToActionLog(String("Device started, initial autoBuzz is ") + (stateGpioHandler->getAutoBuzzState() ? "on" : "off"));
     if (!networkHandler->hasValidTime()) {
         networkHandler->setRequestLogWhenValidTime();
     }
 
+    applyParams();
     setupMqttBroker();
     setupMqttClient();
+    bridge.setup();
+}
+
+void MqttHandler::applyParams()
+{
+    // The recovery timer counts loop cycles, it is converted with the current loop period.
+    recoveryTimer.setCycles(msToCycles(MqttRetryMs, app->getLoopMs()));
 }
 
 void MqttHandler::loop()
@@ -100,51 +229,88 @@ void MqttHandler::loop()
     if (!client.connected()) {
         if (mqttConnected) {
             mqttConnected = false;
-            // We were alread connected: MQTT Server probably crashed, reboot the Arduino
-            Serial.println("MQTT connection lost, reboot...");
-            stateGpioHandler->reboot();
+            // We were already connected: MQTT Server probably crashed, recover it without a reboot
+            Serial.println("MQTT connection lost, recover...");
+            addToActionLog("MQTT connection lost");
+            recovering = true;
+            connectionLostMs = millis();
+            recoveryTimer.start();
+            if (networkHandler->getWifiConnected()) recoverMqttConnection();
             return;
         }
-        reconnectMqttClient();
+        // Non-blocking: one attempt every MqttRetryMs, the first one immediately. Without WiFi the attempts
+        // fail anyway, they neither run nor count, long outages are handled by the WiFi supervisor.
+        if (networkHandler->getWifiConnected() && recoveryTimer.checkAndDecrement()) recoverMqttConnection();
     } else {
+        if (!mqttConnected && !publishQueue.empty()) reportFlush = true;
         mqttConnected = true;
         client.loop();
+        flushPublishQueue();
+    }
+
+    // The upstream bridge has its own connection and queue, independent of the local broker.
+    bridge.loop();
+}
+
+void MqttHandler::onWifiReconnected()
+{
+    // Failed attempts before the outage may have been caused by it, counting towards the reboot starts again.
+    recoveryAttempts = 0;
+}
+
+void MqttHandler::enqueuePublish(PublishKind kind, const char* subtopic, const String& payload, uint32_t eventMs)
+{
+    publishQueue.push(kind, subtopic, payload.c_str(), millis(), eventMs);
+    bridge.enqueue(kind, getRingTopic(subtopic).c_str(), payload.c_str());
+    flushPublishQueue();
+}
+
+String MqttHandler::getRingTopic(const char* subtopic) const
+{
+    return subtopic ? String(RingTopic) + "/" + subtopic : String(RingTopic);
+}
+
+String MqttHandler::getPublishPayload(const QueuedMessage& message) const
+{
+    // Rings end with "t=<edge>,<publish>" (ms since device start), so clients can trace the latency per stage.
+    if (message.kind != PublishKind::Ring) return message.payload;
+    return String(message.payload) + " " + MsgTiming + String(message.tsEventMs) + "," + String(millis());
+}
+
+void MqttHandler::flushPublishQueue()
+{
+    // While WiFi is down, no client could receive the events, so they stay queued.
+    // Just after an outage, they wait for the clients to reconnect, unless a live ring is queued:
+    // it goes out at once, after the events queued before it.
+    const bool holdForClients = !networkHandler->isWifiSettled() && !publishQueue.hasRingSince(millis() - LiveRingMs);
+    if (!client.connected() || !networkHandler->getWifiConnected() || holdForClients) {
+        if (!publishQueue.empty()) reportFlush = true;
+        return;
+    }
+
+    for (int i = 0; i < MaxPublishesPerLoop && !publishQueue.empty(); ++i) {
+        const QueuedMessage& message = publishQueue.front();
+        if (!client.publish(getRingTopic(message.subtopic).c_str(), getPublishPayload(message).c_str())) break;
+        publishQueue.pop(millis());
+    }
+
+    if (reportFlush && publishQueue.empty()) {
+        reportFlush = false;
+        addToActionLog("Flushed publish queue (" + publishQueue.getStatsStr() + ")");
     }
 }
 
 void MqttHandler::callbackMqtt(char* topic, byte* payload, unsigned int length)
 {
-    if (String(topic) == CommandTopic) {
+    if (sessionProbePending && strcmp(topic, SessionProbeTopic) == 0) {
+        sessionProbePending = false;
+        measureClientHeapCost();
+    } else if (String(topic) == CommandTopic) {
         String payloadStr = "";
         for (unsigned int i = 0; i < length; i++) {
             payloadStr += (char) payload[i];
         }
-
-        if (payloadStr == CmdBuzz) {
-            stateGpioHandler->buzz();
-            client.publish(ResponseTopic, MsgBuzzAck);
-        } else if (payloadStr == CmdAutoBuzzOn) {
-            stateGpioHandler->setAutoBuzzState(true);
-        } else if (payloadStr == CmdAutoBuzzOff) {
-            stateGpioHandler->setAutoBuzzState(false);
-        } else if (payloadStr == CmdTestRing) {
-            stateGpioHandler->ring(true);
-        } else if (payloadStr == CmdGetActionLog) {
-            showActionLog();
-        } else if (payloadStr == CmdPing) {
-            client.publish(ResponseTopic, MsgPong);
-        } else if (payloadStr == CmdGetAutoBuzz) {
-            client.publish(ResponseTopic, stateGpioHandler->getAutoBuzzState() ? MsgAutoBuzzOn : MsgAutoBuzzOff);
-        } else if (payloadStr == CmdAckRing) {
-            stateGpioHandler->ackRing();
-        } else if (payloadStr == CmdRawData) {
-            showRawData();
-        } else if (payloadStr == CmdGetStartTime) {
-            client.publish(ResponseTopic, startTime.c_str());
-        } else {
-            Serial.print("[MQTT] received unknown command: ");
-            Serial.println(payloadStr);
-        }
+        handleCommand(payloadStr, CommandSource::Local);
     } else {
         // should not happen, we are not subscribed to other topics
         Serial.print("[MQTT] received data on unexpected topic: ");
@@ -152,54 +318,258 @@ void MqttHandler::callbackMqtt(char* topic, byte* payload, unsigned int length)
     }
 }
 
+void MqttHandler::handleCommand(const String& payloadStr, CommandSource source)
+{
+    // Responses go back to where the command came from, with the correlation id of the command ("#<id> <command>") in front.
+    commandSource = source;
+    const int idEnd = payloadStr.startsWith(CorrelationIdMarker) ? payloadStr.indexOf(' ') : -1;
+    if (idEnd > 0) responsePrefix = payloadStr.substring(0, idEnd + 1);
+    const String command = idEnd > 0 ? payloadStr.substring(idEnd + 1) : payloadStr;
+
+    if (source == CommandSource::Upstream && !isAllowedFromUpstream(command)) {
+        addToActionLog("Rejected command from upstream: " + command);
+        publishResponse("error: not allowed from upstream");
+    } else {
+        executeCommand(command);
+    }
+    responsePrefix = "";
+    commandSource = CommandSource::Local;
+}
+
+bool MqttHandler::isAllowedFromUpstream(const String& payloadStr) const
+{
+    // The upstream broker is another network: queries and ring acks only, the door buzzer if enabled with
+    // setUpstream. Configuration (setParam, setUpstream), traces and test rings (they switch the ext bell) stay local.
+    String arg;
+    if (payloadStr == CmdBuzz || payloadStr == CmdAutoBuzzOn || payloadStr == CmdAutoBuzzOff) return bridge.getBuzzAllowed();
+    return matchCommand(payloadStr, CmdPing, arg) || matchCommand(payloadStr, CmdAckRing, arg) || payloadStr == CmdGetAutoBuzz
+           || payloadStr == CmdGetActionLog || payloadStr == CmdGetStartTime || payloadStr == CmdGetParams
+           || payloadStr == CmdGetUpstream || matchCommand(payloadStr, CmdRawData, arg) || matchCommand(payloadStr, CmdGetTrace, arg);
+}
+
+void MqttHandler::executeCommand(const String& payloadStr)
+{
+    String arg;
+    int ringInput = -1;
+
+    if (payloadStr == CmdBuzz) {
+        stateGpioHandler->buzz();
+        publishResponse(MsgBuzzAck);
+    } else if (payloadStr == CmdAutoBuzzOn) {
+        stateGpioHandler->setAutoBuzzState(true);
+    } else if (payloadStr == CmdAutoBuzzOff) {
+        stateGpioHandler->setAutoBuzzState(false);
+    } else if (matchCommand(payloadStr, CmdTestRing, arg)) {
+        if ((ringInput = findRingInput(arg)) >= 0) stateGpioHandler->ring(ringInput, true);
+    } else if (payloadStr == CmdGetActionLog) {
+        showActionLog();
+    } else if (matchCommand(payloadStr, CmdPing, arg)) {
+        // "pong <token> <ms since device start>" lets clients estimate the clock offset from the round trip.
+        if (arg.isEmpty()) publishResponse(MsgPong);
+        else publishResponse((String(MsgPong) + " " + arg + " " + String(millis())).c_str());
+        if (bootToFirstPingMs == 0) {
+            bootToFirstPingMs = millis();
+            addToActionLog("Boot to first ping: " + String(bootToFirstPingMs) + " ms");
+        }
+    } else if (payloadStr == CmdGetAutoBuzz) {
+        publishResponse(stateGpioHandler->getAutoBuzzState() ? MsgAutoBuzzOn : MsgAutoBuzzOff);
+    } else if (matchCommand(payloadStr, CmdAckRing, arg)) {
+        if (arg.isEmpty()) {
+            stateGpioHandler->ackAllRings();
+        } else if ((ringInput = findRingInput(arg)) >= 0) {
+            stateGpioHandler->ackRing(ringInput);
+        }
+    } else if (matchCommand(payloadStr, CmdRawData, arg)) {
+        showRawData(findRingInput(arg));
+    } else if (matchCommand(payloadStr, CmdStartTrace, arg)) {
+        if ((ringInput = findRingInput(arg)) >= 0) stateGpioHandler->setRingTraceEnabled(ringInput, true);
+    } else if (matchCommand(payloadStr, CmdStopTrace, arg)) {
+        if ((ringInput = findRingInput(arg)) >= 0) stateGpioHandler->setRingTraceEnabled(ringInput, false);
+    } else if (matchCommand(payloadStr, CmdGetTrace, arg)) {
+        showTrace(findRingInput(arg));
+    } else if (payloadStr == CmdGetParams) {
+        showParams();
+    } else if (payloadStr.startsWith(CmdSetParam)) {
+        setParam(payloadStr.substring(strlen(CmdSetParam)));
+    } else if (payloadStr == CmdGetStartTime) {
+        String startTimeStr = startTime;
+        if (bootToFirstPingMs > 0) startTimeStr += ", boot to first ping: " + String(bootToFirstPingMs) + " ms";
+        publishResponse(startTimeStr.c_str());
+    } else if (matchCommand(payloadStr, CmdSetUpstream, arg)) {
+        publishResponse(bridge.setUpstream(arg) ? bridge.getStatusStr().c_str() : "error: invalid upstream options");
+    } else if (payloadStr == CmdGetUpstream) {
+        publishResponse(bridge.getStatusStr().c_str());
+    } else {
+        Serial.print("[MQTT] received unknown command: ");
+        Serial.println(payloadStr);
+    }
+}
+
+void MqttHandler::publishResponse(const char* response)
+{
+    if (!responsePrefix.isEmpty()) {
+        const String prefixedResponse = responsePrefix + response;
+        publishResponseTo(prefixedResponse.c_str());
+    } else {
+        publishResponseTo(response);
+    }
+}
+
+void MqttHandler::publishResponseTo(const char* response)
+{
+    if (commandSource == CommandSource::Upstream) {
+        bridge.publishResponse(response);
+    } else {
+        client.publish(ResponseTopic, response);
+    }
+}
+
+int MqttHandler::findRingInput(const String& name) const
+{
+    // Without a name, commands refer to the first ring input.
+    if (name.isEmpty()) return 0;
+    const int index = stateGpioHandler->findRingInput(name);
+    if (index < 0) {
+        Serial.print("[MQTT] unknown ring input: ");
+        Serial.println(name);
+    }
+    return index;
+}
+
 void MqttHandler::addToActionLog(const String& action)
 {
     actionLog.push(networkHandler->getDateTime() + " " + action);
+    rtcLog->addRecord(action.c_str());
 }
 
-void MqttHandler::showRawData()
+void MqttHandler::updateStartTime()
 {
-    const auto& rawDataStrings = stateGpioHandler->getArchivedRawDataStrings();
+    // NTP is synced after the start, so the first NTP time is some seconds later.
+    startTime = networkHandler->getDateTime() + " (NTP sync, " + String(millis() / 1000) + " s after start)";
+}
 
-    for (int i = 0; i < rawDataStrings.size(); ++i) {
-        client.publish(ResponseTopic, rawDataStrings.at(i).c_str());
+void MqttHandler::replayRtcLog()
+{
+    // Replayed records only go to the action log, the RTC log of this boot starts empty.
+    const String now = networkHandler->getDateTime();
+    const int numRecords = rtcLog->getNumPreviousRecords();
+    for (int i = 0; i < numRecords; ++i) {
+        const auto& record = rtcLog->getPreviousRecord(i);
+        actionLog.push(now + " [before reset, " + String(record.tsMs / 1000) + "s after start] " + record.text);
     }
 
-    const String lastString = stateGpioHandler->getCurrentRawDataStr();
-    if (lastString.length() > 0) {
-        client.publish(ResponseTopic, lastString.c_str());
+    addToActionLog(rtcLog->getPreviousBootSummary());
+    if (!rtcLog->hasPreviousBoot()) return;
+    for (int i = 0; i < NumRingInputs; ++i) {
+        if (rtcLog->getPreviousBoot().ringActiveMask & (1 << i)) {
+            addToActionLog(String("Restored active ring of ") + RingInputs[i].name + " from before reset");
+        }
     }
+    if (rtcLog->getPreviousBoot().doorBuzzerScheduled) addToActionLog("Door buzzer was pending before reset, not repeated");
+    if (rtcLog->getPreviousBoot().extBellScheduled) addToActionLog("Ext bell was pending before reset, not repeated");
+}
+
+void MqttHandler::showRawData(int ringInput)
+{
+    // An unknown input gives an empty response.
+    if (ringInput >= 0) {
+        const auto& rawDataStrings = stateGpioHandler->getArchivedRawDataStrings(ringInput);
+
+        for (int i = 0; i < rawDataStrings.size(); ++i) {
+            publishResponse(rawDataStrings.at(i).c_str());
+        }
 
-    client.publish(ResponseTopic, MsgEndMultiResponse);
+        const String lastString = stateGpioHandler->getCurrentRawDataStr(ringInput);
+        if (lastString.length() > 0) {
+            publishResponse(lastString.c_str());
+        }
+    }
+
+    publishResponse(MsgEndMultiResponse);
 }
 
-void MqttHandler::writeAutoBuzzStateToLogAndMqtt(bool newAutoBuzzState)
+void MqttHandler::showTrace(int ringInput)
+{
+    // Lines in the trace file format of broker-sim, the response can be saved as a trace file.
+    if (ringInput >= 0) {
+        const RingInputConfig& config = stateGpioHandler->getRingInputConfig(ringInput);
+        publishResponse(("# doorbell input trace, " + String(config.name) + " (pin " + String(config.pin) + "), captured at "
+                                       + networkHandler->getDateTime())
+                                          .c_str());
+        publishResponse(("period " + String(app->getLoopMs())).c_str());
+
+        for (const auto& sample : stateGpioHandler->getRingTrace(ringInput)) {
+            publishResponse((String(sample.tsMs) + " " + (sample.pressed ? "1" : "0")).c_str());
+        }
+    }
+
+    publishResponse(MsgEndMultiResponse);
+}
+
+void MqttHandler::showParams()
 {
-    client.publish(RingTopic, newAutoBuzzState ? MsgAutoBuzzOn : MsgAutoBuzzOff);
-    actionLog.push(networkHandler->getDateTime() + " autoBuzz " + (newAutoBuzzState ? "on" : "off"));
+    const SettingsStore* settingsStore = app->getSettingsStore();
+    for (const auto& param : ParamDefinitions) {
+        publishResponse(getParamStr(param, settingsStore->getInt(param.setting)).c_str());
+    }
+    publishResponse(("loop load " + app->getLoopLoadStr()).c_str());
+    publishResponse(("relay pulses " + stateGpioHandler->getRelayStatsStr()).c_str());
+
+    publishResponse(MsgEndMultiResponse);
 }
 
-void MqttHandler::writeAckRingToMqtt()
+void MqttHandler::setParam(const String& args)
 {
-    if (client.connected()) {
-        client.publish(RingTopic, MsgAckRing);
+    const int separator = args.indexOf(' ');
+    const String name = separator < 0 ? args : args.substring(0, separator);
+    const String valueStr = separator < 0 ? "" : args.substring(separator + 1);
+
+    const ParamDefinition* param = findParam(name);
+    if (!param) {
+        publishResponse(("error: unknown param " + name).c_str());
+        return;
     }
+    const int32_t value = valueStr.toInt();
+    if (String(value) != valueStr || value < param->minValue || value > param->maxValue) {
+        const String rangeStr = String(param->minValue) + ".." + String(param->maxValue);
+        publishResponse(("error: invalid value " + valueStr + " for " + name + " (" + rangeStr + ")").c_str());
+        return;
+    }
+
+    // The load is logged again once measured with the new value.
+    SettingsStore* settingsStore = app->getSettingsStore();
+    const int32_t oldValue = settingsStore->getInt(param->setting);
+    addToActionLog("Param " + name + " " + String(oldValue) + " -> " + String(value) + ", loop load " + app->getLoopLoadStr());
+    settingsStore->setInt(param->setting, value);
+    app->applyParams();
+
+    publishResponse(getParamStr(*param, value).c_str());
+}
+
+void MqttHandler::writeAutoBuzzStateToLogAndMqtt(bool newAutoBuzzState)
+{
+    enqueuePublish(PublishKind::AutoBuzzState, nullptr, newAutoBuzzState ? MsgAutoBuzzOn : MsgAutoBuzzOff, millis());
+    addToActionLog(String("autoBuzz ") + (newAutoBuzzState ? "on" : "off"));
+}
+
+void MqttHandler::writeAckRingToMqtt(const char* ringInputName)
+{
+    enqueuePublish(PublishKind::AckRing, ringInputName, MsgAckRing, millis());
 }
 
-void MqttHandler::writeRingToMqttAndLog(bool testRing)
+void MqttHandler::writeRingToMqttAndLog(const char* ringInputName, bool testRing, uint32_t edgeMs)
 {
     const String ringStr = testRing ? MsgTestRing : MsgRing;
 
-    addToActionLog(ringStr);
+    addToActionLog(ringStr + " " + ringInputName);
 
-    if (client.connected()) {
-        String pubString = ringStr + " ";
-        if (stateGpioHandler->getAutoBuzzState() && !testRing) pubString += "auto buzz, ";
-        pubString += networkHandler->getDateTime();
-        client.publish(RingTopic, pubString.c_str());
-    } else {
-        Serial.println("MQTT not connected, cannot publish ring event");
+    String pubString = ringStr + " ";
+    if (stateGpioHandler->getAutoBuzzState() && !testRing) pubString += "auto buzz, ";
+    pubString += networkHandler->getDateTime();
+    if (!client.connected()) {
+        Serial.println("MQTT not connected, ring event queued");
     }
+    enqueuePublish(PublishKind::Ring, ringInputName, pubString, edgeMs);
 }
 
 void MqttHandler::writeBuzzToLog(bool autoBuzz)
@@ -207,16 +577,26 @@ void MqttHandler::writeBuzzToLog(bool autoBuzz)
     addToActionLog(String{"buzz "} + (autoBuzz ? "(auto)" : "(manual)"));
 }
 
+void MqttHandler::writeRelayPulseToLog(const char* relayName, uint32_t durationUs, uint32_t requestedMs)
+{
+    addToActionLog(String(relayName) + " pulse " + String(durationUs / 1000.0, 1) + " ms (requested " + String(requestedMs) + " ms)");
+}
+
 void MqttHandler::showActionLog()
 {
     for (const auto& entry : actionLog) {
-        client.publish(ResponseTopic, entry.c_str());
+        publishResponse(entry.c_str());
     }
 
-    client.publish(ResponseTopic, MsgEndMultiResponse);
+    publishResponse(MsgEndMultiResponse);
 }
 
 bool MqttHandler::getMqttConnected() const
 {
     return mqttConnected;
+}
+
+const PublishQueue& MqttHandler::getPublishQueue() const
+{
+    return publishQueue;
 }
\ No newline at end of file
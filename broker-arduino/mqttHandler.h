@@ -1,6 +1,9 @@
 #pragma once
 
 #include "circularArray.h"
+#include "mqttBridge.h"
+#include "publishQueue.h"
+#include "timer.h"
 
 #include <Arduino.h>
 #include <EmbeddedMqttBroker.h>
@@ -11,6 +14,14 @@ constexpr int ActionLogSize = 50;
 class App;
 class StateGpioHandler;
 class NetworkHandler;
+class RtcLog;
+
+// Origin of a command, the response is published there
+enum class CommandSource : uint8_t
+{
+    Local,
+    Upstream,
+};
 
 class MqttHandler final
 {
@@ -19,35 +30,79 @@ public:
 
     void loop();
     void setup();
-    void reconnectMqttClient();
+    void applyParams();
 
-    void writeRingToMqttAndLog(bool testRing);
+    void writeRingToMqttAndLog(const char* ringInputName, bool testRing, uint32_t edgeMs);
     void writeBuzzToLog(bool autoBuzz);
+    void writeRelayPulseToLog(const char* relayName, uint32_t durationUs, uint32_t requestedMs);
     void writeAutoBuzzStateToLogAndMqtt(bool newAutoBuzzState);
-    void writeAckRingToMqtt();
+    void writeAckRingToMqtt(const char* ringInputName);
     bool getMqttConnected() const;
+    const PublishQueue& getPublishQueue() const;
     void addToActionLog(const String& action);
+    void updateStartTime();
+    void onWifiReconnected();
+    void handleCommand(const String& payloadStr, CommandSource source);
 
 private:
     void setupMqttBroker();
     void setupMqttClient();
+    bool connectMqttClient();
+    void restartMqttBroker();
+    void recoverMqttConnection();
+    int getMaxNumClientsForHeap(uint32_t freeHeap, uint32_t heapPerClient) const;
+    void measureClientHeapCost();
+    void enqueuePublish(PublishKind kind, const char* subtopic, const String& payload, uint32_t eventMs);
+    String getRingTopic(const char* subtopic) const;
+    String getPublishPayload(const QueuedMessage& message) const;
+    void flushPublishQueue();
 
     void callbackMqtt(char* topic, byte* payload, unsigned int length);
+    bool isAllowedFromUpstream(const String& payloadStr) const;
+    void executeCommand(const String& payloadStr);
+    void publishResponse(const char* response);
+    void publishResponseTo(const char* response);
+    int findRingInput(const String& name) const;
     void showActionLog();
-    void showRawData();
+    void showRawData(int ringInput);
+    void showTrace(int ringInput);
+    void showParams();
+    void setParam(const String& args);
+    void replayRtcLog();
 
     // Connection to other components
     App* const app;
     StateGpioHandler* stateGpioHandler = nullptr;
     NetworkHandler* networkHandler = nullptr;
+    RtcLog* rtcLog = nullptr;
 
     // MQTT stack
     mqttBrokerName::MqttBroker broker;
     WiFiClient espClient;
     PubSubClient client;
+    MqttBridge bridge;
+    CommandSource commandSource = CommandSource::Local;
+    String responsePrefix; // correlation id of the current command
 
     // State
     bool mqttConnected = false;
+    int maxNumClients = 0;
+    uint32_t clientHeapCost = 0;
+    uint32_t clientHeapCostSum = 0;
+    int numHeapCostSamples = 0;
+    uint32_t freeHeapBeforeSession = 0;
+    bool sessionProbePending = false;
     CircularArray<String, ActionLogSize> actionLog;
+    PublishQueue publishQueue;
+    bool reportFlush = false;
     String startTime;
+    uint32_t bootToFirstPingMs = 0;
+
+    // In-place recovery of the MQTT stack
+    EventTimer recoveryTimer;
+    int recoveryAttempts = 0;
+    bool recovering = false;
+    uint32_t connectionLostMs = 0;
+    int numRecoveries = 0;
+    uint32_t maxRecoveryMs = 0;
 };
\ No newline at end of file
@@ -3,21 +3,33 @@
 #include "app.h"
 #include "arduinoSecrets.h"
 #include "mqttHandler.h"
+#include "rtcLog.h"
+#include "settingsStore.h"
 #include "stateGpioHandler.h"
 #include "timing.h"
 
-constexpr int NtpUpdateIntervalCycles = 10; // 1sec
+#include <esp_sntp.h>
+
+const char* NvsNamespace = "network";
+const char* NvsKeyLastNetwork = "lastNetwork";
+const char* NtpServer = "pool.ntp.org";
+const char* TimeZone = "CET-1CEST,M3.5.0,M10.5.0/3"; // CET, CEST from the last Sunday in March to the last Sunday in October
 
 NetworkHandler::NetworkHandler(App* app)
     : app(app)
-    , ntp(wifiUdp)
-    , ntpTimer(NtpUpdateIntervalCycles, true)
+    , ntpTimer(msToCycles(NtpUpdateIntervalMs, MainLoopSampleTimeMs), true)
+    , timerWifiSettle(msToCycles(WifiSettleMs, MainLoopSampleTimeMs))
 {}
 
 String NetworkHandler::getDateTime()
 {
     if (validTime) {
-        return ntp.formattedTime("%Y-%m-%d %H:%M:%S");
+        const time_t now = time(nullptr);
+        struct tm localTime;
+        localtime_r(&now, &localTime);
+        char dateTime[20];
+        strftime(dateTime, sizeof(dateTime), "%Y-%m-%d %H:%M:%S", &localTime);
+        return dateTime;
     } else {
         // return seconds since device start:
         return "(No NTP time, seconds since device start: " + String(millis() / 1000) + ")";
@@ -29,42 +41,63 @@ void NetworkHandler::setup()
     Serial.println("Setup NetworkHandler");
 
     stateGpioHandler = app->getStateGpioHandler();
+    mqttHandler = app->getMqttHandler();
+    settingsStore = app->getSettingsStore();
+    applyParams();
 
     wifiConnected = false;
     startupCycleCompleted = false;
 
     auto wifiConfigs = getWifiConfigs();
+    const int numWifiConfigs = wifiConfigs.size();
+
+    // Fast boot: try the network of the last connection first
+    LastNetwork lastNetwork;
+    if (loadLastNetwork(lastNetwork) && lastNetwork.configIndex >= 0 && lastNetwork.configIndex < numWifiConfigs) {
+        wifiConfigIndex = lastNetwork.configIndex;
+        setupWifiConnFast(wifiConfigs[wifiConfigIndex], lastNetwork);
+    }
 
-    for (const auto& wifiConfig : wifiConfigs) {
-        setupWifiConn(wifiConfig);
-        if (wifiConnected) {
-            break;
+    if (!wifiConnected) {
+        for (wifiConfigIndex = 0; wifiConfigIndex < numWifiConfigs; ++wifiConfigIndex) {
+            setupWifiConn(wifiConfigs[wifiConfigIndex]);
+            if (wifiConnected) {
+                break;
+            }
         }
     }
 
+    // NTP is set up in the loop, so the broker is started right after WiFi is up.
     if (wifiConnected) {
-        setupNTP();
+        wifiConfigFound = true;
+        if (!usingStoredLease) storeLastNetwork();
+    } else {
+        // No WiFi at startup: the supervisor keeps trying in the loop, the doorbell works offline meanwhile.
+        wifiConfigIndex = -1;
+        outageStartMs = millis();
+        ++numOutages;
     }
 }
 
 
 void NetworkHandler::loop()
 {
-    // Reconnect wifi
-    if (WiFi.status() != WL_CONNECTED) {
-        wifiConnected = false;
-        Serial.println("Wifi disconnected, reboot...");
-        stateGpioHandler->reboot();
-        return;
+    superviseWifi();
+
+    if (storeLeasePending && wifiConnected && uint32_t(WiFi.localIP()) != 0) {
+        storeLeasePending = false;
+        storeLastNetwork();
     }
 
     // Loop NTP
     if (wifiConnected) {
-        if (ntpTimer.checkAndDecrement()) ntp.update();
-        if (!validTime) {
-            validTime = ntp.year() != 1970;
-            if (logWhenValidTime) {
+        if (!ntpStarted) setupNTP();
+        if (ntpTimer.checkAndDecrement() && !validTime) {
+            // Set once the SNTP client has received the first reply, it resyncs on its own afterwards.
+            validTime = sntp_get_sync_status() == SNTP_SYNC_STATUS_COMPLETED;
+            if (validTime && logWhenValidTime) {
                 mqttHandler->addToActionLog("Received first NTP time");
+                mqttHandler->updateStartTime();
                 logWhenValidTime = false;
             }
         }
@@ -75,11 +108,35 @@ void NetworkHandler::setupWifiConn(const WifiConfig& wifiConfig)
 {
     WiFi.begin(wifiConfig.ssid.c_str(), wifiConfig.password.c_str());
     Serial.println("Connecting to WiFi '" + wifiConfig.ssid + "'");
+    waitForWifiConn(wifiConfig, WifiTimeoutCycles);
+}
+
+void NetworkHandler::setupWifiConnFast(const WifiConfig& wifiConfig, const LastNetwork& lastNetwork)
+{
+    // Channel and BSSID skip the scan, the IP of the last lease skips DHCP.
+    WiFi.config(IPAddress(lastNetwork.ip), IPAddress(lastNetwork.gateway), IPAddress(lastNetwork.subnet), IPAddress(lastNetwork.dns));
+    WiFi.begin(wifiConfig.ssid.c_str(), wifiConfig.password.c_str(), lastNetwork.channel, lastNetwork.bssid);
+    Serial.println("Connecting to last WiFi '" + wifiConfig.ssid + "' (fast boot)");
+    waitForWifiConn(wifiConfig, FastBootTimeoutCycles);
+
+    if (wifiConnected) {
+        // Switching to DHCP on a working link restarts the DHCP client and may change the address, which
+        // drops the broker clients. The stored lease is kept until a reconnect, which then uses DHCP.
+        usingStoredLease = true;
+    } else {
+        // Back to DHCP, e.g. the access point or the network changed.
+        WiFi.disconnect();
+        WiFi.config(IPAddress(), IPAddress(), IPAddress());
+    }
+}
+
+void NetworkHandler::waitForWifiConn(const WifiConfig& wifiConfig, int timeoutCycles)
+{
     int numCycles = 0;
     while (WiFi.status() != WL_CONNECTED) {
         stateGpioHandler->loopWaitCycle();
         Serial.print(".");
-        if (++numCycles > WifiTimeoutCycles) {
+        if (++numCycles > timeoutCycles) {
             Serial.println("WiFi connection timeout for '" + wifiConfig.ssid + "'");
             return;
         }
@@ -89,13 +146,126 @@ void NetworkHandler::setupWifiConn(const WifiConfig& wifiConfig)
     wifiConnected = true;
 }
 
+void NetworkHandler::superviseWifi()
+{
+    timerWifiSettle.decrement();
+
+    if (WiFi.status() == WL_CONNECTED) {
+        if (!wifiConnected) endWifiOutage();
+        return;
+    }
+
+    if (wifiConnected) startWifiOutage();
+
+    const uint32_t outageMs = millis() - outageStartMs;
+    if (outageMs >= static_cast<uint32_t>(WifiOutageRebootMs)) {
+        Serial.println("Wifi disconnected for " + String(outageMs / 1000) + " s, reboot...");
+        stateGpioHandler->reboot(RebootCause::WifiLost);
+        return;
+    }
+
+    if (static_cast<int32_t>(millis() - nextRetryMs) < 0) return;
+    retryWifiConn();
+    retryDelayMs = min(2 * retryDelayMs, static_cast<uint32_t>(WifiRetryMaxMs));
+    nextRetryMs = millis() + retryDelayMs;
+}
+
+void NetworkHandler::startWifiOutage()
+{
+    wifiConnected = false;
+    outageStartMs = millis();
+    ++numOutages;
+    retryDelayMs = WifiRetryMinMs;
+    nextRetryMs = millis() + retryDelayMs;
+
+    Serial.println("Wifi disconnected, reconnecting in the background...");
+    mqttHandler->addToActionLog("WiFi connection lost");
+}
+
+void NetworkHandler::endWifiOutage()
+{
+    wifiConnected = true;
+    wifiConfigFound = true;
+    timerWifiSettle.start();
+
+    const uint32_t outageMs = millis() - outageStartMs;
+    maxOutageMs = max(maxOutageMs, outageMs);
+    totalOutageMs += outageMs;
+
+    Serial.println("WiFi reconnected. IP: ");
+    Serial.println(WiFi.localIP());
+    mqttHandler->addToActionLog("WiFi reconnected after " + String(outageMs) + " ms (outages: " + String(numOutages)
+                                + ", max: " + String(maxOutageMs) + " ms, total: " + String(totalOutageMs) + " ms)");
+    if (!usingStoredLease) storeLastNetwork();
+    mqttHandler->onWifiReconnected();
+}
+
+void NetworkHandler::retryWifiConn()
+{
+    // Without a connection so far, try the configured networks one after the other.
+    const auto wifiConfigs = getWifiConfigs();
+    if (wifiConfigs.empty()) return;
+    if (!wifiConfigFound) wifiConfigIndex = (wifiConfigIndex + 1) % wifiConfigs.size();
+    const auto& wifiConfig = wifiConfigs[wifiConfigIndex];
+
+    Serial.println("Reconnecting to WiFi '" + wifiConfig.ssid + "'");
+    WiFi.disconnect();
+    if (usingStoredLease) useDhcp();
+    WiFi.begin(wifiConfig.ssid.c_str(), wifiConfig.password.c_str());
+}
+
+bool NetworkHandler::loadLastNetwork(LastNetwork& lastNetwork)
+{
+    preferences.begin(NvsNamespace, true);
+    const bool found = preferences.getBytes(NvsKeyLastNetwork, &lastNetwork, sizeof(lastNetwork)) == sizeof(lastNetwork);
+    preferences.end();
+    return found;
+}
+
+void NetworkHandler::storeLastNetwork()
+{
+    LastNetwork lastNetwork;
+    memset(&lastNetwork, 0, sizeof(lastNetwork));
+    lastNetwork.configIndex = wifiConfigIndex;
+    lastNetwork.channel = WiFi.channel();
+    memcpy(lastNetwork.bssid, WiFi.BSSID(), sizeof(lastNetwork.bssid));
+    lastNetwork.ip = WiFi.localIP();
+    lastNetwork.gateway = WiFi.gatewayIP();
+    lastNetwork.subnet = WiFi.subnetMask();
+    lastNetwork.dns = WiFi.dnsIP();
+
+    // Only write on changes, to spare the flash.
+    LastNetwork storedNetwork;
+    if (loadLastNetwork(storedNetwork) && memcmp(&storedNetwork, &lastNetwork, sizeof(lastNetwork)) == 0) return;
+
+    preferences.begin(NvsNamespace, false);
+    preferences.putBytes(NvsKeyLastNetwork, &lastNetwork, sizeof(lastNetwork));
+    preferences.end();
+}
+
+void NetworkHandler::useDhcp()
+{
+    // Without an address, the DHCP client is started. Its lease is stored for the next fast boot once it is bound.
+    WiFi.config(IPAddress(), IPAddress(), IPAddress());
+    usingStoredLease = false;
+    storeLeasePending = true;
+    Serial.println("WiFi: stored IP lease replaced by DHCP");
+}
+
+void NetworkHandler::applyParams()
+{
+    // Timers count loop cycles, they are converted with the current loop period.
+    const int loopMs = app->getLoopMs();
+    ntpTimer.setCycles(msToCycles(settingsStore->getInt(Setting::NtpUpdateMs), loopMs));
+    timerWifiSettle.setCycles(msToCycles(WifiSettleMs, loopMs));
+}
+
 void NetworkHandler::setupNTP()
 {
-    // Timezones
-    ntp.ruleDST("CEST", Last, Sun, Mar, 2, 120);
-    ntp.ruleSTD("CET", Last, Sun, Oct, 3, 60);
-    ntp.begin();
-    validTime = ntp.year() != 1970;
+    // The SNTP client of lwIP sends the requests and receives the replies (including the DNS lookup) in the
+    // TCP/IP task, the loop only polls for the first reply. A blocking NTP request could delay ring detection.
+    configTzTime(TimeZone, NtpServer);
+    ntpStarted = true;
 }
 
 bool NetworkHandler::getWifiConnected() const
@@ -103,6 +273,12 @@ bool NetworkHandler::getWifiConnected() const
     return wifiConnected;
 }
 
+bool NetworkHandler::isWifiSettled() const
+{
+    // After an outage, clients need some time to reconnect to the broker.
+    return wifiConnected && !timerWifiSettle.check();
+}
+
 bool NetworkHandler::hasValidTime() const
 {
     return validTime;
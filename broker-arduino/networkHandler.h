@@ -1,16 +1,17 @@
 #pragma once
 
 #include "timer.h"
+#include "timing.h"
 
 #include <Arduino.h>
 
-#include <NTP.h>
+#include <Preferences.h>
 #include <PubSubClient.h>
 #include <WiFi.h>
-#include <WiFiUdp.h>
 
 class App;
 class MqttHandler;
+class SettingsStore;
 class StateGpioHandler;
 class WifiConfig;
 
@@ -21,28 +22,68 @@ public:
     String getDateTime();
     void setup();
     void loop();
+    void applyParams();
     bool getWifiConnected() const;
+    bool isWifiSettled() const;
     bool hasValidTime() const;
     void setRequestLogWhenValidTime();
 
-
 private:
+    // Network of the last successful connection, kept in NVS for a fast boot
+    struct LastNetwork
+    {
+        int32_t configIndex;
+        int32_t channel;
+        uint8_t bssid[6];
+        uint32_t ip;
+        uint32_t gateway;
+        uint32_t subnet;
+        uint32_t dns;
+    };
+
     void setupWifiConn(const WifiConfig& wifiConfig);
+    void setupWifiConnFast(const WifiConfig& wifiConfig, const LastNetwork& lastNetwork);
+    void waitForWifiConn(const WifiConfig& wifiConfig, int timeoutCycles);
+    bool loadLastNetwork(LastNetwork& lastNetwork);
+    void storeLastNetwork();
+    void useDhcp();
     void setupNTP();
 
+    // WiFi supervisor
+    void superviseWifi();
+    void startWifiOutage();
+    void endWifiOutage();
+    void retryWifiConn();
+
     // Connection to other components
     App* const app;
     StateGpioHandler* stateGpioHandler = nullptr;
     MqttHandler* mqttHandler = nullptr;
+    SettingsStore* settingsStore = nullptr;
 
     // Connection stack
-    WiFiUDP wifiUdp;
-    NTP ntp;
     EventTimer ntpTimer;
+    DurationTimer timerWifiSettle;
+    Preferences preferences;
 
     // System states
     bool wifiConnected = false;
     bool startupCycleCompleted = false;
+    bool ntpStarted = false;
     bool validTime = false;
     bool logWhenValidTime = false;
+
+    // Fast boot: the stored lease is kept while the link is up, DHCP takes over when a reconnect is needed anyway
+    bool usingStoredLease = false;
+    bool storeLeasePending = false;
+
+    // WiFi outages
+    int wifiConfigIndex = 0;
+    bool wifiConfigFound = false;
+    uint32_t retryDelayMs = WifiRetryMinMs;
+    uint32_t nextRetryMs = 0;
+    uint32_t outageStartMs = 0;
+    int numOutages = 0;
+    uint32_t maxOutageMs = 0;
+    uint32_t totalOutageMs = 0;
 };
\ No newline at end of file
@@ -0,0 +1,15 @@
+#include "params.h"
+
+const ParamDefinition* findParam(const String& name)
+{
+    for (const auto& param : ParamDefinitions) {
+        if (name == param.name) return &param;
+    }
+    return nullptr;
+}
+
+String getParamStr(const ParamDefinition& param, int32_t value)
+{
+    return String(param.name) + " " + String(value) + " " + param.unit + " (" + String(param.minValue) + ".."
+           + String(param.maxValue) + ")";
+}
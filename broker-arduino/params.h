@@ -0,0 +1,33 @@
+#pragma once
+
+#include "settingsStore.h"
+
+#include <Arduino.h>
+
+// Timing parameters which can be read and changed at runtime via MQTT (getParams, setParam <name> <value>).
+// Values are validated against the range, persisted in the settings store and applied live by App::applyParams.
+struct ParamDefinition final
+{
+    const char* name;
+    Setting setting;
+    int32_t minValue;
+    int32_t maxValue;
+    const char* unit;
+};
+
+constexpr ParamDefinition ParamDefinitions[] = {
+    {"loopMs", Setting::LoopMs, 20, 200, "ms"},
+    {"ringDebounceMs", Setting::RingDebounceMs, 20, 5000, "ms"},
+    {"switchDebounceMs", Setting::SwitchDebounceMs, 20, 2000, "ms"},
+    {"doorOpenMs", Setting::DoorOpenMs, 500, 15000, "ms"},
+    {"extBellMs", Setting::ExtBellMs, 100, 5000, "ms"},
+    {"ntpMs", Setting::NtpUpdateMs, 100, 60000, "ms"},
+};
+
+constexpr int NumParams = sizeof(ParamDefinitions) / sizeof(ParamDefinitions[0]);
+
+// Returns nullptr for an unknown name
+const ParamDefinition* findParam(const String& name);
+
+// "name value unit (min..max)"
+String getParamStr(const ParamDefinition& param, int32_t value);
@@ -0,0 +1,104 @@
+#include "publishQueue.h"
+
+void PublishQueue::push(PublishKind kind, const char* subtopic, const char* payload, uint32_t nowMs, uint32_t eventMs)
+{
+    if (count == PublishQueueSize) {
+        // Make room by dropping the least important message, never a ring for something else.
+        bool dropped = dropOldest(PublishKind::AckRing) || dropOldest(PublishKind::AutoBuzzState)
+                       || (kind == PublishKind::Ring && dropOldest(PublishKind::Ring));
+        if (!dropped) {
+            ++numDropped;
+            return;
+        }
+    }
+
+    QueuedMessage& entry = entryAt(count);
+    entry.kind = kind;
+    entry.subtopic = subtopic;
+    entry.tsQueuedMs = nowMs;
+    entry.tsEventMs = eventMs;
+    strncpy(entry.payload, payload, MaxPublishPayloadLength - 1);
+    entry.payload[MaxPublishPayloadLength - 1] = '\0';
+    ++count;
+    ++numQueued;
+}
+
+const QueuedMessage& PublishQueue::front() const
+{
+    return entries[tail];
+}
+
+void PublishQueue::pop(uint32_t nowMs)
+{
+    if (count == 0) return;
+    const uint32_t latencyMs = nowMs - entries[tail].tsQueuedMs;
+    if (latencyMs > maxFlushLatencyMs) maxFlushLatencyMs = latencyMs;
+    tail = (tail + 1) % PublishQueueSize;
+    --count;
+}
+
+bool PublishQueue::empty() const
+{
+    return count == 0;
+}
+
+int PublishQueue::size() const
+{
+    return count;
+}
+
+bool PublishQueue::hasRingSince(uint32_t eventMs) const
+{
+    for (int i = 0; i < count; ++i) {
+        const QueuedMessage& entry = entries[(tail + i) % PublishQueueSize];
+        if (entry.kind == PublishKind::Ring && static_cast<int32_t>(entry.tsEventMs - eventMs) >= 0) return true;
+    }
+    return false;
+}
+
+bool PublishQueue::dropOldest(PublishKind kind)
+{
+    for (int i = 0; i < count; ++i) {
+        if (entryAt(i).kind == kind) {
+            removeAt(i);
+            ++numDropped;
+            return true;
+        }
+    }
+    return false;
+}
+
+void PublishQueue::removeAt(int index)
+{
+    // Close the gap, keeps the order of the remaining messages.
+    for (int i = index; i < count - 1; ++i) {
+        entryAt(i) = entryAt(i + 1);
+    }
+    --count;
+}
+
+QueuedMessage& PublishQueue::entryAt(int index)
+{
+    return entries[(tail + index) % PublishQueueSize];
+}
+
+uint32_t PublishQueue::getNumQueued() const
+{
+    return numQueued;
+}
+
+uint32_t PublishQueue::getNumDropped() const
+{
+    return numDropped;
+}
+
+uint32_t PublishQueue::getMaxFlushLatencyMs() const
+{
+    return maxFlushLatencyMs;
+}
+
+String PublishQueue::getStatsStr() const
+{
+    return "queued: " + String(numQueued) + ", dropped: " + String(numDropped) + ", max flush latency: " + String(maxFlushLatencyMs)
+           + "ms";
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <Arduino.h>
+
+constexpr int PublishQueueSize = 16;
+constexpr int MaxPublishPayloadLength = 96;
+
+// Kind of an outgoing event, ordered by importance (dropped last to first).
+enum class PublishKind : uint8_t
+{
+    Ring,
+    AutoBuzzState,
+    AckRing,
+};
+
+struct QueuedMessage final
+{
+    PublishKind kind = PublishKind::Ring;
+    const char* subtopic = nullptr; // static string, e.g. the name of a ring input
+    uint32_t tsQueuedMs = 0;
+    uint32_t tsEventMs = 0; // when the event happened, e.g. the edge of a ring input
+    char payload[MaxPublishPayloadLength] = {};
+};
+
+// Bounded FIFO for outgoing events, without any heap allocation.
+// If the queue is full, the oldest message of the least important kind is dropped.
+// Rings are only dropped in favour of newer rings.
+class PublishQueue final
+{
+public:
+    void push(PublishKind kind, const char* subtopic, const char* payload, uint32_t nowMs, uint32_t eventMs);
+    const QueuedMessage& front() const;
+    void pop(uint32_t nowMs);
+
+    bool empty() const;
+    int size() const;
+    bool hasRingSince(uint32_t eventMs) const;
+
+    // Counters
+    uint32_t getNumQueued() const;
+    uint32_t getNumDropped() const;
+    uint32_t getMaxFlushLatencyMs() const;
+    String getStatsStr() const;
+
+private:
+    bool dropOldest(PublishKind kind);
+    void removeAt(int index);
+    QueuedMessage& entryAt(int index);
+
+    QueuedMessage entries[PublishQueueSize];
+    int tail = 0;
+    int count = 0;
+
+    uint32_t numQueued = 0;
+    uint32_t numDropped = 0;
+    uint32_t maxFlushLatencyMs = 0;
+};
@@ -0,0 +1,87 @@
+#include "relayPulse.h"
+
+RelayPulse::RelayPulse(uint8_t pin, uint32_t durationMs, const char* name)
+    : pin(pin)
+    , durationMs(durationMs)
+    , name(name)
+{}
+
+void RelayPulse::setup()
+{
+    digitalWrite(pin, LOW);
+
+    const esp_timer_create_args_t timerArgs = {
+        .callback = &RelayPulse::onTimer,
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = name,
+        .skip_unhandled_events = false,
+    };
+    if (esp_timer_create(&timerArgs, &timer) != ESP_OK) {
+        timer = nullptr;
+        Serial.print("Failed to create relay timer ");
+        Serial.println(name);
+    }
+}
+
+void RelayPulse::start()
+{
+    // Without a timer, the relay could not be switched off again.
+    if (!timer || running) return;
+
+    running = true;
+    digitalWrite(pin, HIGH);
+    startUs = esp_timer_get_time();
+    pulseDurationMs = durationMs;
+    esp_timer_start_once(timer, uint64_t(pulseDurationMs) * 1000);
+}
+
+void RelayPulse::onTimer(void* arg)
+{
+    // Runs in the esp_timer task
+    auto* pulse = static_cast<RelayPulse*>(arg);
+    digitalWrite(pulse->pin, LOW);
+    pulse->finishedPulsesUs.push(static_cast<uint32_t>(esp_timer_get_time() - pulse->startUs));
+    pulse->running.store(false, std::memory_order_release);
+}
+
+bool RelayPulse::isRunning() const
+{
+    return running.load(std::memory_order_acquire);
+}
+
+bool RelayPulse::takeFinishedPulse(uint32_t& durationUs)
+{
+    if (!finishedPulsesUs.pop(durationUs)) return false;
+
+    const int32_t deviationUs = static_cast<int32_t>(durationUs) - static_cast<int32_t>(pulseDurationMs * 1000);
+    if (abs(deviationUs) > abs(maxDeviationUs)) maxDeviationUs = deviationUs;
+    ++numPulses;
+    return true;
+}
+
+void RelayPulse::setDurationMs(uint32_t newDurationMs)
+{
+    durationMs = newDurationMs;
+}
+
+uint32_t RelayPulse::getDurationMs() const
+{
+    return durationMs;
+}
+
+uint32_t RelayPulse::getLastPulseDurationMs() const
+{
+    return pulseDurationMs;
+}
+
+const char* RelayPulse::getName() const
+{
+    return name;
+}
+
+String RelayPulse::getStatsStr() const
+{
+    return String(name) + ": " + String(numPulses) + " pulses of " + String(durationMs) + " ms, max deviation "
+           + String(maxDeviationUs) + " us";
+}
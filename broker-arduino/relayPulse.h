@@ -0,0 +1,48 @@
+#pragma once
+
+#include "circularArray.h"
+
+#include <Arduino.h>
+#include <esp_timer.h>
+
+#include <atomic>
+
+// Relay pulse with an exact duration: start() switches the relay on immediately,
+// a one-shot esp_timer switches it off after the duration, independent of the main loop.
+class RelayPulse final
+{
+public:
+    RelayPulse(uint8_t pin, uint32_t durationMs, const char* name);
+
+    void setup();
+    void start();
+    bool isRunning() const;
+
+    // Measured duration of the next finished pulse, returns false if no pulse finished since the last call.
+    bool takeFinishedPulse(uint32_t& durationUs);
+
+    // A new duration applies from the next pulse.
+    void setDurationMs(uint32_t newDurationMs);
+    uint32_t getDurationMs() const;
+    uint32_t getLastPulseDurationMs() const;
+    const char* getName() const;
+    String getStatsStr() const;
+
+private:
+    static void onTimer(void* arg);
+
+    const uint8_t pin;
+    uint32_t durationMs;
+    uint32_t pulseDurationMs = 0;
+    const char* const name;
+    esp_timer_handle_t timer = nullptr;
+
+    // Written by the timer task, read by the main loop
+    std::atomic<bool> running{false};
+    SpscCircularArray<uint32_t, 4> finishedPulsesUs;
+    int64_t startUs = 0;
+
+    // Statistics of the measured pulses
+    uint32_t numPulses = 0;
+    int32_t maxDeviationUs = 0;
+};
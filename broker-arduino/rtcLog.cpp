@@ -0,0 +1,128 @@
+#include "rtcLog.h"
+
+#include <esp_attr.h>
+
+constexpr uint32_t RtcLogMagic = 0xD00BE11B; // changes with the layout of RtcLogData
+
+RTC_NOINIT_ATTR static RtcLogData rtcData;
+
+void RtcLog::setup()
+{
+    resetReason = esp_reset_reason();
+
+    // After power-on the RTC memory contains garbage, only trust it after a soft reset.
+    previousBootValid = resetReason != ESP_RST_POWERON && resetReason != ESP_RST_BROWNOUT && rtcData.magic == RtcLogMagic
+                        && rtcData.recordCount <= RtcLogNumRecords && rtcData.recordHead < RtcLogNumRecords
+                        && rtcData.lastStage < LoopStage::NumStages;
+
+    const uint32_t bootCount = previousBootValid ? rtcData.bootCount + 1 : 1;
+    if (previousBootValid) previousBoot = rtcData;
+
+    memset(&rtcData, 0, sizeof(rtcData));
+    rtcData.magic = RtcLogMagic;
+    rtcData.bootCount = bootCount;
+    markStage(LoopStage::Setup);
+}
+
+void RtcLog::markStage(LoopStage stage)
+{
+    rtcData.lastStage = stage;
+    rtcData.stageTsMs[static_cast<int>(stage)] = millis();
+}
+
+void RtcLog::addRecord(const char* text)
+{
+    RtcLogRecord& record = rtcData.records[rtcData.recordHead];
+    record.tsMs = millis();
+    strncpy(record.text, text, RtcLogRecordLength - 1);
+    record.text[RtcLogRecordLength - 1] = '\0';
+
+    rtcData.recordHead = (rtcData.recordHead + 1) % RtcLogNumRecords;
+    if (rtcData.recordCount < RtcLogNumRecords) ++rtcData.recordCount;
+}
+
+void RtcLog::setRebootCause(RebootCause cause)
+{
+    rtcData.rebootCause = cause;
+}
+
+void RtcLog::setGpioState(uint8_t ringActiveMask, bool doorBuzzerScheduled, bool extBellScheduled)
+{
+    rtcData.ringActiveMask = ringActiveMask;
+    rtcData.doorBuzzerScheduled = doorBuzzerScheduled;
+    rtcData.extBellScheduled = extBellScheduled;
+}
+
+bool RtcLog::hasPreviousBoot() const
+{
+    return previousBootValid;
+}
+
+const RtcLogData& RtcLog::getPreviousBoot() const
+{
+    return previousBoot;
+}
+
+int RtcLog::getNumPreviousRecords() const
+{
+    return previousBootValid ? previousBoot.recordCount : 0;
+}
+
+const RtcLogRecord& RtcLog::getPreviousRecord(int index) const
+{
+    // oldest record first
+    const int first = (previousBoot.recordHead + RtcLogNumRecords - previousBoot.recordCount) % RtcLogNumRecords;
+    return previousBoot.records[(first + index) % RtcLogNumRecords];
+}
+
+String RtcLog::getResetReasonStr() const
+{
+    switch (resetReason) {
+        case ESP_RST_POWERON: return "power on";
+        case ESP_RST_EXT: return "external pin";
+        case ESP_RST_SW: return "software restart";
+        case ESP_RST_PANIC: return "panic";
+        case ESP_RST_INT_WDT: return "interrupt watchdog";
+        case ESP_RST_TASK_WDT: return "task watchdog";
+        case ESP_RST_WDT: return "other watchdog";
+        case ESP_RST_DEEPSLEEP: return "deep sleep";
+        case ESP_RST_BROWNOUT: return "brownout";
+        case ESP_RST_SDIO: return "SDIO";
+        default: return "unknown (" + String(static_cast<int>(resetReason)) + ")";
+    }
+}
+
+String RtcLog::getPreviousBootSummary() const
+{
+    String summary = "Reset reason: " + getResetReasonStr();
+    if (!previousBootValid) return summary;
+
+    const int lastStage = static_cast<int>(previousBoot.lastStage);
+    summary += ", boot count: " + String(previousBoot.bootCount + 1);
+    summary += String(", reboot cause: ") + getRebootCauseStr(previousBoot.rebootCause);
+    summary += String(", last stage: ") + getStageStr(previousBoot.lastStage) + " at " + String(previousBoot.stageTsMs[lastStage]) + "ms";
+    return summary;
+}
+
+const char* RtcLog::getRebootCauseStr(RebootCause cause)
+{
+    switch (cause) {
+        case RebootCause::None: return "none";
+        case RebootCause::WifiLost: return "WiFi lost";
+        case RebootCause::MqttRecoveryFailed: return "MQTT recovery failed";
+    }
+    return "unknown";
+}
+
+const char* RtcLog::getStageStr(LoopStage stage)
+{
+    switch (stage) {
+        case LoopStage::Setup: return "setup";
+        case LoopStage::Network: return "network";
+        case LoopStage::Mqtt: return "mqtt";
+        case LoopStage::StateGpio: return "gpio";
+        case LoopStage::Settings: return "settings";
+        case LoopStage::NumStages: break;
+    }
+    return "unknown";
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_system.h>
+
+constexpr int RtcLogNumRecords = 8;
+constexpr int RtcLogRecordLength = 56;
+
+enum class LoopStage : uint8_t
+{
+    Setup,
+    Network,
+    Mqtt,
+    StateGpio,
+    Settings,
+    NumStages
+};
+
+enum class RebootCause : uint8_t
+{
+    None,
+    WifiLost,
+    MqttRecoveryFailed,
+};
+
+struct RtcLogRecord final
+{
+    uint32_t tsMs;
+    char text[RtcLogRecordLength];
+};
+
+// Contents of the RTC slow memory, survives a soft reset (but not a power cycle).
+struct RtcLogData final
+{
+    uint32_t magic;
+    uint32_t bootCount;
+    RebootCause rebootCause;
+    LoopStage lastStage;
+    uint32_t stageTsMs[static_cast<int>(LoopStage::NumStages)];
+
+    // Pending GPIO state
+    uint8_t ringActiveMask; // bit per ring input
+    bool doorBuzzerScheduled;
+    bool extBellScheduled;
+
+    uint8_t recordHead;
+    uint8_t recordCount;
+    RtcLogRecord records[RtcLogNumRecords];
+};
+
+// Forensics of the previous boot: recent events and state are kept in RTC memory,
+// so after a reboot or crash we know why it restarted and what it was doing.
+// All stores are plain writes into RTC memory, without allocations.
+class RtcLog final
+{
+public:
+    void setup();
+
+    // Hot path stores
+    void markStage(LoopStage stage);
+    void addRecord(const char* text);
+    void setRebootCause(RebootCause cause);
+    void setGpioState(uint8_t ringActiveMask, bool doorBuzzerScheduled, bool extBellScheduled);
+
+    // Data of the previous boot, only valid after a soft reset.
+    bool hasPreviousBoot() const;
+    const RtcLogData& getPreviousBoot() const;
+    String getResetReasonStr() const;
+    String getPreviousBootSummary() const;
+    int getNumPreviousRecords() const;
+    const RtcLogRecord& getPreviousRecord(int index) const;
+
+private:
+    static const char* getRebootCauseStr(RebootCause cause);
+    static const char* getStageStr(LoopStage stage);
+
+    RtcLogData previousBoot = {};
+    bool previousBootValid = false;
+    esp_reset_reason_t resetReason = ESP_RST_UNKNOWN;
+};
@@ -0,0 +1,111 @@
+#include "settingsStore.h"
+
+#include "gpioConfig.h"
+#include "timing.h"
+
+#include <EEPROM.h>
+
+constexpr uint32_t SettingsCommitDelayMs = 5000;
+
+const char* NvsNamespaceSettings = "settings";
+
+struct SettingDefinition
+{
+    const char* key; // NVS keys have at most 15 characters
+    int32_t defaultValue;
+};
+
+constexpr SettingDefinition SettingDefinitions[] = {
+    {"autoBuzz", 0},
+    {"loopMs", MainLoopSampleTimeMs},
+    {"ringDebounceMs", InputDebounceMs},
+    {"swDebounceMs", SwitchDebounceMs},
+    {"doorOpenMs", DoorOpenMs},
+    {"extBellMs", ExtBellMs},
+    {"ntpMs", NtpUpdateIntervalMs},
+};
+
+static_assert(sizeof(SettingDefinitions) / sizeof(SettingDefinitions[0]) == static_cast<int>(Setting::NumSettings),
+              "Every setting needs a definition");
+
+// Former EEPROM layout (one byte), migrated once
+constexpr int EepromSize = 1;
+constexpr int EepromAddressAutoBuzz = 0;
+
+void SettingsStore::setup()
+{
+    Serial.println("Setup SettingsStore");
+
+    preferences.begin(NvsNamespaceSettings, true);
+    const bool hasSettings = preferences.isKey(SettingDefinitions[0].key);
+    for (int i = 0; i < static_cast<int>(Setting::NumSettings); ++i) {
+        values[i] = preferences.getInt(SettingDefinitions[i].key, SettingDefinitions[i].defaultValue);
+    }
+    preferences.end();
+
+    if (!hasSettings) {
+        // First start with the settings store: take over the EEPROM and write all settings once.
+        migrateFromEeprom();
+        for (bool& settingDirty : dirty) settingDirty = true;
+        anyDirty = true;
+        commit();
+    }
+}
+
+void SettingsStore::migrateFromEeprom()
+{
+    if (!EEPROM.begin(EepromSize)) return;
+
+    const uint8_t autoBuzz = EEPROM.read(EepromAddressAutoBuzz);
+    if (autoBuzz <= 1) {
+        Serial.println("Migrate settings from EEPROM");
+        setBool(Setting::AutoBuzz, autoBuzz == 1);
+    }
+}
+
+void SettingsStore::loop(bool idle)
+{
+    if (!anyDirty) return;
+    if (millis() - lastChangeMs < SettingsCommitDelayMs || !idle) return;
+    commit();
+}
+
+void SettingsStore::commit()
+{
+    if (!anyDirty) return;
+
+    preferences.begin(NvsNamespaceSettings, false);
+    for (int i = 0; i < static_cast<int>(Setting::NumSettings); ++i) {
+        if (dirty[i]) preferences.putInt(SettingDefinitions[i].key, values[i]);
+        dirty[i] = false;
+    }
+    preferences.end();
+
+    anyDirty = false;
+}
+
+bool SettingsStore::getBool(Setting setting) const
+{
+    return getInt(setting) != 0;
+}
+
+void SettingsStore::setBool(Setting setting, bool value)
+{
+    setInt(setting, value ? 1 : 0);
+}
+
+int32_t SettingsStore::getInt(Setting setting) const
+{
+    return values[static_cast<int>(setting)];
+}
+
+void SettingsStore::setInt(Setting setting, int32_t value)
+{
+    const int index = static_cast<int>(setting);
+    if (values[index] == value) return;
+
+    values[index] = value;
+    dirty[index] = true;
+    anyDirty = true;
+    lastChangeMs = millis();
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Preferences.h>
+
+// Persistent broker settings
+enum class Setting : uint8_t
+{
+    AutoBuzz,
+    LoopMs,
+    RingDebounceMs,
+    SwitchDebounceMs,
+    DoorOpenMs,
+    ExtBellMs,
+    NtpUpdateMs,
+    NumSettings
+};
+
+// Typed settings in NVS (wear-leveled, every entry is CRC-checked by NVS).
+// Changes are kept in RAM and committed together once no setting changed for SettingsCommitDelayMs
+// and the device is idle, so toggling a setting never blocks the loop on flash.
+class SettingsStore final
+{
+public:
+    void setup();
+    void loop(bool idle);
+
+    bool getBool(Setting setting) const;
+    void setBool(Setting setting, bool value);
+    int32_t getInt(Setting setting) const;
+    void setInt(Setting setting, int32_t value);
+
+    // Write pending changes right away, e.g. before a reboot
+    void commit();
+
+private:
+    void migrateFromEeprom();
+
+    Preferences preferences;
+    int32_t values[static_cast<int>(Setting::NumSettings)] = {};
+    bool dirty[static_cast<int>(Setting::NumSettings)] = {};
+    bool anyDirty = false;
+    uint32_t lastChangeMs = 0;
+};
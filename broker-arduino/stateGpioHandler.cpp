@@ -5,49 +5,57 @@
 #include "gpioConfig.h"
 #include "mqttHandler.h"
 #include "networkHandler.h"
+#include "rtcLog.h"
+#include "settingsStore.h"
 #include "timing.h"
 
-#include <EEPROM.h>
+// The ring state of all inputs is kept as a bit mask in RTC memory.
+static_assert(NumRingInputs > 0 && NumRingInputs <= 8, "Between 1 and 8 ring inputs are supported");
 
-constexpr int EepromSize = 1;
-constexpr int EepromAddressAutoBuzz = 0;
+StateGpioHandler::RingInput::RingInput(const RingInputConfig& config, App* app)
+    : config(config)
+    , input(config.pin, msToCycles(InputDebounceMs, MainLoopSampleTimeMs), app)
+    , timerBellBlink(msToCycles(BellBlinkMs, MainLoopSampleTimeMs))
+{}
 
-StateGpioHandler::StateGpioHandler(App* app)
-    : app(app)
-    , switchBuzzMode(SwitchBuzzmode, SwitchDebounceCycles, app)
-    , switchAckBuzz(SwitchAckBuzz, SwitchDebounceCycles, app)
-    , switchAck(SwitchAck, SwitchDebounceCycles, app)
-    , inputRing(InputRing, InputDebounceCycles, app, true)
-    , timerDoorBuzzer(DoorOpenCycles)
-    , timerExtBell(ExtBellCycles)
-    , timerBellBlink(BellBlinkCycles)
-    , timerAckLedOn(AckLedCycles)
-    , timerErrorLedOn(ErrorLedCycles)
-    , timerReboot(RebootWaitCycles)
+template<size_t... Indices>
+std::array<StateGpioHandler::RingInput, NumRingInputs> StateGpioHandler::createRingInputs(App* app,
+                                                                                          std::index_sequence<Indices...>)
 {
-    ledSeq = FirstLed;
+    return {{RingInput(RingInputs[Indices], app)...}};
 }
 
-void StateGpioHandler::updateBlinkState()
-{
-    blinkState = 1 - blinkState;
-}
+StateGpioHandler::StateGpioHandler(App* app)
+    : app(app)
+    , switchBuzzMode(SwitchBuzzmode, msToCycles(SwitchDebounceMs, MainLoopSampleTimeMs))
+    , switchAckBuzz(SwitchAckBuzz, msToCycles(SwitchDebounceMs, MainLoopSampleTimeMs))
+    , switchAck(SwitchAck, msToCycles(SwitchDebounceMs, MainLoopSampleTimeMs))
+    , ringInputs(createRingInputs(app, std::make_index_sequence<NumRingInputs>()))
+    , relayDoorBuzzer(RelayBuzzer, DoorOpenMs, "door buzzer")
+    , relayExtBell(RelayExtBell, ExtBellMs, "ext bell")
+    , timerAckLedOn(msToCycles(AckLedMs, MainLoopSampleTimeMs))
+    , timerErrorLedOn(msToCycles(ErrorLedMs, MainLoopSampleTimeMs))
+    , timerReboot(msToCycles(RebootWaitMs, MainLoopSampleTimeMs))
+{}
 
 void StateGpioHandler::loop()
 {
-    updateBlinkState();
+    updateElapsedCycles();
     readSwitches();
     readInputs();
     handleRelays();
-    writeLedsInNormalLoop();
+    setLedsInNormalLoop();
     decrementTimers();
     checkForReboot();
+
+    rtcLog->setGpioState(getRingActiveMask(), stateDoorBuzzer == EventState::Scheduled, stateExtBell == EventState::Scheduled);
 }
 
 void StateGpioHandler::checkForReboot()
 {
     if (wantToReboot && !timerReboot.check()) {
         Serial.println("Rebooting...");
+        settingsStore->commit();
         ESP.restart();
     }
 }
@@ -62,20 +70,16 @@ void StateGpioHandler::waitSeconds(int sec)
 
 void StateGpioHandler::loopWaitCycle()
 {
-    updateBlinkState();
-
+    setLedsInWaitCycle();
     delay(StartupCycleTimeMs);
+}
 
-    // loop blink (shows that we didn't stuck)
-    digitalWrite(LED_BUILTIN, blinkState);
-
-    // write LOW to all LEDS, except the ledSeq LED:
+void StateGpioHandler::setLedsInWaitCycle()
+{
+    // builtin LED shows that the firmware is alive, the other LEDs light up one after the other
+    ledEngine.setPattern(LED_BUILTIN, LedPatternWaitBuiltin);
     for (uint8_t i = FirstLed; i <= LastLed; ++i) {
-        digitalWrite(i, i == ledSeq ? HIGH : LOW);
-    }
-
-    if (++ledSeq > LastLed) {
-        ledSeq = FirstLed;
+        ledEngine.setPattern(i, LedPatternWait, 2 * (i - FirstLed));
     }
 }
 
@@ -85,51 +89,83 @@ void StateGpioHandler::setup()
 
     mqttHandler = app->getMqttHandler();
     networkHandler = app->getNetworkHandler();
-    inputRing.setup();
+    rtcLog = app->getRtcLog();
+    settingsStore = app->getSettingsStore();
+    for (auto& ringInput : ringInputs) {
+        ringInput.input.setup();
+    }
 
-    readEeprom();
+    autoBuzz = settingsStore->getBool(Setting::AutoBuzz);
+    applyParams();
     setupPins();
+    restoreFromRtcLog();
+}
+
+void StateGpioHandler::applyParams()
+{
+    // Debounce times and timers count loop cycles, they are converted with the current loop period.
+    const int loopMs = app->getLoopMs();
+    const int switchDebounceCycles = msToCycles(settingsStore->getInt(Setting::SwitchDebounceMs), loopMs);
+    switchBuzzMode.setDebounceCycles(switchDebounceCycles);
+    switchAckBuzz.setDebounceCycles(switchDebounceCycles);
+    switchAck.setDebounceCycles(switchDebounceCycles);
+    const int ringDebounceCycles = msToCycles(settingsStore->getInt(Setting::RingDebounceMs), loopMs);
+    for (auto& ringInput : ringInputs) {
+        ringInput.input.setDebounceCycles(ringDebounceCycles);
+        ringInput.timerBellBlink.setCycles(msToCycles(BellBlinkMs, loopMs));
+    }
+    timerAckLedOn.setCycles(msToCycles(AckLedMs, loopMs));
+    timerErrorLedOn.setCycles(msToCycles(ErrorLedMs, loopMs));
+    timerReboot.setCycles(msToCycles(RebootWaitMs, loopMs));
+
+    // A running pulse keeps its duration.
+    relayDoorBuzzer.setDurationMs(settingsStore->getInt(Setting::DoorOpenMs));
+    relayExtBell.setDurationMs(settingsStore->getInt(Setting::ExtBellMs));
+}
+
+void StateGpioHandler::restoreFromRtcLog()
+{
+    if (!rtcLog->hasPreviousBoot()) return;
+
+    // Continue a ring which was active before the reboot (LEDs only).
+    // Relays are never switched by a restore, a pending door buzzer could open the door long after the command.
+    const auto& previousBoot = rtcLog->getPreviousBoot();
+    for (int i = 0; i < NumRingInputs; ++i) {
+        if (previousBoot.ringActiveMask & (1 << i)) {
+            ringInputs[i].ringActive = true;
+            ringInputs[i].timerBellBlink.start();
+        }
+    }
 }
 
 void StateGpioHandler::setupPins()
 {
-    // LEDs
+    // LEDs (incl. build-in LED), driven by the LED engine
     for (int i = FirstLed; i <= LastLed; ++i) {
-        pinMode(i, OUTPUT);
+        ledEngine.addLed(i);
     }
+    ledEngine.addLed(LED_BUILTIN);
+    ledEngine.setup();
 
     // Switches
     pinMode(SwitchBuzzmode, INPUT_PULLUP);
     pinMode(SwitchAckBuzz, INPUT_PULLUP);
     pinMode(SwitchAck, INPUT_PULLUP);
-
-    // Ring input (also grounded, has its own pull up)
-    pinMode(InputRing, INPUT);
+    switchBuzzMode.attachEdgeInterrupt();
+    switchAckBuzz.attachEdgeInterrupt();
+    switchAck.attachEdgeInterrupt();
+
+    // Ring inputs (also grounded)
+    for (auto& ringInput : ringInputs) {
+        pinMode(ringInput.config.pin, ringInput.config.externalPullUp ? INPUT : INPUT_PULLUP);
+        ringInput.input.attachEdgeInterrupt();
+    }
 
     // Relays
     pinMode(RelayBuzzer, OUTPUT);
     pinMode(RelayExtBell, OUTPUT);
-
-    // Build-in LED for output
-    pinMode(LED_BUILTIN, OUTPUT);
-}
-
-
-void StateGpioHandler::readEeprom()
-{
-    if (!EEPROM.begin(EepromSize)) {
-        Serial.println("Failed to initialize EEPROM");
-        return;
-    }
-
-    Serial.println(EEPROM.read(EepromAddressAutoBuzz));
-    autoBuzz = EEPROM.read(EepromAddressAutoBuzz) == 1;
-}
-
-void StateGpioHandler::writeEeprom()
-{
-    EEPROM.write(EepromAddressAutoBuzz, autoBuzz ? 1 : 0);
-    EEPROM.commit();
+    relayDoorBuzzer.setup();
+    relayExtBell.setup();
 }
 
 void StateGpioHandler::scheduleEvent(EventState& state)
@@ -137,14 +173,20 @@ void StateGpioHandler::scheduleEvent(EventState& state)
     if (state == EventState::Idle) {
         state = EventState::Scheduled;
     }
+
+    // Switch on right away if the other relay is off, not only in the next loop cycle.
+    grantRelays();
 }
 
-void StateGpioHandler::ring(bool testRing)
+void StateGpioHandler::ring(int index, bool testRing)
 {
-    ringActive = true;
-    mqttHandler->writeRingToMqttAndLog(testRing);
+    RingInput& ringInput = ringInputs[index];
+    ringInput.ringActive = true;
+    // A test ring has no input edge, its latency starts with the command.
+    const uint32_t edgeMs = testRing ? millis() : ringInput.input.getPressEdgeMs();
+    mqttHandler->writeRingToMqttAndLog(ringInput.config.name, testRing, edgeMs);
     scheduleEvent(stateExtBell);
-    timerBellBlink.start();
+    ringInput.timerBellBlink.start();
 
     if (autoBuzz) {
         buzz();
@@ -162,7 +204,7 @@ void StateGpioHandler::setAutoBuzzState(bool newAutoBuzzState)
     if (newAutoBuzzState == autoBuzz) return;
     autoBuzz = newAutoBuzzState;
     mqttHandler->writeAutoBuzzStateToLogAndMqtt(newAutoBuzzState);
-    writeEeprom();
+    settingsStore->setBool(Setting::AutoBuzz, autoBuzz);
 }
 
 bool StateGpioHandler::getAutoBuzzState() const
@@ -170,128 +212,212 @@ bool StateGpioHandler::getAutoBuzzState() const
     return autoBuzz;
 }
 
-void StateGpioHandler::ackRing()
+bool StateGpioHandler::getRelaysIdle() const
 {
-    ringActive = false;
-    mqttHandler->writeAckRingToMqtt();
+    return stateDoorBuzzer == EventState::Idle && stateExtBell == EventState::Idle;
+}
+
+void StateGpioHandler::ackRing(int index)
+{
+    RingInput& ringInput = ringInputs[index];
+    ringInput.ringActive = false;
+    mqttHandler->writeAckRingToMqtt(ringInput.config.name);
     timerAckLedOn.start();
-    timerBellBlink.stop();
+    ringInput.timerBellBlink.stop();
+}
+
+void StateGpioHandler::ackAllRings()
+{
+    for (int i = 0; i < NumRingInputs; ++i) {
+        if (ringInputs[i].ringActive) ackRing(i);
+    }
+}
+
+uint8_t StateGpioHandler::getRingActiveMask() const
+{
+    uint8_t mask = 0;
+    for (int i = 0; i < NumRingInputs; ++i) {
+        if (ringInputs[i].ringActive) mask |= 1 << i;
+    }
+    return mask;
 }
 
 void StateGpioHandler::ackRingButton()
 {
-    if (!ringActive) {
+    if (!getRingActiveMask()) {
         timerErrorLedOn.start();
         return;
     }
-    ackRing();
+    ackAllRings();
 }
 
 void StateGpioHandler::ackRingAndBuzzButton()
 {
-    if (!ringActive) {
+    if (!getRingActiveMask()) {
         timerErrorLedOn.start();
         return;
     }
 
-    ackRing();
+    ackAllRings();
     if (!autoBuzz) {
         buzz();
     }
 }
 
 
-void StateGpioHandler::writeLedsInNormalLoop()
+void StateGpioHandler::setLedsInNormalLoop()
 {
-    digitalWrite(LED_BUILTIN, HIGH);
-    digitalWrite(LedOn, HIGH);
+    using namespace LedPatterns;
+
+    ledEngine.setPattern(LED_BUILTIN, Solid);
+    ledEngine.setPattern(LedOn, Solid);
+    ledEngine.setPattern(Led3Unused, Off);
     if (timerAckLedOn.check()) {
-        digitalWrite(LedAckAutobuzz, HIGH);
+        ledEngine.setPattern(LedAckAutobuzz, Solid);
     } else {
-        digitalWrite(LedAckAutobuzz, autoBuzz ? blinkState : LOW);
+        ledEngine.setPattern(LedAckAutobuzz, autoBuzz ? LedPatternAutoBuzz : Off);
     }
     if (wantToReboot) {
-        digitalWrite(LedError, blinkState);
+        ledEngine.setPattern(LedError, LedPatternRebootPending);
+    } else {
+        ledEngine.setPattern(LedError, timerErrorLedOn.check() ? Solid : Off);
+    }
+    // One doorbell LED for all inputs, blink in opposite state of the auto buzzer LED
+    bool bellBlink = false;
+    for (const auto& ringInput : ringInputs) {
+        bellBlink = bellBlink || ringInput.timerBellBlink.check();
+    }
+    if (bellBlink) {
+        ledEngine.setPattern(LedDoorbell, LedPatternRingBlink, 1);
     } else {
-        digitalWrite(LedError, timerErrorLedOn.check() ? HIGH : LOW);
+        ledEngine.setPattern(LedDoorbell, getRingActiveMask() ? Solid : Off);
     }
-    // Blick in opposite state of the auto buzzer LED
-    digitalWrite(LedDoorbell, timerBellBlink.check() ? !blinkState : static_cast<uint8_t>(ringActive));
+}
+
+void StateGpioHandler::updateElapsedCycles()
+{
+    // A blocking stage (e.g. a reconnect) stretches a loop cycle. Debouncing counts the cycles that passed,
+    // so a press is detected after its debounce time and not after a number of (long) samples.
+    // Rounded down, the busy time of a normal loop does not count as a cycle.
+    const uint32_t nowMs = millis();
+    const int loopMs = app->getLoopMs();
+    elapsedCycles = loopStartMs == 0 ? 1 : max(1, static_cast<int>((nowMs - loopStartMs) / loopMs));
+    loopStartMs = nowMs;
 }
 
 void StateGpioHandler::readSwitches()
 {
-    if (switchBuzzMode.checkRaise()) {
+    if (switchBuzzMode.checkRaise(elapsedCycles, loopStartMs)) {
         setAutoBuzzState(!autoBuzz);
     }
 
-    if (switchAckBuzz.checkRaise()) {
+    if (switchAckBuzz.checkRaise(elapsedCycles, loopStartMs)) {
         ackRingAndBuzzButton();
     }
 
-    if (switchAck.checkRaise()) {
+    if (switchAck.checkRaise(elapsedCycles, loopStartMs)) {
         ackRingButton();
     }
 }
 
 void StateGpioHandler::readInputs()
 {
-    if (inputRing.checkRaise()) {
-        ring(false);
+    for (int i = 0; i < NumRingInputs; ++i) {
+        if (ringInputs[i].input.checkRaise(elapsedCycles, loopStartMs)) {
+            ring(i, false);
+        }
     }
 }
 
 void StateGpioHandler::handleRelays()
+{
+    // Running -> Idle, the relays are switched off by their timers
+    finishPulse(stateExtBell, relayExtBell);
+    finishPulse(stateDoorBuzzer, relayDoorBuzzer);
+
+    grantRelays();
+}
+
+void StateGpioHandler::grantRelays()
 {
     // Never turn of both relays at the same time,
     // the power consumption is probably too high.
 
     // Scheduled -> Running - only if no other relay is running
-    if (stateExtBell == EventState::Scheduled && stateDoorBuzzer != EventState::Running) {
+    if (stateExtBell == EventState::Scheduled && !relayDoorBuzzer.isRunning()) {
         stateExtBell = EventState::Running;
-        timerExtBell.start();
-    } else if (stateDoorBuzzer == EventState::Scheduled && stateExtBell != EventState::Running) {
+        relayExtBell.start();
+    } else if (stateDoorBuzzer == EventState::Scheduled && !relayExtBell.isRunning()) {
         stateDoorBuzzer = EventState::Running;
-        timerDoorBuzzer.start();
+        relayDoorBuzzer.start();
     }
+}
 
-    // Running -> Idle
-    if (stateExtBell == EventState::Running && !timerExtBell.check()) {
-        stateExtBell = EventState::Idle;
-    }
-    if (stateDoorBuzzer == EventState::Running && !timerDoorBuzzer.check()) {
-        stateDoorBuzzer = EventState::Idle;
-    }
+void StateGpioHandler::finishPulse(EventState& state, RelayPulse& relay)
+{
+    if (state != EventState::Running || relay.isRunning()) return;
 
-    digitalWrite(RelayBuzzer, stateDoorBuzzer == EventState::Running ? HIGH : LOW);
-    digitalWrite(RelayExtBell, stateExtBell == EventState::Running ? HIGH : LOW);
+    state = EventState::Idle;
+    uint32_t durationUs = 0;
+    if (relay.takeFinishedPulse(durationUs)) {
+        mqttHandler->writeRelayPulseToLog(relay.getName(), durationUs, relay.getLastPulseDurationMs());
+    }
 }
 
 void StateGpioHandler::decrementTimers()
 {
     timerAckLedOn.decrement();
     timerErrorLedOn.decrement();
-    timerDoorBuzzer.decrement();
-    timerExtBell.decrement();
-    timerBellBlink.decrement();
+    for (auto& ringInput : ringInputs) {
+        ringInput.timerBellBlink.decrement();
+    }
     timerErrorLedOn.decrement();
     timerReboot.decrement();
 }
 
-const CircularArray<String, MaxRawDataStrings>& StateGpioHandler::getArchivedRawDataStrings() const
+int StateGpioHandler::findRingInput(const String& name) const
+{
+    for (int i = 0; i < NumRingInputs; ++i) {
+        if (name == ringInputs[i].config.name) return i;
+    }
+    return -1;
+}
+
+const RingInputConfig& StateGpioHandler::getRingInputConfig(int index) const
+{
+    return ringInputs[index].config;
+}
+
+const CircularArray<String, MaxRawDataStrings>& StateGpioHandler::getArchivedRawDataStrings(int index) const
+{
+    return ringInputs[index].input.getArchivedRawDataStrings();
+}
+
+String StateGpioHandler::getRelayStatsStr() const
+{
+    return relayDoorBuzzer.getStatsStr() + ", " + relayExtBell.getStatsStr();
+}
+
+String StateGpioHandler::getCurrentRawDataStr(int index) const
+{
+    return ringInputs[index].input.getCurrentRawDataStr();
+}
+
+void StateGpioHandler::setRingTraceEnabled(int index, bool enabled)
 {
-    return inputRing.getArchivedRawDataStrings();
+    ringInputs[index].input.setTraceEnabled(enabled);
 }
 
-String StateGpioHandler::getCurrentRawDataStr() const
+const CircularArray<TraceSample, MaxTraceSamples>& StateGpioHandler::getRingTrace(int index) const
 {
-    return inputRing.getCurrentRawDataStr();
+    return ringInputs[index].input.getTrace();
 }
 
-void StateGpioHandler::reboot()
+void StateGpioHandler::reboot(RebootCause cause)
 {
     if (!wantToReboot) {
         wantToReboot = true;
+        rtcLog->setRebootCause(cause);
         timerReboot.start();
     }
 }
\ No newline at end of file
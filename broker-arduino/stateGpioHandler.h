@@ -1,11 +1,20 @@
 #pragma once
 
 #include "debouncedSwitch.h"
+#include "gpioConfig.h"
+#include "ledEngine.h"
+#include "relayPulse.h"
 #include "timer.h"
 
+#include <array>
+#include <utility>
+
 class App;
 class MqttHandler;
 class NetworkHandler;
+class RtcLog;
+class SettingsStore;
+enum class RebootCause : uint8_t;
 
 class StateGpioHandler final
 {
@@ -14,79 +23,111 @@ public:
 
     void setup();
     void loop();
+    void applyParams();
 
     // Waiting / system state from external
     void loopWaitCycle();
     void waitSeconds(int sec);
-    void reboot();
+    void reboot(RebootCause cause);
+
+    // Ring inputs by index (see RingInputs), findRingInput returns -1 for an unknown name
+    int findRingInput(const String& name) const;
+    const RingInputConfig& getRingInputConfig(int index) const;
 
     // State
-    const CircularArray<String, MaxRawDataStrings>& getArchivedRawDataStrings() const;
-    String getCurrentRawDataStr() const;
+    const CircularArray<String, MaxRawDataStrings>& getArchivedRawDataStrings(int index) const;
+    String getCurrentRawDataStr(int index) const;
+    void setRingTraceEnabled(int index, bool enabled);
+    const CircularArray<TraceSample, MaxTraceSamples>& getRingTrace(int index) const;
     bool getAutoBuzzState() const;
+    bool getRelaysIdle() const;
+    String getRelayStatsStr() const;
 
     // Events
-    void ring(bool testRing);
+    void ring(int index, bool testRing);
     void buzz();
     void setAutoBuzzState(bool newAutoBuzzState);
-    void ackRing();
+    void ackRing(int index);
+    void ackAllRings();
 
 private:
+    enum class EventState
+    {
+        Idle,
+        Scheduled,
+        Running,
+    };
+
+    // Ring input with its own debounce, raw data, ring and bell blink state
+    struct RingInput final
+    {
+        RingInput(const RingInputConfig& config, App* app);
+
+        const RingInputConfig& config;
+        RawLoggedSwitch input;
+        DurationTimer timerBellBlink;
+        bool ringActive = false;
+    };
+
+    template<size_t... Indices>
+    static std::array<RingInput, NumRingInputs> createRingInputs(App* app, std::index_sequence<Indices...>);
+
     // Events
     void ackRingButton();
     void ackRingAndBuzzButton();
+    uint8_t getRingActiveMask() const;
 
-    // Setup / EEPROM
+    // Setup
     void setupPins();
-    void readEeprom();
-    void writeEeprom();
+    void restoreFromRtcLog();
 
     // Loop functions
-    void updateBlinkState();
+    void updateElapsedCycles();
     void readSwitches();
     void readInputs();
     void handleRelays();
-    void writeLedsInNormalLoop();
+    void grantRelays();
+    void finishPulse(EventState& state, RelayPulse& relay);
+    void setLedsInNormalLoop();
+    void setLedsInWaitCycle();
     void decrementTimers();
     void checkForReboot();
 
-    enum class EventState
-    {
-        Idle,
-        Scheduled,
-        Running,
-    };
-
     void scheduleEvent(EventState& state);
 
     // Connection to other components
     App* const app;
     MqttHandler* mqttHandler = nullptr;
     NetworkHandler* networkHandler = nullptr;
+    RtcLog* rtcLog = nullptr;
+    SettingsStore* settingsStore = nullptr;
 
     // GPIO inputs
-    DebouncedSwitch switchBuzzMode;
-    DebouncedSwitch switchAckBuzz;
-    DebouncedSwitch switchAck;
-    DebouncedSwitch inputRing;
+    PlainSwitch switchBuzzMode;
+    PlainSwitch switchAckBuzz;
+    PlainSwitch switchAck;
+    std::array<RingInput, NumRingInputs> ringInputs;
+
+    // LEDs
+    LedEngine ledEngine;
+
+    // Relays
+    RelayPulse relayDoorBuzzer;
+    RelayPulse relayExtBell;
 
     // Timers
-    DurationTimer timerDoorBuzzer;
-    DurationTimer timerExtBell;
-    DurationTimer timerBellBlink;
     DurationTimer timerAckLedOn;
     DurationTimer timerErrorLedOn;
     DurationTimer timerReboot;
 
+    // Start of the current loop and the loop cycles since the last one, more than one if it stalled
+    uint32_t loopStartMs = 0;
+    int elapsedCycles = 1;
+
     // System states
-    bool ringActive = false;
     bool autoBuzz = false;
     bool wantToReboot = false;
 
-    // LED state
-    uint8_t blinkState = 0;
-    uint8_t ledSeq = 0;
-
     // States for Buzzer and Ext Bell relays
     EventState stateDoorBuzzer = EventState::Idle;
     EventState stateExtBell = EventState::Idle;
@@ -14,6 +14,15 @@ void BaseTimer::stop()
     count = -1;
 }
 
+void BaseTimer::setCycles(int newCycles)
+{
+    if (count > 0 && cycles > 0) {
+        const int scaledCount = count * newCycles / cycles;
+        count = scaledCount > 0 ? scaledCount : 1;
+    }
+    cycles = newCycles;
+}
+
 void BaseTimer::decrement()
 {
     if (count >= -1) --count;
@@ -40,7 +49,7 @@ DurationTimer::DurationTimer(int cycles)
     : BaseTimer(cycles)
 {}
 
-bool DurationTimer::check()
+bool DurationTimer::check() const
 {
     return count > 0;
 }
\ No newline at end of file
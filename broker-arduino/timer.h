@@ -9,8 +9,11 @@ public:
     void stop();
     void decrement();
 
+    // A running timer is rescaled, so it keeps its remaining share of the duration.
+    void setCycles(int newCycles);
+
 protected:
-    const int cycles;
+    int cycles;
     int count = 0;
 };
 
@@ -34,5 +37,5 @@ class DurationTimer final : public BaseTimer
 public:
     DurationTimer(int cycles);
 
-    bool check();
+    bool check() const;
 };
\ No newline at end of file
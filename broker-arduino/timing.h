@@ -1,14 +1,44 @@
 #pragma once
 
+// The main loop period, relay durations, debounce times and the NTP interval are defaults of the
+// runtime-tunable parameters (params.h). Durations are given in ms; timers counting main loop cycles
+// convert them with the current loop period (msToCycles), so they keep their length if it changes.
 
 constexpr int MainLoopSampleTimeMs = 100;
 constexpr int StartupCycleTimeMs = 200;
+constexpr int LoopLoadWindowMs = 5000; // window of the loop load measurement
 
-constexpr int DoorOpenCycles = 50;   // 5 sec
-constexpr int ExtBellCycles = 10;    // 1 sec
-constexpr int AckLedCycles = 10;     // 1 sec
-constexpr int ErrorLedCycles = 10;   // 1 sec
-constexpr int RebootWaitCycles = 20; // 2 sec
-constexpr int BellBlinkCycles = 600; // 60 sec
+// Relay pulses are timed by esp_timer, independent of the main loop
+constexpr int DoorOpenMs = 5000;
+constexpr int ExtBellMs = 1000;
 
-constexpr int WifiTimeoutCycles = 50; // 5sec, as a startup cycle is 200ms
+constexpr int AckLedMs = 1000;
+constexpr int ErrorLedMs = 1000;
+constexpr int RebootWaitMs = 2000;
+constexpr int BellBlinkMs = 60 * 1000;
+
+constexpr int NtpUpdateIntervalMs = 1000; // the loop checks this often for the first NTP reply
+
+// Startup cycles (StartupCycleTimeMs), the loop period does not apply to them
+constexpr int WifiTimeoutCycles = 50;     // 5sec, as a startup cycle is 200ms
+constexpr int FastBootTimeoutCycles = 15; // 3sec for the network of the last connection
+
+constexpr int MqttRetryMs = 3000; // between MQTT recovery attempts
+
+// Upstream bridge: reconnect attempts with exponential backoff, a connect attempt blocks the loop
+constexpr int BridgeRetryMinMs = 5000;
+constexpr int BridgeRetryMaxMs = 60 * 1000;
+constexpr int BridgeConfirmTimeoutMs = 5000; // events without an echo (QoS 0) are sent again after this
+
+// WiFi supervisor: reconnect attempts with exponential backoff, reboot only after a long outage
+constexpr int WifiRetryMinMs = 1000;
+constexpr int WifiRetryMaxMs = 30 * 1000;
+constexpr int WifiSettleMs = 10 * 1000;            // for clients to reconnect before queued events are published
+constexpr int LiveRingMs = 30 * 1000;              // younger rings are published right after an outage, without the settle time
+constexpr int WifiOutageRebootMs = 10 * 60 * 1000; // 10 min
+
+// Main loop cycles for a duration, at least one
+constexpr int msToCycles(int ms, int loopMs)
+{
+    return ms <= loopMs ? 1 : (ms + loopMs / 2) / loopMs;
+}
@@ -0,0 +1,308 @@
+// Microbenchmarks of the broker building blocks, compiled against the stand-ins in stubs/.
+// Reports ns/op (median of repeated runs) and heap allocations/op, writes the results as JSON and compares them to a baseline.
+
+#include "app.h"
+#include "circularArray.h"
+#include "debouncedSwitch.h"
+#include "gpioConfig.h"
+#include "mqttHandler.h"
+#include "sim.h"
+#include "stateGpioHandler.h"
+#include "timer.h"
+#include "timing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+// --------------------------------------------------------------
+// Allocation counting
+
+namespace {
+uint64_t numAllocations = 0;
+}
+
+// Not inlined: GCC would see malloc()/free() in the operators and warn of a mismatch with new/delete.
+__attribute__((noinline)) void* operator new(size_t size)
+{
+    ++numAllocations;
+    if (void* ptr = std::malloc(size ? size : 1)) return ptr;
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+__attribute__((noinline)) void operator delete(void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+namespace {
+
+template<typename T>
+void doNotOptimize(const T& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// --------------------------------------------------------------
+// Harness
+
+struct Result
+{
+    std::string name;
+    double nsPerOp = 0;
+    double allocsPerOp = 0;
+};
+
+using BenchFn = std::function<void(uint64_t iterations)>;
+
+Result runBenchmark(const std::string& name, const BenchFn& fn)
+{
+    using Clock = std::chrono::steady_clock;
+    constexpr double MinRunSec = 0.05;
+    constexpr int Repetitions = 9;
+
+    // Find the number of iterations for the minimum run time
+    uint64_t iterations = 1;
+    for (;;) {
+        const auto start = Clock::now();
+        fn(iterations);
+        const double sec = std::chrono::duration<double>(Clock::now() - start).count();
+        if (sec >= MinRunSec || iterations >= (uint64_t(1) << 32)) break;
+        iterations *= sec < MinRunSec / 10 ? 10 : 2;
+    }
+
+    // The median is robust against runs disturbed by other processes, in both directions.
+    Result result{name, 0, 0};
+    std::vector<double> nsPerOp;
+    for (int rep = 0; rep < Repetitions; ++rep) {
+        const uint64_t allocationsBefore = numAllocations;
+        const auto start = Clock::now();
+        fn(iterations);
+        const double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        nsPerOp.push_back(ns / iterations);
+        result.allocsPerOp = std::max(result.allocsPerOp, double(numAllocations - allocationsBefore) / iterations);
+    }
+    std::nth_element(nsPerOp.begin(), nsPerOp.begin() + Repetitions / 2, nsPerOp.end());
+    result.nsPerOp = nsPerOp[Repetitions / 2];
+    return result;
+}
+
+// --------------------------------------------------------------
+// Benchmarks
+
+std::vector<std::pair<std::string, BenchFn>> createBenchmarks(App& app)
+{
+    std::vector<std::pair<std::string, BenchFn>> benchmarks;
+
+    benchmarks.emplace_back("CircularArray<int,100>::push", [](uint64_t n) {
+        static CircularArray<int, 100> array;
+        for (uint64_t i = 0; i < n; ++i) array.push(int(i));
+        doNotOptimize(array);
+    });
+
+    benchmarks.emplace_back("CircularArray<int,128>::push", [](uint64_t n) {
+        static CircularArray<int, 128> array;
+        for (uint64_t i = 0; i < n; ++i) array.push(int(i));
+        doNotOptimize(array);
+    });
+
+    benchmarks.emplace_back("CircularArray<String,50>::push", [](uint64_t n) {
+        static CircularArray<String, 50> array;
+        static const String entry = "2025-06-01 12:00:00 ring auto buzz";
+        for (uint64_t i = 0; i < n; ++i) array.push(entry);
+        doNotOptimize(array);
+    });
+
+    benchmarks.emplace_back("CircularArray<int,100>::iterate", [](uint64_t n) {
+        static CircularArray<int, 100> array;
+        for (int i = 0; i < 100; ++i) array.push(i);
+        int sum = 0;
+        for (uint64_t i = 0; i < n; ++i) {
+            for (const int value : array) sum += value;
+            doNotOptimize(sum);
+        }
+    });
+
+    benchmarks.emplace_back("CircularArray<int,100>::pushN(16)", [](uint64_t n) {
+        static CircularArray<int, 100> array;
+        static const int values[16] = {};
+        for (uint64_t i = 0; i < n; ++i) array.pushN(values, 16);
+        doNotOptimize(array);
+    });
+
+    benchmarks.emplace_back("CircularArray<int,100>::copyOut", [](uint64_t n) {
+        static CircularArray<int, 100> array;
+        static int out[100];
+        for (int i = 0; i < 130; ++i) array.push(i);
+        for (uint64_t i = 0; i < n; ++i) {
+            doNotOptimize(array.copyOut(out, 100));
+            doNotOptimize(out);
+        }
+    });
+
+    benchmarks.emplace_back("SpscCircularArray<uint32_t,4>::push+pop", [](uint64_t n) {
+        static SpscCircularArray<uint32_t, 4> ring;
+        uint32_t value = 0;
+        for (uint64_t i = 0; i < n; ++i) {
+            ring.push(uint32_t(i));
+            ring.pop(value);
+            doNotOptimize(value);
+        }
+    });
+
+    benchmarks.emplace_back("DebouncedSwitch::checkRaise", [](uint64_t n) {
+        static PlainSwitch debouncedSwitch(SwitchAck, msToCycles(SwitchDebounceMs, MainLoopSampleTimeMs));
+        for (uint64_t i = 0; i < n; ++i) {
+            sim::gpio().setInput(SwitchAck, (i / 4) % 2 ? LOW : HIGH);
+            doNotOptimize(debouncedSwitch.checkRaise());
+        }
+    });
+
+    benchmarks.emplace_back("EventTimer::checkAndDecrement", [](uint64_t n) {
+        static EventTimer timer(10, true);
+        timer.start();
+        for (uint64_t i = 0; i < n; ++i) doNotOptimize(timer.checkAndDecrement());
+    });
+
+    benchmarks.emplace_back("DurationTimer::check+decrement", [](uint64_t n) {
+        static DurationTimer timer(50);
+        for (uint64_t i = 0; i < n; ++i) {
+            if (!timer.check()) timer.start();
+            timer.decrement();
+            doNotOptimize(timer);
+        }
+    });
+
+    benchmarks.emplace_back("StateGpioHandler::loop (idle)", [&app](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) app.getStateGpioHandler()->loop();
+    });
+
+    benchmarks.emplace_back("StateGpioHandler::loop (relays)", [&app](uint64_t n) {
+        auto* stateGpioHandler = app.getStateGpioHandler();
+        for (uint64_t i = 0; i < n; ++i) {
+            if (i % 64 == 0) stateGpioHandler->buzz();
+            stateGpioHandler->loop();
+        }
+    });
+
+    const auto commandBenchmark = [&app](const char* command) {
+        return [&app, command](uint64_t n) {
+            auto& bus = sim::mqttBus("localhost");
+            for (uint64_t i = 0; i < n; ++i) {
+                bus.publish("cmd", command);
+                app.getMqttHandler()->loop();
+            }
+        };
+    };
+    benchmarks.emplace_back("MqttHandler::callbackMqtt ping", commandBenchmark("ping"));
+    benchmarks.emplace_back("MqttHandler::callbackMqtt getAutoBuzz", commandBenchmark("getAutoBuzz"));
+    benchmarks.emplace_back("MqttHandler::callbackMqtt unknown", commandBenchmark("unknownCommand"));
+
+    return benchmarks;
+}
+
+// --------------------------------------------------------------
+// Result files
+
+void writeResults(const std::string& path, const std::vector<Result>& results)
+{
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        printf("Cannot write %s\n", path.c_str());
+        return;
+    }
+    fprintf(file, "[\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        fprintf(file,
+                "  {\"name\": \"%s\", \"ns_per_op\": %.2f, \"allocs_per_op\": %.3f}%s\n",
+                results[i].name.c_str(),
+                results[i].nsPerOp,
+                results[i].allocsPerOp,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "]\n");
+    fclose(file);
+}
+
+// Reads files written by writeResults(), one benchmark per line.
+std::map<std::string, Result> readResults(const std::string& path)
+{
+    std::map<std::string, Result> results;
+    FILE* file = fopen(path.c_str(), "r");
+    if (!file) return results;
+
+    char line[512];
+    char name[256];
+    while (fgets(line, sizeof(line), file)) {
+        Result result;
+        if (sscanf(line, " {\"name\": \"%255[^\"]\", \"ns_per_op\": %lf, \"allocs_per_op\": %lf", name, &result.nsPerOp, &result.allocsPerOp)
+            == 3) {
+            result.name = name;
+            results[result.name] = result;
+        }
+    }
+    fclose(file);
+    return results;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    std::string outPath = "bench-results.json";
+    std::string baselinePath;
+    // Timing differences are reported, they only fail the run with --max-slowdown: host timings of a shared
+    // machine vary by more than the changes worth catching. More allocations always fail it.
+    constexpr double ReportedSlowdown = 1.25;
+    double maxSlowdown = 0;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--out" && i + 1 < argc) outPath = argv[++i];
+        else if (arg == "--baseline" && i + 1 < argc) baselinePath = argv[++i];
+        else if (arg == "--max-slowdown" && i + 1 < argc) maxSlowdown = std::stod(argv[++i]);
+        else {
+            printf("Usage: broker-bench [--out FILE] [--baseline FILE] [--max-slowdown FACTOR]\n");
+            return 2;
+        }
+    }
+
+    static App app;
+    app.setup();
+    app.loop();
+
+    const auto baseline = readResults(baselinePath);
+    std::vector<Result> results;
+    int numRegressions = 0;
+
+    printf("%-42s %12s %12s   %s\n", "benchmark", "ns/op", "allocs/op", baseline.empty() ? "" : "vs. baseline");
+    for (const auto& [name, fn] : createBenchmarks(app)) {
+        const Result result = runBenchmark(name, fn);
+        results.push_back(result);
+        printf("%-42s %12.1f %12.3f", name.c_str(), result.nsPerOp, result.allocsPerOp);
+
+        auto it = baseline.find(name);
+        if (it != baseline.end()) {
+            const double factor = result.nsPerOp / std::max(it->second.nsPerOp, 1e-3);
+            const bool moreAllocations = result.allocsPerOp > it->second.allocsPerOp + 1e-3;
+            const bool regression = moreAllocations || (maxSlowdown > 0 && factor > maxSlowdown);
+            printf("   x%.2f%s%s", factor, factor > ReportedSlowdown && !regression ? "  slower" : "", regression ? "  REGRESSION" : "");
+            if (regression) ++numRegressions;
+        }
+        printf("\n");
+    }
+
+    writeResults(outPath, results);
+    printf("Results written to %s\n", outPath.c_str());
+    return numRegressions == 0 ? 0 : 1;
+}
@@ -0,0 +1,194 @@
+// Checks of the broker containers (CircularArray, SpscCircularArray), compiled against the stand-ins in stubs/.
+// Prints every failed check, the exit code is non-zero if one failed.
+
+#include "circularArray.h"
+
+#include <Arduino.h>
+
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+int numChecks = 0;
+int numFailures = 0;
+
+void check(bool condition, const char* what, int line)
+{
+    ++numChecks;
+    if (!condition) {
+        ++numFailures;
+        printf("FAILED (line %d): %s\n", line, what);
+    }
+}
+
+#define CHECK(condition) check((condition), #condition, __LINE__)
+
+template<typename T, int maxSize>
+std::vector<T> contents(const CircularArray<T, maxSize>& array)
+{
+    std::vector<T> values;
+    for (const T& value : array) values.push_back(value);
+    return values;
+}
+
+// Both index wrapping modes: by mask (power of two) and by subtraction
+template<int maxSize>
+void checkOverwriteOrder()
+{
+    CircularArray<int, maxSize> array;
+    CHECK(array.size() == 0 && !array.full());
+    for (int i = 0; i < maxSize + 3; ++i) array.push(i);
+    CHECK(array.full());
+    CHECK(array.size() == maxSize);
+    CHECK(array.at(0) == 3);
+    CHECK(array[maxSize - 1] == maxSize + 2);
+
+    std::vector<int> expected;
+    for (int i = 3; i < maxSize + 3; ++i) expected.push_back(i);
+    CHECK(contents(array) == expected);
+}
+
+void checkMovePushAndClear()
+{
+    CircularArray<String, 3> array;
+    String value = "a string longer than the small string buffer";
+    array.push(std::move(value));
+    CHECK(array.at(0) == "a string longer than the small string buffer");
+
+    array.clear();
+    CHECK(array.size() == 0);
+    array.push(String("b"));
+    CHECK(array.size() == 1 && array.at(0) == "b");
+}
+
+template<int maxSize>
+void checkPushN()
+{
+    // Across the end of the storage
+    CircularArray<int, maxSize> array;
+    for (int i = 0; i < maxSize - 2; ++i) array.push(-1);
+    const int values[] = {0, 1, 2, 3, 4};
+    array.pushN(values, 5);
+    CHECK(array.full());
+    CHECK(array.at(maxSize - 5) == 0 && array.at(maxSize - 1) == 4);
+
+    // More values than the size: only the last ones are kept.
+    std::vector<int> many(2 * maxSize + 1);
+    for (int i = 0; i < static_cast<int>(many.size()); ++i) many[i] = i;
+    array.pushN(many.data(), many.size());
+    std::vector<int> expected(many.end() - maxSize, many.end());
+    CHECK(contents(array) == expected);
+
+    // Same as single pushes
+    CircularArray<int, maxSize> single;
+    CircularArray<int, maxSize> bulk;
+    for (int i = 0; i < 3; ++i) {
+        single.push(i);
+        bulk.push(i);
+    }
+    for (int i = 0; i < maxSize; ++i) single.push(many[i]);
+    bulk.pushN(many.data(), maxSize);
+    CHECK(contents(single) == contents(bulk));
+}
+
+template<int maxSize>
+void checkCopyOut()
+{
+    CircularArray<int, maxSize> array;
+    int out[maxSize + 1] = {};
+    CHECK(array.copyOut(out, maxSize) == 0);
+
+    for (int i = 0; i < maxSize + 2; ++i) array.push(i);
+    CHECK(array.copyOut(out, maxSize + 1) == maxSize);
+    CHECK(out[0] == 2 && out[maxSize - 1] == maxSize + 1);
+    CHECK(array.copyOut(out, 2) == 2);
+    CHECK(out[0] == 2 && out[1] == 3);
+}
+
+void checkSpscSingleThread()
+{
+    SpscCircularArray<int, 4> ring;
+    int value = 0;
+    CHECK(ring.empty() && !ring.pop(value));
+    for (int i = 0; i < 4; ++i) CHECK(ring.push(i));
+    CHECK(!ring.push(4)); // full, nothing is overwritten
+    CHECK(ring.size() == 4);
+    CHECK(ring.pop(value) && value == 0);
+
+    const int values[] = {10, 11, 12};
+    CHECK(ring.pushN(values, 3) == 1); // only one is free
+    int out[8] = {};
+    CHECK(ring.popN(out, 8) == 4);
+    CHECK(out[0] == 1 && out[2] == 3 && out[3] == 10);
+    CHECK(ring.empty());
+
+    // Free running counters across the storage end
+    for (int round = 0; round < 10; ++round) {
+        CHECK(ring.pushN(values, 3) == 3);
+        CHECK(ring.popN(out, 2) == 2 && out[0] == 10 && out[1] == 11);
+        CHECK(ring.pop(value) && value == 12);
+    }
+}
+
+void checkSpscTwoThreads()
+{
+    // Producer and consumer on their own threads: every value arrives once and in order.
+    constexpr uint32_t NumValues = 200000;
+    SpscCircularArray<uint32_t, 64> ring;
+
+    std::thread producer([&ring]() {
+        uint32_t next = 0;
+        uint32_t batch[5];
+        while (next < NumValues) {
+            // The consumer may run on the same core, a full ring hands over to it.
+            if (ring.size() == 64) std::this_thread::yield();
+            if (next % 3 == 0) {
+                if (ring.push(next)) ++next;
+            } else {
+                int n = 0;
+                while (n < 5 && next + n < NumValues) {
+                    batch[n] = next + n;
+                    ++n;
+                }
+                next += ring.pushN(batch, n);
+            }
+        }
+    });
+
+    uint32_t expected = 0;
+    bool inOrder = true;
+    uint32_t out[7];
+    while (expected < NumValues) {
+        const int n = ring.popN(out, 7);
+        if (n == 0) std::this_thread::yield();
+        for (int i = 0; i < n; ++i) {
+            if (out[i] != expected) inOrder = false;
+            ++expected;
+        }
+    }
+    producer.join();
+
+    CHECK(inOrder);
+    CHECK(ring.empty());
+}
+
+} // namespace
+
+int main()
+{
+    checkOverwriteOrder<8>();
+    checkOverwriteOrder<10>();
+    checkMovePushAndClear();
+    checkPushN<8>();
+    checkPushN<10>();
+    checkCopyOut<8>();
+    checkCopyOut<10>();
+    checkSpscSingleThread();
+    checkSpscTwoThreads();
+
+    printf("%d checks, %d failed\n", numChecks, numFailures);
+    return numFailures == 0 ? 0 : 1;
+}
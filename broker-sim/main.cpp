@@ -0,0 +1,429 @@
+// Host simulation of the broker firmware.
+// Runs the real broker sources against the stand-ins in stubs/ with a virtual clock,
+// presses the ring inputs (in turn) many times and measures ring-to-publish latency and relay timing.
+
+#include "app.h"
+#include "gpioConfig.h"
+#include "sim.h"
+#include "timing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Stand-in for an upstream broker (like mosquitto) on the network, with credentials
+const char* UpstreamHost = "upstream";
+const char* UpstreamUser = "doorbell";
+const char* UpstreamPassword = "secret";
+
+// Free heap the client limit of the firmware keeps for WiFi, NTP and logs (MqttHeapReserve)
+constexpr uint32_t HeapReserve = 32 * 1024;
+
+// Broker clients the firmware has to accept, the local client included
+constexpr int TargetNumClients = 32;
+
+struct Options
+{
+    int numRings = 1000;
+    int buzzEvery = 10;
+    uint32_t seed = 1;
+    uint32_t stallMs = 0;
+    int stallEvery = 0;
+    uint32_t relayToleranceMs = 0;
+    int brokerCrashEvery = 0;
+    int wifiOutageEvery = 0;
+    uint32_t wifiOutageMs = 5000;
+    int numSubscribers = 0;
+    bool upstream = false;
+    int upstreamOutageEvery = 0;
+    uint32_t upstreamOutageMs = 20000;
+    int upstreamLossEvery = 0;
+    bool verbose = false;
+};
+
+struct Stats
+{
+    std::vector<double> values;
+
+    void add(double value)
+    {
+        values.push_back(value);
+    }
+    double percentile(double p)
+    {
+        if (values.empty()) return 0;
+        std::sort(values.begin(), values.end());
+        const size_t index = std::min(values.size() - 1, static_cast<size_t>(p / 100.0 * values.size()));
+        return values[index];
+    }
+    void print(const char* name, const char* unit)
+    {
+        if (values.empty()) {
+            printf("%-28s no samples\n", name);
+            return;
+        }
+        printf("%-28s n=%-6zu min=%.0f p50=%.0f p95=%.0f max=%.0f %s\n",
+               name,
+               values.size(),
+               percentile(0),
+               percentile(50),
+               percentile(95),
+               percentile(100),
+               unit);
+    }
+};
+
+class RingScenario final
+{
+public:
+    RingScenario(App& app, const Options& options)
+        : app(app)
+        , options(options)
+        , rng(options.seed)
+    {}
+
+    int run()
+    {
+        observe();
+        const auto wallStart = std::chrono::steady_clock::now();
+        app.setup();
+
+        // Like a client waiting for the device: ping until the first pong arrives (with the correlation id echoed).
+        while (pongUs == 0 && sim::clock().nowMs() < 30000) {
+            sim::mqttBus("localhost").publish("cmd", "#1 ping");
+            runLoopsUntil(sim::clock().nowMs() + MainLoopSampleTimeMs);
+        }
+
+        if (options.numSubscribers > 0) connectSubscribers();
+
+        if (options.upstream) {
+            auto& upstreamBus = sim::mqttBus(UpstreamHost);
+            upstreamBus.setCredentials(UpstreamUser, UpstreamPassword);
+            upstreamBus.setRunning(true);
+            sim::mqttBus("localhost").publish("cmd", std::string("setUpstream ") + UpstreamHost + " user=" + UpstreamUser
+                                                         + " password=" + UpstreamPassword);
+            runLoopsUntil(sim::clock().nowMs() + 1000);
+
+            // Only queries are allowed from upstream, the buzzer is not enabled.
+            upstreamBus.publish("doorbell/cmd", "#1 ping");
+            upstreamBus.publish("doorbell/cmd", "#2 buzz");
+            upstreamBus.publish("doorbell/cmd", std::string("#3 setUpstream evil"));
+            upstreamBus.publish("doorbell/cmd", "#4 setParam loopMs 1000");
+            runLoopsUntil(sim::clock().nowMs() + 1000);
+            upstreamBus.setLossEvery(options.upstreamLossEvery);
+        }
+
+        for (int i = 0; i < options.numRings; ++i) {
+            runRing(i);
+        }
+
+        // Events queued for the upstream broker are sent with the next reconnect.
+        if (options.upstream) runLoopsUntil(sim::clock().nowMs() + BridgeRetryMaxMs + 5000);
+
+        const double wallSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+        return report(wallSec);
+    }
+
+private:
+    void observe()
+    {
+        sim::mqttBus("localhost").addObserver("response", [this](const sim::MqttMessage& message) {
+            if (message.payload == "#1 pong" && pongUs == 0) pongUs = message.tsUs;
+        });
+        sim::mqttBus(UpstreamHost).addObserver("doorbell/response", [this](const sim::MqttMessage& message) {
+            if (message.payload == "#1 pong") ++upstreamAllowed;
+            if (message.payload.find(" error: not allowed from upstream") != std::string::npos) ++upstreamRejected;
+        });
+        // Consumer on the upstream broker: drops events with known ids, like a real consumer has to.
+        sim::mqttBus(UpstreamHost).addObserver("doorbell/doorRing/#", [this](const sim::MqttMessage& message) {
+            unsigned long epoch = 0;
+            unsigned long seq = 0;
+            int idLength = 0;
+            if (sscanf(message.payload.c_str(), "%lx.%lu %n", &epoch, &seq, &idLength) != 2) return;
+            if (!upstreamSeqs.insert(seq).second) {
+                ++upstreamDuplicates;
+                return;
+            }
+            // A lost event is sent again later, out of order.
+            if (upstreamLastSeq > 0 && seq != upstreamLastSeq + 1) ++upstreamGaps;
+            upstreamLastSeq = std::max(upstreamLastSeq, seq);
+            if (message.payload.compare(idLength, 5, "ring ") == 0) ++upstreamRings;
+        });
+        sim::mqttBus("localhost").addObserver("doorRing/#", [this](const sim::MqttMessage& message) {
+            // Only a ring on the topic of the pressed input counts.
+            if (message.payload.rfind("ring", 0) == 0 && ringPublishedUs == 0 && message.topic == ringTopic) {
+                ringPublishedUs = message.tsUs;
+                // Timestamps of the ring for latency tracing: "... t=<edge>,<publish>"
+                const size_t timingPos = message.payload.rfind(" t=");
+                unsigned long edgeMs = 0;
+                unsigned long publishMs = 0;
+                if (timingPos != std::string::npos && sscanf(message.payload.c_str() + timingPos, " t=%lu,%lu", &edgeMs, &publishMs) == 2) {
+                    ringStampedEdgeMs = edgeMs;
+                    if (publishMs != message.tsUs / 1000) ++ringStampErrors;
+                } else {
+                    ++ringStampErrors;
+                }
+            }
+        });
+
+        sim::gpio().onOutputChange([this](int pin, int level, uint64_t tsUs) {
+            if (pin != RelayBuzzer && pin != RelayExtBell) return;
+            uint64_t& onSinceUs = pin == RelayBuzzer ? buzzerOnSinceUs : extBellOnSinceUs;
+            if (level == HIGH) {
+                onSinceUs = tsUs;
+                if (sim::gpio().getOutput(RelayBuzzer) == HIGH && sim::gpio().getOutput(RelayExtBell) == HIGH) ++relayOverlaps;
+            } else {
+                const double durationMs = (tsUs - onSinceUs) / 1000.0;
+                if (pin == RelayBuzzer) {
+                    buzzerError.add(std::abs(durationMs - DoorOpenMs));
+                } else {
+                    extBellError.add(std::abs(durationMs - ExtBellMs));
+                }
+            }
+        });
+    }
+
+    // Clients of the doorbell (like the PC client) connect and subscribe to the rings until the broker refuses them.
+    void connectSubscribers()
+    {
+        auto& bus = sim::mqttBus("localhost");
+        for (int i = 0; i < options.numSubscribers; ++i) {
+            if (!bus.connectClient()) continue;
+            const int id = bus.addSubscriber();
+            bus.subscribe(id, "doorRing/#");
+            subscriberIds.push_back(id);
+        }
+        freeHeapWithSubscribers = ESP.getFreeHeap();
+    }
+
+    // Every subscriber has to get the ring of the pressed input.
+    void checkRingFanOut()
+    {
+        auto& bus = sim::mqttBus("localhost");
+        for (const int id : subscriberIds) {
+            bool gotRing = false;
+            sim::MqttMessage message;
+            while (bus.takeMessage(id, message)) {
+                if (message.topic == ringTopic && message.payload.rfind("ring", 0) == 0) gotRing = true;
+            }
+            if (!gotRing) ++undeliveredRings;
+        }
+        // The broker has set up the sessions of all subscribers by now.
+        freeHeapWithSubscribers = std::min(freeHeapWithSubscribers, ESP.getFreeHeap());
+    }
+
+    void runLoopsUntil(uint32_t untilMs)
+    {
+        while (sim::clock().nowMs() < untilMs) {
+            app.loop();
+            if (brokerCrashedUs > 0 && sim::mqttBus("localhost").getNumClients() > 0) {
+                mqttRecovery.add((sim::clock().nowUs() - brokerCrashedUs) / 1000.0);
+                brokerCrashedUs = 0;
+            }
+            if (options.stallEvery > 0 && ++loopCount % options.stallEvery == 0) {
+                // Blocking stage, e.g. a reconnect or a publish burst.
+                sim::clock().advanceUs(uint64_t(options.stallMs) * 1000);
+            }
+        }
+    }
+
+    // Ring input pressed for about one second, with contact bounce at the beginning.
+    void scheduleRingPress(uint32_t pressMs, int pin)
+    {
+        std::uniform_int_distribution<int> bounceMs(5, 40);
+        uint32_t t = pressMs;
+        int level = LOW;
+        for (int i = 0; i < 6; ++i) {
+            sim::gpio().setInputAt(t, pin, level);
+            level = level == LOW ? HIGH : LOW;
+            t += bounceMs(rng);
+        }
+        sim::gpio().setInputAt(t, pin, LOW);
+        sim::gpio().setInputAt(pressMs + 1000, pin, HIGH);
+    }
+
+    void runRing(int index)
+    {
+        std::uniform_int_distribution<int> gapMs(500, 2500);
+        const uint32_t pressMs = sim::clock().nowMs() + gapMs(rng);
+        // The rings go round all inputs.
+        const RingInputConfig& ringInput = RingInputs[index % NumRingInputs];
+        ringTopic = std::string("doorRing/") + ringInput.name;
+        ringPublishedUs = 0;
+        scheduleRingPress(pressMs, ringInput.pin);
+
+        // WiFi drops shortly before the ring, the ring is published right after the outage (it is live, no settle time).
+        const bool wifiOutage = options.wifiOutageEvery > 0 && index % options.wifiOutageEvery == options.wifiOutageEvery - 1;
+        uint32_t ringTimeoutMs = 3000;
+        if (wifiOutage) {
+            const uint32_t outageStartMs = pressMs - 500;
+            sim::clock().schedule(uint64_t(outageStartMs) * 1000, []() { sim::wifi().available = false; });
+            sim::clock().schedule(uint64_t(outageStartMs + options.wifiOutageMs) * 1000, []() { sim::wifi().available = true; });
+            ringTimeoutMs += options.wifiOutageMs + WifiRetryMaxMs;
+        }
+
+        // The upstream broker is down while the ring is forwarded, the bridge keeps it queued.
+        if (options.upstreamOutageEvery > 0 && index % options.upstreamOutageEvery == options.upstreamOutageEvery - 1) {
+            const uint32_t outageStartMs = pressMs - 200;
+            sim::clock().schedule(uint64_t(outageStartMs) * 1000, []() { sim::mqttBus(UpstreamHost).setRunning(false); });
+            sim::clock().schedule(uint64_t(outageStartMs + options.upstreamOutageMs) * 1000,
+                                  []() { sim::mqttBus(UpstreamHost).setRunning(true); });
+        }
+
+        while (ringPublishedUs == 0 && sim::clock().nowMs() < pressMs + ringTimeoutMs) {
+            runLoopsUntil(sim::clock().nowMs() + MainLoopSampleTimeMs);
+        }
+        if (ringPublishedUs == 0) {
+            ++missedRings;
+        } else {
+            (wifiOutage ? outageRingLatency : ringLatency).add((ringPublishedUs - uint64_t(pressMs) * 1000) / 1000.0);
+            edgeStampError.add(double(ringStampedEdgeMs) - pressMs);
+            checkRingFanOut();
+        }
+
+        auto& bus = sim::mqttBus("localhost");
+        if (options.buzzEvery > 0 && index % options.buzzEvery == 0) bus.publish("cmd", "buzz");
+        bus.publish("cmd", std::string("ackRing ") + ringInput.name);
+
+        if (options.brokerCrashEvery > 0 && index % options.brokerCrashEvery == options.brokerCrashEvery - 1) {
+            // The embedded broker dies and drops all connections.
+            bus.setRunning(false);
+            brokerCrashedUs = sim::clock().nowUs();
+        }
+
+        // Wait until both relays are idle again
+        runLoopsUntil(sim::clock().nowMs() + DoorOpenMs + ExtBellMs + 5 * MainLoopSampleTimeMs);
+    }
+
+    int report(double wallSec)
+    {
+        printf("Simulated %d rings, %.1f s virtual time in %.2f s wall time (%.0f rings/s)\n",
+               options.numRings,
+               sim::clock().nowMs() / 1000.0,
+               wallSec,
+               options.numRings / std::max(wallSec, 1e-9));
+        printf("%-28s %.0f ms\n", "boot to first pong", pongUs / 1000.0);
+        printf("%-28s %d\n", "missed rings", missedRings);
+        printf("%-28s %d\n", "relay overlaps", relayOverlaps);
+        ringLatency.print("ring-to-publish latency", "ms");
+        edgeStampError.print("edge timestamp error", "ms");
+        printf("%-28s %d\n", "ring timestamp errors", ringStampErrors);
+        extBellError.print("ext bell pulse error", "ms");
+        buzzerError.print("door buzzer pulse error", "ms");
+        if (options.brokerCrashEvery > 0) mqttRecovery.print("MQTT recovery time", "ms");
+        if (options.wifiOutageEvery > 0) outageRingLatency.print("latency with WiFi outage", "ms");
+        // The broker has to accept at least the target number of clients and subscribers up to its limit
+        // (the local client is one of them), without eating into the heap reserve.
+        const int maxSubscribers = sim::mqttBus("localhost").getMaxNumClients() - 1;
+        const int expectedSubscribers = std::min(options.numSubscribers, maxSubscribers);
+        const bool fanOutOk = options.numSubscribers == 0
+                              || (maxSubscribers + 1 >= TargetNumClients && static_cast<int>(subscriberIds.size()) == expectedSubscribers
+                                  && freeHeapWithSubscribers >= HeapReserve
+                                  && undeliveredRings == 0);
+        if (options.numSubscribers > 0) {
+            printf("%-28s %zu of %d (limit %d, target %d), free heap %u bytes\n", "subscribers connected", subscriberIds.size(),
+                   options.numSubscribers, maxSubscribers, TargetNumClients - 1, freeHeapWithSubscribers);
+            printf("%-28s %d\n", "rings not fanned out", undeliveredRings);
+        }
+        if (options.upstream) {
+            printf("%-28s %d of %d, %d gaps, %d duplicates dropped\n", "upstream rings", upstreamRings, options.numRings, upstreamGaps,
+                   upstreamDuplicates);
+            printf("%-28s %d of 1 answered, %d of 3 rejected\n", "upstream commands", upstreamAllowed, upstreamRejected);
+        }
+
+        const bool relaysOk = extBellError.percentile(100) <= options.relayToleranceMs
+                              && buzzerError.percentile(100) <= options.relayToleranceMs;
+        const bool upstreamOk = !options.upstream
+                                || (upstreamRings == options.numRings && (upstreamGaps == 0 || options.upstreamLossEvery > 0)
+                                    && upstreamAllowed == 1 && upstreamRejected == 3);
+        return missedRings == 0 && relayOverlaps == 0 && ringStampErrors == 0 && relaysOk && upstreamOk && fanOutOk ? 0 : 1;
+    }
+
+    App& app;
+    const Options options;
+    std::mt19937 rng;
+    uint64_t loopCount = 0;
+
+    std::string ringTopic;
+    uint64_t ringPublishedUs = 0;
+    uint64_t buzzerOnSinceUs = 0;
+    uint64_t extBellOnSinceUs = 0;
+    uint64_t brokerCrashedUs = 0;
+    uint64_t pongUs = 0;
+    int missedRings = 0;
+    int relayOverlaps = 0;
+    Stats ringLatency;
+    Stats extBellError;
+    Stats buzzerError;
+    Stats mqttRecovery;
+    Stats outageRingLatency;
+    Stats edgeStampError;
+    unsigned long ringStampedEdgeMs = 0;
+    int ringStampErrors = 0;
+    std::set<unsigned long> upstreamSeqs;
+    unsigned long upstreamLastSeq = 0;
+    int upstreamRings = 0;
+    int upstreamGaps = 0;
+    int upstreamDuplicates = 0;
+    int upstreamAllowed = 0;
+    int upstreamRejected = 0;
+    std::vector<int> subscriberIds;
+    uint32_t freeHeapWithSubscribers = 0;
+    int undeliveredRings = 0;
+};
+
+Options parseOptions(int argc, char* argv[])
+{
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const auto next = [&]() { return i + 1 < argc ? std::stol(argv[++i]) : 0L; };
+        if (arg == "--rings") options.numRings = next();
+        else if (arg == "--buzz-every") options.buzzEvery = next();
+        else if (arg == "--seed") options.seed = next();
+        else if (arg == "--stall-ms") options.stallMs = next();
+        else if (arg == "--stall-every") options.stallEvery = next();
+        else if (arg == "--relay-tolerance-ms") options.relayToleranceMs = next();
+        else if (arg == "--broker-crash-every") options.brokerCrashEvery = next();
+        else if (arg == "--wifi-outage-every") options.wifiOutageEvery = next();
+        else if (arg == "--wifi-outage-ms") options.wifiOutageMs = next();
+        else if (arg == "--subscribers") options.numSubscribers = next();
+        else if (arg == "--upstream") options.upstream = true;
+        else if (arg == "--upstream-outage-every") options.upstreamOutageEvery = next();
+        else if (arg == "--upstream-outage-ms") options.upstreamOutageMs = next();
+        else if (arg == "--upstream-loss-every") options.upstreamLossEvery = next();
+        else if (arg == "--verbose") options.verbose = true;
+        else {
+            printf("Usage: broker-sim [--rings N] [--buzz-every N] [--seed N] [--stall-ms MS --stall-every N]\n"
+                   "                  [--relay-tolerance-ms MS] [--broker-crash-every N]\n"
+                   "                  [--wifi-outage-every N --wifi-outage-ms MS] [--subscribers N]\n"
+                   "                  [--upstream [--upstream-outage-every N --upstream-outage-ms MS] [--upstream-loss-every N]]\n"
+                   "                  [--verbose]\n");
+            exit(2);
+        }
+    }
+    return options;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const Options options = parseOptions(argc, argv);
+    sim::device().verbose = options.verbose;
+
+    static App app;
+    try {
+        return RingScenario(app, options).run();
+    } catch (const sim::RestartException&) {
+        printf("Firmware requested a restart at %u ms (virtual time)\n", sim::clock().nowMs());
+        return 1;
+    }
+}
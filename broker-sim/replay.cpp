@@ -0,0 +1,199 @@
+// Replay of recorded ring input traces through the debounce logic and the firmware.
+// Reports detection latency, missed and phantom rings per debounce configuration.
+
+#include "app.h"
+#include "debouncedSwitch.h"
+#include "gpioConfig.h"
+#include "sim.h"
+#include "timing.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Options
+{
+    std::vector<std::string> files;
+    std::vector<int> debounceCycles = {1, 2, 3, 4, 5, 6, 8, 10};
+    uint32_t minRingMs = 300;
+    uint32_t maxLatencyMs = 3000;
+    bool firmware = true;
+};
+
+struct Evaluation
+{
+    int rings = 0;
+    int detected = 0;
+    int missed = 0;
+    int phantom = 0;
+    std::vector<uint32_t> latenciesMs;
+
+    // Match detections to reference rings: the first detection within maxLatencyMs after a ring start.
+    void add(const std::vector<uint32_t>& referenceRings, const std::vector<uint32_t>& detections, uint32_t maxLatencyMs)
+    {
+        std::vector<bool> ringMatched(referenceRings.size(), false);
+        rings += referenceRings.size();
+        detected += detections.size();
+
+        for (const uint32_t detectionMs : detections) {
+            bool matched = false;
+            for (size_t i = 0; i < referenceRings.size(); ++i) {
+                if (!ringMatched[i] && detectionMs >= referenceRings[i] && detectionMs - referenceRings[i] <= maxLatencyMs) {
+                    ringMatched[i] = true;
+                    latenciesMs.push_back(detectionMs - referenceRings[i]);
+                    matched = true;
+                    break;
+                }
+            }
+            if (!matched) ++phantom;
+        }
+        missed += std::count(ringMatched.begin(), ringMatched.end(), false);
+    }
+
+    uint32_t percentile(double p)
+    {
+        if (latenciesMs.empty()) return 0;
+        std::sort(latenciesMs.begin(), latenciesMs.end());
+        return latenciesMs[std::min(latenciesMs.size() - 1, static_cast<size_t>(p / 100.0 * latenciesMs.size()))];
+    }
+
+    void print(const std::string& name)
+    {
+        printf("%-24s %7d %9d %7d %8d %8u %8u %8u\n",
+               name.c_str(),
+               rings,
+               detected,
+               missed,
+               phantom,
+               percentile(50),
+               percentile(95),
+               percentile(100));
+    }
+};
+
+// Debounce only: a DebouncedSwitch sampled once per period, like in the main loop.
+template<typename DebouncePolicy>
+std::vector<uint32_t> replayDebounce(const sim::InputTrace& trace, int debounceCycles)
+{
+    DebouncedSwitch<DebouncePolicy> inputSwitch(RingInputs[0].pin, debounceCycles);
+    std::vector<uint32_t> detections;
+    for (uint32_t tsMs = 0; tsMs < trace.durationMs; tsMs += trace.periodMs) {
+        // Inputs are grounded: pressed is LOW
+        sim::gpio().setInput(RingInputs[0].pin, trace.isPressedAt(tsMs) ? LOW : HIGH);
+        if (inputSwitch.checkRaise()) detections.push_back(tsMs);
+    }
+    return detections;
+}
+
+// Complete firmware: the trace drives the ring input, detections are the published ring messages.
+class FirmwareReplay final
+{
+public:
+    FirmwareReplay()
+    {
+        sim::mqttBus("localhost").addObserver("doorRing/#", [this](const sim::MqttMessage& message) {
+            if (message.payload.rfind("ring", 0) == 0) ringPublishedMs.push_back(message.tsUs / 1000);
+        });
+        app.setup();
+    }
+
+    std::vector<uint32_t> replay(const sim::InputTrace& trace)
+    {
+        const uint32_t startMs = sim::clock().nowMs() + MainLoopSampleTimeMs;
+        for (const auto& edge : trace.edges) {
+            sim::gpio().setInputAt(startMs + edge.tsMs, RingInputs[0].pin, edge.pressed ? LOW : HIGH);
+        }
+
+        ringPublishedMs.clear();
+        while (sim::clock().nowMs() < startMs + trace.durationMs) app.loop();
+
+        // Acknowledge and let the relays finish, so the next trace starts idle.
+        sim::mqttBus("localhost").publish("cmd", "ackRing");
+        const uint32_t idleMs = sim::clock().nowMs() + DoorOpenMs + ExtBellMs + 5 * MainLoopSampleTimeMs;
+        while (sim::clock().nowMs() < idleMs) app.loop();
+
+        std::vector<uint32_t> detections;
+        for (const uint32_t publishedMs : ringPublishedMs) detections.push_back(publishedMs - startMs);
+        return detections;
+    }
+
+private:
+    App app;
+    std::vector<uint32_t> ringPublishedMs;
+};
+
+std::vector<int> parseList(const std::string& str)
+{
+    std::vector<int> values;
+    std::stringstream in(str);
+    for (std::string item; std::getline(in, item, ',');) values.push_back(std::stoi(item));
+    return values;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--debounce" && i + 1 < argc) options.debounceCycles = parseList(argv[++i]);
+        else if (arg == "--min-ring-ms" && i + 1 < argc) options.minRingMs = std::stoul(argv[++i]);
+        else if (arg == "--max-latency-ms" && i + 1 < argc) options.maxLatencyMs = std::stoul(argv[++i]);
+        else if (arg == "--no-firmware") options.firmware = false;
+        else if (arg.rfind("--", 0) == 0) {
+            printf("Usage: broker-replay [--debounce 1,2,5] [--min-ring-ms MS] [--max-latency-ms MS] [--no-firmware] TRACE...\n");
+            return 2;
+        } else options.files.push_back(arg);
+    }
+
+    std::vector<sim::InputTrace> traces;
+    for (const auto& file : options.files) {
+        auto loaded = sim::loadTraces(file);
+        if (loaded.empty()) printf("No trace data in %s\n", file.c_str());
+        traces.insert(traces.end(), loaded.begin(), loaded.end());
+    }
+    if (traces.empty()) return 2;
+
+    uint64_t totalMs = 0;
+    for (const auto& trace : traces) totalMs += trace.durationMs;
+    printf("Replaying %zu traces, %.1f h of input\n", traces.size(), totalMs / 3600000.0);
+
+    const auto wallStart = std::chrono::steady_clock::now();
+    printf("%-24s %7s %9s %7s %8s %8s %8s %8s\n", "config", "rings", "detected", "missed", "phantom", "p50[ms]", "p95[ms]", "max[ms]");
+
+    for (const int cycles : options.debounceCycles) {
+        Evaluation evaluation;
+        for (const auto& trace : traces) {
+            evaluation.add(trace.getReferenceRings(options.minRingMs), replayDebounce<CounterDebounce>(trace, cycles), options.maxLatencyMs);
+        }
+        evaluation.print("debounce " + std::to_string(cycles) + " cycles");
+    }
+
+    for (const int cycles : options.debounceCycles) {
+        Evaluation evaluation;
+        for (const auto& trace : traces) {
+            evaluation.add(trace.getReferenceRings(options.minRingMs), replayDebounce<IntegratorDebounce>(trace, cycles), options.maxLatencyMs);
+        }
+        evaluation.print("integrator " + std::to_string(cycles) + " cycles");
+    }
+
+    if (options.firmware) {
+        FirmwareReplay firmware;
+        Evaluation evaluation;
+        for (const auto& trace : traces) {
+            evaluation.add(trace.getReferenceRings(options.minRingMs), firmware.replay(trace), options.maxLatencyMs);
+        }
+        evaluation.print("firmware (" + std::to_string(InputDebounceMs) + " ms)");
+    }
+
+    const double wallSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    printf("Replay took %.2f s\n", wallSec);
+    return 0;
+}
@@ -0,0 +1,297 @@
+#include "sim.h"
+
+#include <Arduino.h>
+
+namespace sim {
+
+uint64_t Clock::nowUs() const
+{
+    return currentUs;
+}
+
+uint32_t Clock::nowMs() const
+{
+    return static_cast<uint32_t>(currentUs / 1000);
+}
+
+void Clock::advanceUs(uint64_t us)
+{
+    const uint64_t targetUs = currentUs + us;
+    while (!events.empty() && events.top().atUs <= targetUs) {
+        Event event = events.top();
+        events.pop();
+        currentUs = std::max(currentUs, event.atUs);
+        event.fn();
+    }
+    currentUs = targetUs;
+}
+
+void Clock::schedule(uint64_t atUs, std::function<void()> event)
+{
+    events.push(Event{atUs, nextSeq++, std::move(event)});
+}
+
+void Clock::scheduleInMs(uint32_t inMs, std::function<void()> event)
+{
+    schedule(currentUs + uint64_t(inMs) * 1000, std::move(event));
+}
+
+Clock& clock()
+{
+    static Clock clock;
+    return clock;
+}
+
+// --------------------------------------------------------------
+
+Gpio::Gpio()
+{
+    // All switches and inputs have pull ups: not pressed is HIGH.
+    for (int& input : inputs) input = HIGH;
+}
+
+void Gpio::setMode(int pin, int mode)
+{
+    if (pin >= 0 && pin < NumPins) modes[pin] = mode;
+}
+
+void Gpio::write(int pin, int level)
+{
+    if (pin < 0 || pin >= NumPins || outputs[pin] == level) return;
+    outputs[pin] = level;
+    for (auto& listener : listeners) listener(pin, level, clock().nowUs());
+}
+
+int Gpio::read(int pin) const
+{
+    return pin >= 0 && pin < NumPins ? inputs[pin] : LOW;
+}
+
+void Gpio::setInput(int pin, int level)
+{
+    if (pin < 0 || pin >= NumPins || inputs[pin] == level) return;
+    inputs[pin] = level;
+    if (interrupts[pin].handler) interrupts[pin].handler(interrupts[pin].arg);
+}
+
+void Gpio::setInputAt(uint32_t atMs, int pin, int level)
+{
+    clock().schedule(uint64_t(atMs) * 1000, [this, pin, level]() { setInput(pin, level); });
+}
+
+int Gpio::getOutput(int pin) const
+{
+    return pin >= 0 && pin < NumPins ? outputs[pin] : LOW;
+}
+
+void Gpio::onOutputChange(OutputListener listener)
+{
+    listeners.push_back(std::move(listener));
+}
+
+void Gpio::attachInterrupt(int pin, void (*handler)(void*), void* arg)
+{
+    if (pin >= 0 && pin < NumPins) interrupts[pin] = Interrupt{handler, arg};
+}
+
+Gpio& gpio()
+{
+    static Gpio gpio;
+    return gpio;
+}
+
+// --------------------------------------------------------------
+
+void Wifi::begin(const std::string&, bool knownAccessPoint)
+{
+    connecting = available;
+    connected = false;
+    const uint32_t connectMs = (knownAccessPoint ? 0 : scanMs) + associateMs + (staticIp ? 0 : dhcpMs);
+    connectedAtUs = clock().nowUs() + uint64_t(connectMs) * 1000;
+}
+
+bool Wifi::isConnected() const
+{
+    return available && connecting && clock().nowUs() >= connectedAtUs;
+}
+
+void Wifi::drop()
+{
+    connecting = false;
+    connected = false;
+}
+
+Wifi& wifi()
+{
+    static Wifi wifi;
+    return wifi;
+}
+
+// --------------------------------------------------------------
+
+bool topicMatches(const std::string& filter, const std::string& topic)
+{
+    size_t f = 0;
+    size_t t = 0;
+    while (f < filter.size()) {
+        const size_t fEnd = std::min(filter.find('/', f), filter.size());
+        const std::string level = filter.substr(f, fEnd - f);
+        if (level == "#") return true;
+        if (t > topic.size()) return false;
+        const size_t tEnd = std::min(topic.find('/', t), topic.size());
+        if (level != "+" && level != topic.substr(t, tEnd - t)) return false;
+        f = fEnd + 1;
+        t = tEnd + 1;
+    }
+    return t > topic.size();
+}
+
+MqttBus::MqttBus(const std::string& host)
+    : host(host)
+{}
+
+bool MqttBus::isReachable() const
+{
+    // The local broker runs on the device itself, remote brokers need WiFi.
+    return running && (host == "localhost" || wifi().isConnected());
+}
+
+void MqttBus::setRunning(bool newRunning)
+{
+    if (running && !newRunning) {
+        // Stopping the broker drops all connections.
+        ++generation;
+        clientConnectedUs.clear();
+    }
+    running = newRunning;
+}
+
+uint32_t MqttBus::getGeneration() const
+{
+    return generation;
+}
+
+void MqttBus::setMaxNumClients(int numClients)
+{
+    maxNumClients = numClients;
+}
+
+int MqttBus::getMaxNumClients() const
+{
+    return maxNumClients;
+}
+
+void MqttBus::setCredentials(const std::string& newUser, const std::string& newPassword)
+{
+    user = newUser;
+    password = newPassword;
+}
+
+bool MqttBus::connectClient(const char* clientUser, const char* clientPassword)
+{
+    if (!isReachable() || getNumClients() >= maxNumClients) return false;
+    if (!user.empty() && (!clientUser || !clientPassword || user != clientUser || password != clientPassword)) return false;
+    clientConnectedUs.push_back(clock().nowUs());
+    return true;
+}
+
+void MqttBus::disconnectClient()
+{
+    if (!clientConnectedUs.empty()) clientConnectedUs.pop_back();
+}
+
+int MqttBus::getNumClients() const
+{
+    return static_cast<int>(clientConnectedUs.size());
+}
+
+int MqttBus::getNumSessions() const
+{
+    const uint64_t nowUs = clock().nowUs();
+    return static_cast<int>(std::count_if(clientConnectedUs.begin(), clientConnectedUs.end(), [nowUs](uint64_t connectedUs) {
+        return nowUs - connectedUs >= Device::SessionSetupUs;
+    }));
+}
+
+int MqttBus::addSubscriber()
+{
+    const int id = nextSubscriberId++;
+    subscribers[id];
+    return id;
+}
+
+void MqttBus::removeSubscriber(int id)
+{
+    subscribers.erase(id);
+}
+
+void MqttBus::subscribe(int id, const std::string& filter)
+{
+    subscribers[id].filters.push_back(filter);
+}
+
+bool MqttBus::takeMessage(int id, MqttMessage& message)
+{
+    auto it = subscribers.find(id);
+    if (it == subscribers.end() || it->second.inbox.empty()) return false;
+    message = it->second.inbox.front();
+    it->second.inbox.pop();
+    return true;
+}
+
+void MqttBus::publish(const std::string& topic, const std::string& payload)
+{
+    const MqttMessage message{topic, payload, clock().nowUs()};
+    ++numPublished;
+
+    for (auto& [id, subscriber] : subscribers) {
+        for (const auto& filter : subscriber.filters) {
+            if (topicMatches(filter, topic)) {
+                subscriber.inbox.push(message);
+                break;
+            }
+        }
+    }
+
+    for (auto& [filter, observer] : observers) {
+        if (topicMatches(filter, topic)) observer(message);
+    }
+}
+
+void MqttBus::publishFromClient(const std::string& topic, const std::string& payload)
+{
+    if (lossEvery > 0 && ++numClientPublishes % lossEvery == 0) return;
+    publish(topic, payload);
+}
+
+void MqttBus::setLossEvery(int every)
+{
+    lossEvery = every;
+}
+
+void MqttBus::addObserver(const std::string& filter, Observer observer)
+{
+    observers.emplace_back(filter, std::move(observer));
+}
+
+uint64_t MqttBus::getNumPublished() const
+{
+    return numPublished;
+}
+
+MqttBus& mqttBus(const std::string& host)
+{
+    // Never destroyed, firmware clients still unsubscribe during static destruction.
+    static auto* buses = new std::map<std::string, MqttBus>();
+    return buses->try_emplace(host, host).first->second;
+}
+
+// --------------------------------------------------------------
+
+Device& device()
+{
+    static Device device;
+    return device;
+}
+
+} // namespace sim
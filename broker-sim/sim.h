@@ -0,0 +1,205 @@
+#pragma once
+
+// Simulated environment of the broker firmware: virtual clock, scriptable GPIO,
+// WiFi and MQTT bus. The Arduino stand-ins in stubs/ are implemented on top of it.
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <queue>
+#include <string>
+#include <vector>
+
+namespace sim {
+
+// --------------------------------------------------------------
+
+// Virtual clock, only advanced by delay() or explicitly by the scenario.
+class Clock final
+{
+public:
+    uint64_t nowUs() const;
+    uint32_t nowMs() const;
+
+    void advanceUs(uint64_t us);
+    void schedule(uint64_t atUs, std::function<void()> event);
+    void scheduleInMs(uint32_t inMs, std::function<void()> event);
+
+private:
+    struct Event
+    {
+        uint64_t atUs;
+        uint64_t seq;
+        std::function<void()> fn;
+        bool operator>(const Event& other) const
+        {
+            return atUs != other.atUs ? atUs > other.atUs : seq > other.seq;
+        }
+    };
+
+    uint64_t currentUs = 0;
+    uint64_t nextSeq = 0;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+};
+
+Clock& clock();
+
+// --------------------------------------------------------------
+
+// Scriptable GPIO: inputs are set by the scenario, outputs can be observed.
+class Gpio final
+{
+public:
+    static constexpr int NumPins = 64;
+    using OutputListener = std::function<void(int pin, int level, uint64_t tsUs)>;
+
+    void setMode(int pin, int mode);
+    void write(int pin, int level);
+    int read(int pin) const;
+
+    void setInput(int pin, int level);
+    void setInputAt(uint32_t atMs, int pin, int level);
+    int getOutput(int pin) const;
+    void onOutputChange(OutputListener listener);
+
+    // Interrupt on both edges of an input, it runs when the input is set (also during a stall).
+    void attachInterrupt(int pin, void (*handler)(void*), void* arg);
+
+private:
+    struct Interrupt
+    {
+        void (*handler)(void*) = nullptr;
+        void* arg = nullptr;
+    };
+
+    int modes[NumPins] = {};
+    int inputs[NumPins] = {};
+    int outputs[NumPins] = {};
+    Interrupt interrupts[NumPins];
+    std::vector<OutputListener> listeners;
+
+public:
+    Gpio();
+};
+
+Gpio& gpio();
+
+// --------------------------------------------------------------
+
+class Wifi final
+{
+public:
+    bool available = true;
+    bool staticIp = false;
+
+    // Connection phases: scan (skipped with known channel and BSSID), association, DHCP (skipped with static IP)
+    uint32_t scanMs = 1500;
+    uint32_t associateMs = 300;
+    uint32_t dhcpMs = 800;
+
+    void begin(const std::string& ssid, bool knownAccessPoint = false);
+    bool isConnected() const;
+    void drop();
+
+private:
+    bool connecting = false;
+    bool connected = false;
+    uint64_t connectedAtUs = 0;
+};
+
+Wifi& wifi();
+
+// --------------------------------------------------------------
+
+struct MqttMessage
+{
+    std::string topic;
+    std::string payload;
+    uint64_t tsUs = 0;
+};
+
+bool topicMatches(const std::string& filter, const std::string& topic);
+
+// Messages of one broker host. Firmware clients receive messages in their loop(),
+// observers of the scenario synchronously when published.
+class MqttBus final
+{
+public:
+    using Observer = std::function<void(const MqttMessage&)>;
+
+    explicit MqttBus(const std::string& host);
+
+    bool isReachable() const;
+    void setRunning(bool running);
+    uint32_t getGeneration() const;
+    void setMaxNumClients(int numClients);
+    int getMaxNumClients() const;
+
+    // Without credentials set, clients connect anonymously.
+    void setCredentials(const std::string& user, const std::string& password);
+    bool connectClient(const char* user = nullptr, const char* password = nullptr);
+    void disconnectClient();
+    int getNumClients() const;
+    int getNumSessions() const; // clients whose session the broker has set up
+
+    int addSubscriber();
+    void removeSubscriber(int id);
+    void subscribe(int id, const std::string& filter);
+    bool takeMessage(int id, MqttMessage& message);
+
+    void publish(const std::string& topic, const std::string& payload);
+    // Publish of a PubSubClient (QoS 0), every lossEvery-th one is lost on the way
+    void publishFromClient(const std::string& topic, const std::string& payload);
+    void setLossEvery(int every);
+    void addObserver(const std::string& filter, Observer observer);
+
+    uint64_t getNumPublished() const;
+
+private:
+    struct Subscriber
+    {
+        std::vector<std::string> filters;
+        std::queue<MqttMessage> inbox;
+    };
+
+    const std::string host;
+    bool running = false;
+    uint32_t generation = 0;
+    int maxNumClients = 9;
+    std::string user;
+    std::string password;
+    int lossEvery = 0;
+    uint64_t numClientPublishes = 0;
+    std::vector<uint64_t> clientConnectedUs;
+    int nextSubscriberId = 0;
+    uint64_t numPublished = 0;
+    std::map<int, Subscriber> subscribers;
+    std::vector<std::pair<std::string, Observer>> observers;
+};
+
+MqttBus& mqttBus(const std::string& host);
+
+// --------------------------------------------------------------
+
+struct Device
+{
+    // Free heap of an ESP32 without PSRAM once WiFi is up
+    static constexpr uint32_t HeapSize = 200 * 1024;
+    // Heap of a broker client: the socket is taken on the connect, the session (task, buffers)
+    // is set up by the broker task a little later.
+    static constexpr uint32_t ClientConnectHeap = 1024;
+    static constexpr uint32_t ClientSessionHeap = 4 * 1024;
+    static constexpr uint32_t SessionSetupUs = 5000;
+
+    bool verbose = false;
+    bool restartRequested = false;
+    int resetReason = 1; // ESP_RST_POWERON
+};
+
+Device& device();
+
+// Thrown by ESP.restart(), the scenario decides how to continue.
+struct RestartException
+{};
+
+} // namespace sim
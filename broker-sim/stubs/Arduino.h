@@ -0,0 +1,100 @@
+#pragma once
+
+// Stand-in for the Arduino core, used by the host simulation of the broker.
+// Time is virtual: delay() advances the simulated clock and runs scheduled events.
+
+#include "WString.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+
+#include <esp_system.h>
+#include <sdkconfig.h>
+
+using byte = uint8_t;
+using std::max;
+using std::min;
+
+#define HIGH         0x1
+#define LOW          0x0
+#define INPUT        0x01
+#define OUTPUT       0x03
+#define INPUT_PULLUP 0x05
+#define LED_BUILTIN  13
+#define CHANGE       0x03
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+void attachInterruptArg(uint8_t pin, void (*userFunc)(void*), void* arg, int mode); // CHANGE only
+
+// Time of the C library: time() returns the simulated time, a fixed date once SNTP is synced (see esp_sntp.h).
+void configTzTime(const char* tz, const char* server1, const char* server2 = nullptr, const char* server3 = nullptr);
+
+// LEDC: the simulated pin is HIGH for a duty > 0, fades switch at their end.
+bool ledcAttach(uint8_t pin, uint32_t freq, uint8_t resolution);
+bool ledcWrite(uint8_t pin, uint32_t duty);
+bool ledcFade(uint8_t pin, uint32_t start_duty, uint32_t target_duty, int max_fade_time_ms);
+
+// FreeRTOS critical sections, the simulation is single-threaded.
+struct portMUX_TYPE
+{};
+#define portMUX_INITIALIZER_UNLOCKED {}
+#define portENTER_CRITICAL(mux) ((void) (mux))
+#define portEXIT_CRITICAL(mux)  ((void) (mux))
+
+class HardwareSerial
+{
+public:
+    void begin(unsigned long baud);
+
+    template<typename T>
+    void print(const T& value)
+    {
+        if (enabled()) std::cout << value;
+    }
+    void print(uint8_t value)
+    {
+        print(static_cast<int>(value));
+    }
+
+    template<typename T>
+    void println(const T& value)
+    {
+        if (enabled()) std::cout << value << std::endl;
+    }
+    void println(uint8_t value)
+    {
+        println(static_cast<int>(value));
+    }
+    void println()
+    {
+        if (enabled()) std::cout << std::endl;
+    }
+
+private:
+    bool enabled() const;
+};
+
+extern HardwareSerial Serial;
+
+class EspClass
+{
+public:
+    [[noreturn]] void restart();
+    uint32_t getFreeHeap();
+};
+
+extern EspClass ESP;
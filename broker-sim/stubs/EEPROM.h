@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+class EEPROMClass
+{
+public:
+    bool begin(size_t size);
+    uint8_t read(int address);
+    void write(int address, uint8_t value);
+    bool commit();
+
+private:
+    uint8_t data[512] = {};
+    size_t size = 0;
+};
+
+extern EEPROMClass EEPROM;
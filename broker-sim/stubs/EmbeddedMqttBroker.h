@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+
+namespace mqttBrokerName {
+
+// Stand-in for the embedded broker, it starts/stops the simulated "localhost" MQTT bus.
+class MqttBroker
+{
+public:
+    explicit MqttBroker(uint16_t port = 1883);
+
+    void setMaxNumClients(int numClients);
+    void startBroker();
+    void stopBroker();
+
+private:
+    int maxNumClients = 9;
+};
+
+} // namespace mqttBrokerName
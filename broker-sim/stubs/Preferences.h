@@ -0,0 +1,29 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <cstddef>
+#include <cstdint>
+
+// Stand-in for the NVS backed Preferences, kept in memory for the lifetime of the process.
+class Preferences
+{
+public:
+    bool begin(const char* name, bool readOnly = false);
+    void end();
+
+    size_t putInt(const char* key, int32_t value);
+    int32_t getInt(const char* key, int32_t defaultValue = 0);
+    size_t putString(const char* key, const String& value);
+    String getString(const char* key, const String& defaultValue = String());
+    size_t putBytes(const char* key, const void* value, size_t len);
+    size_t getBytes(const char* key, void* buf, size_t maxLen);
+    size_t getBytesLength(const char* key);
+    bool isKey(const char* key);
+    bool remove(const char* key);
+
+private:
+    std::string space;
+    bool readOnly = false;
+    bool opened = false;
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+#include <functional>
+#include <string>
+
+#define MQTT_CALLBACK_SIGNATURE std::function<void(char*, uint8_t*, unsigned int)> callback
+
+namespace sim {
+class MqttBus;
+}
+
+// Stand-in for PubSubClient, connected to the simulated MQTT bus of the server host.
+class PubSubClient
+{
+public:
+    explicit PubSubClient(Client& client);
+    ~PubSubClient();
+
+    PubSubClient& setClient(Client& client);
+    PubSubClient& setServer(const char* domain, uint16_t port);
+    PubSubClient& setServer(IPAddress ip, uint16_t port);
+    PubSubClient& setSocketTimeout(uint16_t timeout);
+    PubSubClient& setCallback(MQTT_CALLBACK_SIGNATURE);
+    bool setBufferSize(uint16_t size);
+
+    bool connect(const char* id);
+    bool connect(const char* id, const char* user, const char* password);
+    void disconnect();
+    bool connected();
+    int state();
+
+    bool subscribe(const char* topic);
+    bool publish(const char* topic, const char* payload);
+    bool loop();
+
+private:
+    sim::MqttBus* bus = nullptr;
+    std::function<void(char*, uint8_t*, unsigned int)> callback;
+    int subscriberId = -1;
+    uint32_t connectedGeneration = 0;
+    bool isConnected = false;
+    uint16_t bufferSize = 256;
+};
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstdlib>
+#include <ostream>
+#include <string>
+
+// Subset of the Arduino String, backed by std::string.
+class String
+{
+public:
+    String() = default;
+    String(const char* str)
+        : str(str ? str : "")
+    {}
+    String(const std::string& str)
+        : str(str)
+    {}
+    explicit String(char c)
+        : str(1, c)
+    {}
+    explicit String(int value)
+        : str(std::to_string(value))
+    {}
+    explicit String(unsigned int value)
+        : str(std::to_string(value))
+    {}
+    explicit String(long value)
+        : str(std::to_string(value))
+    {}
+    explicit String(unsigned long value)
+        : str(std::to_string(value))
+    {}
+    explicit String(long long value)
+        : str(std::to_string(value))
+    {}
+    explicit String(unsigned long long value)
+        : str(std::to_string(value))
+    {}
+    explicit String(float value, unsigned int decimals = 2)
+        : String(static_cast<double>(value), decimals)
+    {}
+    explicit String(double value, unsigned int decimals = 2)
+    {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.*f", decimals, value);
+        str = buf;
+    }
+
+    const char* c_str() const
+    {
+        return str.c_str();
+    }
+    unsigned int length() const
+    {
+        return str.length();
+    }
+    bool isEmpty() const
+    {
+        return str.empty();
+    }
+    char operator[](unsigned int index) const
+    {
+        return index < str.length() ? str[index] : '\0';
+    }
+    char charAt(unsigned int index) const
+    {
+        return (*this)[index];
+    }
+
+    int indexOf(char c, unsigned int from = 0) const
+    {
+        const auto pos = str.find(c, from);
+        return pos == std::string::npos ? -1 : static_cast<int>(pos);
+    }
+    int indexOf(const String& s, unsigned int from = 0) const
+    {
+        const auto pos = str.find(s.str, from);
+        return pos == std::string::npos ? -1 : static_cast<int>(pos);
+    }
+    String substring(unsigned int from) const
+    {
+        return from < str.length() ? String(str.substr(from)) : String();
+    }
+    String substring(unsigned int from, unsigned int to) const
+    {
+        if (from > to) std::swap(from, to);
+        return from < str.length() ? String(str.substr(from, to - from)) : String();
+    }
+    bool startsWith(const String& prefix) const
+    {
+        return str.compare(0, prefix.str.length(), prefix.str) == 0;
+    }
+    bool endsWith(const String& suffix) const
+    {
+        return str.length() >= suffix.str.length() && str.compare(str.length() - suffix.str.length(), std::string::npos, suffix.str) == 0;
+    }
+    void trim()
+    {
+        const auto first = str.find_first_not_of(" \t\r\n");
+        const auto last = str.find_last_not_of(" \t\r\n");
+        str = first == std::string::npos ? std::string() : str.substr(first, last - first + 1);
+    }
+    long toInt() const
+    {
+        return std::strtol(str.c_str(), nullptr, 10);
+    }
+    void reserve(unsigned int size)
+    {
+        str.reserve(size);
+    }
+
+    String& operator+=(const String& other)
+    {
+        str += other.str;
+        return *this;
+    }
+    String& operator+=(const char* other)
+    {
+        str += other;
+        return *this;
+    }
+    String& operator+=(char c)
+    {
+        str += c;
+        return *this;
+    }
+
+    friend String operator+(const String& lhs, const String& rhs)
+    {
+        return String(lhs.str + rhs.str);
+    }
+    friend String operator+(const String& lhs, const char* rhs)
+    {
+        return String(lhs.str + rhs);
+    }
+    friend String operator+(const char* lhs, const String& rhs)
+    {
+        return String(lhs + rhs.str);
+    }
+    friend String operator+(const String& lhs, char rhs)
+    {
+        return String(lhs.str + rhs);
+    }
+
+    friend bool operator==(const String& lhs, const String& rhs)
+    {
+        return lhs.str == rhs.str;
+    }
+    friend bool operator==(const String& lhs, const char* rhs)
+    {
+        return lhs.str == rhs;
+    }
+    friend bool operator!=(const String& lhs, const String& rhs)
+    {
+        return lhs.str != rhs.str;
+    }
+    friend bool operator!=(const String& lhs, const char* rhs)
+    {
+        return lhs.str != rhs;
+    }
+    friend bool operator<(const String& lhs, const String& rhs)
+    {
+        return lhs.str < rhs.str;
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, const String& s)
+    {
+        return os << s.str;
+    }
+
+private:
+    std::string str;
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <Arduino.h>
+
+typedef enum
+{
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6,
+} wl_status_t;
+
+class IPAddress
+{
+public:
+    IPAddress() = default;
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+        : bytes{a, b, c, d}
+    {}
+    explicit IPAddress(uint32_t address)
+    {
+        memcpy(bytes, &address, sizeof(bytes));
+    }
+
+    operator uint32_t() const
+    {
+        uint32_t address;
+        memcpy(&address, bytes, sizeof(address));
+        return address;
+    }
+
+    bool fromString(const String& address)
+    {
+        unsigned int a, b, c, d;
+        char rest;
+        if (sscanf(address.c_str(), "%u.%u.%u.%u%c", &a, &b, &c, &d, &rest) != 4 || a > 255 || b > 255 || c > 255 || d > 255) return false;
+        *this = IPAddress(a, b, c, d);
+        return true;
+    }
+
+    String toString() const
+    {
+        return String(int(bytes[0])) + "." + String(int(bytes[1])) + "." + String(int(bytes[2])) + "." + String(int(bytes[3]));
+    }
+    uint8_t operator[](int index) const
+    {
+        return bytes[index];
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, const IPAddress& ip)
+    {
+        return os << ip.toString();
+    }
+
+private:
+    uint8_t bytes[4] = {0, 0, 0, 0};
+};
+
+class WiFiClass
+{
+public:
+    wl_status_t begin(const char* ssid, const char* password, int32_t channel = 0, const uint8_t* bssid = nullptr);
+    bool config(IPAddress localIP, IPAddress gateway, IPAddress subnet, IPAddress dns1 = IPAddress());
+    wl_status_t status();
+    bool disconnect();
+    IPAddress localIP();
+    IPAddress gatewayIP();
+    IPAddress subnetMask();
+    IPAddress dnsIP();
+    int32_t channel();
+    uint8_t* BSSID();
+    int hostByName(const char* host, IPAddress& address);
+};
+
+extern WiFiClass WiFi;
+
+class Client
+{
+public:
+    virtual ~Client() = default;
+};
+
+class WiFiClient : public Client
+{
+public:
+    int setTimeout(uint32_t)
+    {
+        return 0;
+    }
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <WiFi.h>
+
+// Stand-in for the TLS client, the simulated upstream broker takes any certificate fingerprint.
+class WiFiClientSecure : public WiFiClient
+{
+public:
+    void setInsecure()
+    {}
+    int connect(IPAddress, uint16_t)
+    {
+        isConnected = true;
+        return 1;
+    }
+    bool verify(const char*, const char*)
+    {
+        return isConnected;
+    }
+    bool connected() const
+    {
+        return isConnected;
+    }
+    void stop()
+    {
+        isConnected = false;
+    }
+
+private:
+    bool isConnected = false;
+};
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "wifiConfig.h"
+
+#include <vector>
+
+inline std::vector<WifiConfig> getWifiConfigs()
+{
+    return {{"doorbell-sim", "secret"}};
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+// Host memory does not survive a reset, the simulation keeps RTC variables as plain globals.
+#define RTC_NOINIT_ATTR
+#define RTC_DATA_ATTR
+#define IRAM_ATTR
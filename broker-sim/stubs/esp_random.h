@@ -0,0 +1,6 @@
+#pragma once
+
+#include <cstdint>
+
+// Deterministic in the simulation
+uint32_t esp_random();
@@ -0,0 +1,12 @@
+#pragma once
+
+// SNTP client of lwIP: synced once configTzTime() was called and WiFi is connected.
+
+typedef enum
+{
+    SNTP_SYNC_STATUS_RESET,
+    SNTP_SYNC_STATUS_COMPLETED,
+    SNTP_SYNC_STATUS_IN_PROGRESS,
+} sntp_sync_status_t;
+
+sntp_sync_status_t sntp_get_sync_status();
@@ -0,0 +1,5 @@
+#pragma once
+
+// Build configuration of ESP-IDF. The simulation models a firmware built for 32+ broker clients,
+// the prebuilt Arduino core has 16 sockets.
+#define CONFIG_LWIP_MAX_SOCKETS 64
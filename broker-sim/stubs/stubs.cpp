@@ -0,0 +1,528 @@
+// Implementation of the Arduino and library stand-ins on top of the simulation.
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <EmbeddedMqttBroker.h>
+#include <Preferences.h>
+#include <PubSubClient.h>
+#include <WiFi.h>
+#include <esp_sntp.h>
+#include <esp_random.h>
+#include <esp_timer.h>
+
+#include "sim.h"
+
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+HardwareSerial Serial;
+EspClass ESP;
+WiFiClass WiFi;
+EEPROMClass EEPROM;
+
+// --------------------------------------------------------------
+// Arduino core
+
+unsigned long millis()
+{
+    return sim::clock().nowMs();
+}
+
+unsigned long micros()
+{
+    return static_cast<unsigned long>(sim::clock().nowUs());
+}
+
+void delay(unsigned long ms)
+{
+    sim::clock().advanceUs(uint64_t(ms) * 1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    sim::clock().advanceUs(us);
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    sim::gpio().setMode(pin, mode);
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+    sim::gpio().write(pin, val);
+}
+
+int digitalRead(uint8_t pin)
+{
+    return sim::gpio().read(pin);
+}
+
+void attachInterruptArg(uint8_t pin, void (*userFunc)(void*), void* arg, int)
+{
+    sim::gpio().attachInterrupt(pin, userFunc, arg);
+}
+
+bool ledcAttach(uint8_t pin, uint32_t, uint8_t)
+{
+    sim::gpio().setMode(pin, OUTPUT);
+    return true;
+}
+
+bool ledcWrite(uint8_t pin, uint32_t duty)
+{
+    sim::gpio().write(pin, duty > 0 ? HIGH : LOW);
+    return true;
+}
+
+bool ledcFade(uint8_t pin, uint32_t start_duty, uint32_t target_duty, int max_fade_time_ms)
+{
+    ledcWrite(pin, start_duty);
+    sim::clock().scheduleInMs(max_fade_time_ms, [pin, target_duty]() { ledcWrite(pin, target_duty); });
+    return true;
+}
+
+void HardwareSerial::begin(unsigned long)
+{}
+
+bool HardwareSerial::enabled() const
+{
+    return sim::device().verbose;
+}
+
+void EspClass::restart()
+{
+    sim::device().restartRequested = true;
+    throw sim::RestartException{};
+}
+
+uint32_t EspClass::getFreeHeap()
+{
+    const auto& bus = sim::mqttBus("localhost");
+    return sim::Device::HeapSize - bus.getNumClients() * sim::Device::ClientConnectHeap
+           - bus.getNumSessions() * sim::Device::ClientSessionHeap;
+}
+
+esp_reset_reason_t esp_reset_reason()
+{
+    return static_cast<esp_reset_reason_t>(sim::device().resetReason);
+}
+
+uint32_t esp_random()
+{
+    static uint32_t state = 0x12345678;
+    state = state * 1664525 + 1013904223;
+    return state;
+}
+
+// --------------------------------------------------------------
+// esp_timer
+
+struct esp_timer
+{
+    esp_timer_cb_t callback;
+    void* arg;
+    uint64_t generation = 0; // a stopped or restarted timer ignores its pending event
+};
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args, esp_timer_handle_t* out_handle)
+{
+    *out_handle = new esp_timer{create_args->callback, create_args->arg};
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    const uint64_t generation = ++timer->generation;
+    sim::clock().schedule(sim::clock().nowUs() + timeout_us, [timer, generation]() {
+        if (timer->generation == generation) timer->callback(timer->arg);
+    });
+    return ESP_OK;
+}
+
+static void scheduleTimerPeriod(esp_timer_handle_t timer, uint64_t generation, uint64_t periodUs)
+{
+    sim::clock().schedule(sim::clock().nowUs() + periodUs, [timer, generation, periodUs]() {
+        if (timer->generation != generation) return;
+        scheduleTimerPeriod(timer, generation, periodUs);
+        timer->callback(timer->arg);
+    });
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period)
+{
+    scheduleTimerPeriod(timer, ++timer->generation, period);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    ++timer->generation;
+    return ESP_OK;
+}
+
+int64_t esp_timer_get_time()
+{
+    return static_cast<int64_t>(sim::clock().nowUs());
+}
+
+// --------------------------------------------------------------
+// WiFi
+
+wl_status_t WiFiClass::begin(const char* ssid, const char*, int32_t channel, const uint8_t* bssid)
+{
+    sim::wifi().begin(ssid, channel > 0 && bssid);
+    return status();
+}
+
+bool WiFiClass::config(IPAddress localIP, IPAddress, IPAddress, IPAddress)
+{
+    sim::wifi().staticIp = uint32_t(localIP) != 0;
+    return true;
+}
+
+wl_status_t WiFiClass::status()
+{
+    return sim::wifi().isConnected() ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+bool WiFiClass::disconnect()
+{
+    sim::wifi().drop();
+    return true;
+}
+
+IPAddress WiFiClass::localIP()
+{
+    return sim::wifi().isConnected() ? IPAddress(192, 168, 1, 50) : IPAddress();
+}
+
+IPAddress WiFiClass::gatewayIP()
+{
+    return sim::wifi().isConnected() ? IPAddress(192, 168, 1, 1) : IPAddress();
+}
+
+IPAddress WiFiClass::subnetMask()
+{
+    return sim::wifi().isConnected() ? IPAddress(255, 255, 255, 0) : IPAddress();
+}
+
+IPAddress WiFiClass::dnsIP()
+{
+    return gatewayIP();
+}
+
+int32_t WiFiClass::channel()
+{
+    return sim::wifi().isConnected() ? 6 : 0;
+}
+
+namespace {
+
+// Hosts resolved by WiFi.hostByName(), by their (made up) address
+std::map<uint32_t, std::string>& resolvedHosts()
+{
+    static std::map<uint32_t, std::string> hosts;
+    return hosts;
+}
+
+} // namespace
+
+int WiFiClass::hostByName(const char* host, IPAddress& address)
+{
+    if (!sim::wifi().isConnected()) return 0;
+    auto& hosts = resolvedHosts();
+    for (const auto& [ip, name] : hosts) {
+        if (name == host) {
+            address = IPAddress(ip);
+            return 1;
+        }
+    }
+    address = IPAddress(10, 0, 0, static_cast<uint8_t>(hosts.size() + 1));
+    hosts[uint32_t(address)] = host;
+    return 1;
+}
+
+uint8_t* WiFiClass::BSSID()
+{
+    static uint8_t bssid[6] = {0x02, 0x00, 0x00, 0x00, 0xd0, 0x0b};
+    return bssid;
+}
+
+// --------------------------------------------------------------
+// Preferences
+
+namespace {
+
+std::map<std::string, std::vector<uint8_t>>& nvs()
+{
+    static std::map<std::string, std::vector<uint8_t>> nvs;
+    return nvs;
+}
+
+} // namespace
+
+bool Preferences::begin(const char* name, bool readOnly)
+{
+    space = name;
+    this->readOnly = readOnly;
+    opened = true;
+    return true;
+}
+
+void Preferences::end()
+{
+    opened = false;
+}
+
+size_t Preferences::putInt(const char* key, int32_t value)
+{
+    return putBytes(key, &value, sizeof(value));
+}
+
+int32_t Preferences::getInt(const char* key, int32_t defaultValue)
+{
+    int32_t value = defaultValue;
+    return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+}
+
+size_t Preferences::putString(const char* key, const String& value)
+{
+    return putBytes(key, value.c_str(), value.length());
+}
+
+String Preferences::getString(const char* key, const String& defaultValue)
+{
+    const auto it = nvs().find(space + "/" + key);
+    if (!opened || it == nvs().end()) return defaultValue;
+    return String(std::string(it->second.begin(), it->second.end()));
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t len)
+{
+    if (!opened || readOnly) return 0;
+    const auto* bytes = static_cast<const uint8_t*>(value);
+    nvs()[space + "/" + key].assign(bytes, bytes + len);
+    return len;
+}
+
+size_t Preferences::getBytes(const char* key, void* buf, size_t maxLen)
+{
+    const auto it = nvs().find(space + "/" + key);
+    if (!opened || it == nvs().end() || it->second.size() > maxLen) return 0;
+    memcpy(buf, it->second.data(), it->second.size());
+    return it->second.size();
+}
+
+size_t Preferences::getBytesLength(const char* key)
+{
+    const auto it = nvs().find(space + "/" + key);
+    return opened && it != nvs().end() ? it->second.size() : 0;
+}
+
+bool Preferences::isKey(const char* key)
+{
+    return opened && nvs().count(space + "/" + key) > 0;
+}
+
+bool Preferences::remove(const char* key)
+{
+    return opened && !readOnly && nvs().erase(space + "/" + key) > 0;
+}
+
+// --------------------------------------------------------------
+// SNTP
+
+// 2025-06-01 12:00:00 UTC, the simulated time once SNTP is synced
+constexpr time_t SimEpoch = 1748779200;
+
+namespace {
+bool sntpStarted = false;
+bool sntpSynced = false;
+} // namespace
+
+void configTzTime(const char* tz, const char*, const char*, const char*)
+{
+    setenv("TZ", tz, 1);
+    tzset();
+    sntpStarted = true;
+}
+
+sntp_sync_status_t sntp_get_sync_status()
+{
+    // Like lwIP, the completion is reported once.
+    if (sntpSynced || !sntpStarted || !sim::wifi().isConnected()) return SNTP_SYNC_STATUS_RESET;
+    sntpSynced = true;
+    return SNTP_SYNC_STATUS_COMPLETED;
+}
+
+// The executables are linked with --wrap=time, so the firmware gets the simulated time.
+extern "C" time_t __wrap_time(time_t* out)
+{
+    const time_t now = (sntpSynced ? SimEpoch : 0) + millis() / 1000;
+    if (out) *out = now;
+    return now;
+}
+
+// --------------------------------------------------------------
+// EEPROM
+
+bool EEPROMClass::begin(size_t newSize)
+{
+    size = newSize;
+    return size <= sizeof(data);
+}
+
+uint8_t EEPROMClass::read(int address)
+{
+    return address >= 0 && size_t(address) < size ? data[address] : 0;
+}
+
+void EEPROMClass::write(int address, uint8_t value)
+{
+    if (address >= 0 && size_t(address) < size) data[address] = value;
+}
+
+bool EEPROMClass::commit()
+{
+    return true;
+}
+
+// --------------------------------------------------------------
+// MQTT
+
+PubSubClient::PubSubClient(Client&)
+{}
+
+PubSubClient::~PubSubClient()
+{
+    if (bus && subscriberId >= 0) bus->removeSubscriber(subscriberId);
+}
+
+PubSubClient& PubSubClient::setClient(Client&)
+{
+    return *this;
+}
+
+PubSubClient& PubSubClient::setServer(const char* domain, uint16_t)
+{
+    bus = &sim::mqttBus(domain);
+    return *this;
+}
+
+PubSubClient& PubSubClient::setServer(IPAddress ip, uint16_t)
+{
+    const auto it = resolvedHosts().find(uint32_t(ip));
+    bus = &sim::mqttBus(it != resolvedHosts().end() ? it->second : ip.toString().c_str());
+    return *this;
+}
+
+PubSubClient& PubSubClient::setSocketTimeout(uint16_t)
+{
+    return *this;
+}
+
+PubSubClient& PubSubClient::setCallback(MQTT_CALLBACK_SIGNATURE)
+{
+    this->callback = callback;
+    return *this;
+}
+
+bool PubSubClient::setBufferSize(uint16_t size)
+{
+    bufferSize = size;
+    return true;
+}
+
+bool PubSubClient::connect(const char* id)
+{
+    return connect(id, nullptr, nullptr);
+}
+
+bool PubSubClient::connect(const char*, const char* user, const char* password)
+{
+    if (!bus || !bus->connectClient(user, password)) return false;
+    if (subscriberId >= 0) bus->removeSubscriber(subscriberId);
+    subscriberId = bus->addSubscriber();
+    connectedGeneration = bus->getGeneration();
+    isConnected = true;
+    return true;
+}
+
+void PubSubClient::disconnect()
+{
+    if (connected()) bus->disconnectClient();
+    isConnected = false;
+}
+
+bool PubSubClient::connected()
+{
+    if (isConnected && (!bus->isReachable() || bus->getGeneration() != connectedGeneration)) {
+        // A connection lost with the network is closed by the broker as well (keep alive timeout).
+        if (bus->getGeneration() == connectedGeneration) bus->disconnectClient();
+        isConnected = false;
+    }
+    return isConnected;
+}
+
+int PubSubClient::state()
+{
+    return connected() ? 0 : -2; // MQTT_CONNECT_FAILED
+}
+
+bool PubSubClient::subscribe(const char* topic)
+{
+    if (!connected()) return false;
+    bus->subscribe(subscriberId, topic);
+    return true;
+}
+
+bool PubSubClient::publish(const char* topic, const char* payload)
+{
+    // Like the real client, messages larger than the buffer are rejected.
+    if (!connected() || strlen(topic) + strlen(payload) + 7 > bufferSize) return false;
+    bus->publishFromClient(topic, payload);
+    return true;
+}
+
+bool PubSubClient::loop()
+{
+    if (!connected()) return false;
+
+    sim::MqttMessage message;
+    while (bus->takeMessage(subscriberId, message)) {
+        if (callback) {
+            std::string topic = message.topic;
+            callback(topic.data(), reinterpret_cast<uint8_t*>(message.payload.data()), message.payload.size());
+        }
+    }
+    return true;
+}
+
+// --------------------------------------------------------------
+// Embedded broker
+
+namespace mqttBrokerName {
+
+MqttBroker::MqttBroker(uint16_t)
+{}
+
+void MqttBroker::setMaxNumClients(int numClients)
+{
+    maxNumClients = numClients;
+    sim::mqttBus("localhost").setMaxNumClients(numClients);
+}
+
+void MqttBroker::startBroker()
+{
+    sim::mqttBus("localhost").setRunning(true);
+}
+
+void MqttBroker::stopBroker()
+{
+    sim::mqttBus("localhost").setRunning(false);
+}
+
+} // namespace mqttBrokerName
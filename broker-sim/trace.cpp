@@ -0,0 +1,107 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace sim {
+
+namespace {
+
+// Released time after the last edge, so late detections are seen.
+constexpr uint32_t TraceTailMs = 3000;
+
+bool isSampleString(const std::string& token)
+{
+    return !token.empty() && token.find_first_not_of("01") == std::string::npos;
+}
+
+InputTrace traceFromSamples(const std::string& name, const std::string& samples, uint32_t periodMs)
+{
+    InputTrace trace;
+    trace.name = name;
+    trace.periodMs = periodMs;
+    bool level = false;
+    for (size_t i = 0; i < samples.size(); ++i) {
+        const bool pressed = samples[i] == '1';
+        if (i == 0 || pressed != level) trace.edges.push_back({static_cast<uint32_t>(i * periodMs), pressed});
+        level = pressed;
+    }
+    if (level) trace.edges.push_back({static_cast<uint32_t>(samples.size() * periodMs), false});
+    trace.durationMs = samples.size() * periodMs + TraceTailMs;
+    return trace;
+}
+
+} // namespace
+
+bool InputTrace::isPressedAt(uint32_t tsMs) const
+{
+    bool pressed = false;
+    for (const auto& edge : edges) {
+        if (edge.tsMs > tsMs) break;
+        pressed = edge.pressed;
+    }
+    return pressed;
+}
+
+std::vector<uint32_t> InputTrace::getReferenceRings(uint32_t minRingMs) const
+{
+    if (!rings.empty()) return rings;
+
+    std::vector<uint32_t> result;
+    for (size_t i = 0; i < edges.size(); ++i) {
+        if (!edges[i].pressed) continue;
+        const uint32_t releaseMs = i + 1 < edges.size() ? edges[i + 1].tsMs : durationMs;
+        if (releaseMs - edges[i].tsMs >= minRingMs) result.push_back(edges[i].tsMs);
+    }
+    return result;
+}
+
+std::vector<InputTrace> loadTraces(const std::string& path)
+{
+    std::vector<InputTrace> traces;
+    std::ifstream file(path);
+    if (!file) return traces;
+
+    InputTrace edgeTrace;
+    edgeTrace.name = path;
+    uint32_t periodMs = 100;
+    std::string line;
+    int lineNo = 0;
+
+    while (std::getline(file, line)) {
+        ++lineNo;
+        const auto comment = line.find('#');
+        if (comment != std::string::npos) line.erase(comment);
+
+        std::istringstream in(line);
+        std::vector<std::string> tokens;
+        for (std::string token; in >> token;) tokens.push_back(token);
+        if (tokens.empty()) continue;
+
+        if (tokens[0] == "period" && tokens.size() == 2) {
+            periodMs = std::stoul(tokens[1]);
+            edgeTrace.periodMs = periodMs;
+        } else if (tokens[0] == "ring" && tokens.size() == 2) {
+            edgeTrace.rings.push_back(std::stoul(tokens[1]));
+        } else if (tokens.size() == 2 && tokens[0].find_first_not_of("0123456789") == std::string::npos
+                   && (tokens[1] == "0" || tokens[1] == "1")) {
+            edgeTrace.edges.push_back({static_cast<uint32_t>(std::stoul(tokens[0])), tokens[1] == "1"});
+        } else if (isSampleString(tokens.back())) {
+            traces.push_back(traceFromSamples(path + ":" + std::to_string(lineNo), tokens.back(), periodMs));
+        }
+    }
+
+    if (!edgeTrace.edges.empty()) {
+        // Timestamps of the device are milliseconds since start, let the trace start at 0.
+        const uint32_t startMs = edgeTrace.edges.front().tsMs;
+        for (auto& edge : edgeTrace.edges) edge.tsMs -= startMs;
+        for (auto& ring : edgeTrace.rings) ring -= std::min(ring, startMs);
+        edgeTrace.durationMs = edgeTrace.edges.back().tsMs + TraceTailMs;
+        traces.push_back(edgeTrace);
+    }
+
+    return traces;
+}
+
+} // namespace sim
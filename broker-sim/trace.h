@@ -0,0 +1,41 @@
+#pragma once
+
+// Input traces for the replay of recorded ring input signals.
+//
+// Trace file format (one entry per line, '#' starts a comment):
+//   period <ms>            sample period of the recording (optional, default 100)
+//   <ms> <0|1>             edge of the raw input at <ms>: 1 = pressed, 0 = released
+//   ring <ms>              ground truth: a real ring started at <ms> (optional)
+//
+// The output of the "getTrace" command is a trace file. Lines of "getRawData"
+// ("<date> <time> 0011...", one sample per period) are also accepted, every line is a separate trace.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace sim {
+
+struct TraceEdge
+{
+    uint32_t tsMs;
+    bool pressed;
+};
+
+struct InputTrace
+{
+    std::string name;
+    uint32_t periodMs = 100;
+    uint32_t durationMs = 0;
+    std::vector<TraceEdge> edges;
+    std::vector<uint32_t> rings; // ground truth, empty if not annotated
+
+    bool isPressedAt(uint32_t tsMs) const;
+
+    // Ring starts: annotated rings, or presses lasting at least minRingMs.
+    std::vector<uint32_t> getReferenceRings(uint32_t minRingMs) const;
+};
+
+std::vector<InputTrace> loadTraces(const std::string& path);
+
+} // namespace sim
@@ -0,0 +1,260 @@
+#include "alarmplayer.h"
+
+#include <QAudioDevice>
+#include <QDebug>
+#include <QFile>
+#include <QMediaDevices>
+#include <QtEndian>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+const QString AlarmWav = ":/audio/alarm.wav";
+// Audio the output buffers ahead, a played sound starts at most this late
+const qint64 OutputBufferUs = 100 * 1000;
+
+const quint16 WavFormatPcm = 1;
+const quint16 WavFormatFloat = 3;
+
+// Sample format of a WAV "fmt " chunk, Unknown if not supported
+QAudioFormat::SampleFormat getWavSampleFormat(quint16 wavFormat, quint16 bitsPerSample)
+{
+	if (wavFormat == WavFormatFloat && bitsPerSample == 32)
+		return QAudioFormat::Float;
+	if (wavFormat != WavFormatPcm)
+		return QAudioFormat::Unknown;
+
+	switch (bitsPerSample)
+	{
+	case 8:
+		return QAudioFormat::UInt8;
+	case 16:
+		return QAudioFormat::Int16;
+	case 32:
+		return QAudioFormat::Int32;
+	default:
+		return QAudioFormat::Unknown;
+	}
+}
+
+void writeSample(float value, const QAudioFormat& format, char* dest)
+{
+	value = std::clamp(value, -1.0f, 1.0f);
+	switch (format.sampleFormat())
+	{
+	case QAudioFormat::UInt8:
+		*reinterpret_cast<quint8*>(dest) = static_cast<quint8>(qRound((value + 1.0f) * 127.5f));
+		break;
+	case QAudioFormat::Int16:
+		qToLittleEndian(static_cast<qint16>(qRound(value * 32767.0f)), dest);
+		break;
+	case QAudioFormat::Int32:
+		qToLittleEndian(static_cast<qint32>(qRound64(value * 2147483647.0)), dest);
+		break;
+	case QAudioFormat::Float:
+		qToLittleEndian(value, dest);
+		break;
+	default:
+		break;
+	}
+}
+
+// Converts to another sample format, rate (linear interpolation) and channel count (the channels are mixed down first).
+QByteArray convertSamples(const QByteArray& samples, const QAudioFormat& from, const QAudioFormat& to)
+{
+	const qsizetype fromFrames = samples.size() / from.bytesPerFrame();
+	std::vector<float> mono(fromFrames);
+	for (qsizetype frame = 0; frame < fromFrames; ++frame)
+	{
+		const char* frameData = samples.constData() + frame * from.bytesPerFrame();
+		float sum = 0;
+		for (int channel = 0; channel < from.channelCount(); ++channel)
+			sum += from.normalizedSampleValue(frameData + channel * from.bytesPerSample());
+		mono[frame] = sum / from.channelCount();
+	}
+
+	const qsizetype toFrames = fromFrames * to.sampleRate() / from.sampleRate();
+	QByteArray converted(toFrames * to.bytesPerFrame(), Qt::Uninitialized);
+	for (qsizetype frame = 0; frame < toFrames; ++frame)
+	{
+		const double pos = static_cast<double>(frame) * from.sampleRate() / to.sampleRate();
+		const qsizetype index = static_cast<qsizetype>(pos);
+		const float next = index + 1 < fromFrames ? mono[index + 1] : mono[index];
+		const float value = mono[index] + static_cast<float>(pos - index) * (next - mono[index]);
+
+		char* frameData = converted.data() + frame * to.bytesPerFrame();
+		for (int channel = 0; channel < to.channelCount(); ++channel)
+			writeSample(value, to, frameData + channel * to.bytesPerSample());
+	}
+	return converted;
+}
+
+} // namespace
+
+AlarmSource::AlarmSource(const QByteArray& samples, const QAudioFormat& format, QObject* parent)
+	: QIODevice(parent)
+	, samples(samples)
+	, bytesPerFrame(format.bytesPerFrame())
+	, readPos(samples.size())
+{
+	silenceFrame = QByteArray(bytesPerFrame, Qt::Uninitialized);
+	for (int channel = 0; channel < format.channelCount(); ++channel)
+		writeSample(0.0f, format, silenceFrame.data() + channel * format.bytesPerSample());
+	clock.start();
+}
+
+void AlarmSource::rewind()
+{
+	rewindMs = clock.elapsed();
+}
+
+bool AlarmSource::isSequential() const
+{
+	return true;
+}
+
+qint64 AlarmSource::bytesAvailable() const
+{
+	// Silence follows the samples, there is always a buffer full to read.
+	return QIODevice::bytesAvailable() + samples.size();
+}
+
+qint64 AlarmSource::readData(char* data, qint64 maxSize)
+{
+	const qint64 size = maxSize - maxSize % bytesPerFrame;
+	const qint64 playMs = rewindMs.exchange(-1);
+	if (playMs >= 0)
+	{
+		readPos = 0;
+		emit firstSampleRead(clock.elapsed() - playMs);
+	}
+
+	const qint64 length = std::min<qint64>(size, samples.size() - readPos);
+	memcpy(data, samples.constData() + readPos, length);
+	readPos += length;
+	for (qint64 pos = length; pos < size; pos += bytesPerFrame)
+		memcpy(data + pos, silenceFrame.constData(), bytesPerFrame);
+	return size;
+}
+
+qint64 AlarmSource::writeData(const char* data, qint64 maxSize)
+{
+	Q_UNUSED(data);
+	Q_UNUSED(maxSize);
+	return -1;
+}
+
+AlarmPlayer::AlarmPlayer(QObject* parent)
+	: QObject(parent)
+{
+}
+
+void AlarmPlayer::start()
+{
+	const QAudioDevice device = QMediaDevices::defaultAudioOutput();
+	if (device.isNull())
+	{
+		qWarning() << "No audio output, the alarm sound is off";
+		return;
+	}
+
+	if (!loadWav(AlarmWav))
+		return;
+
+	// Converted once, so the output takes the samples as they are.
+	const QAudioFormat deviceFormat = device.preferredFormat();
+	if (deviceFormat != format)
+	{
+		samples = convertSamples(samples, format, deviceFormat);
+		format = deviceFormat;
+	}
+
+	source.reset(new AlarmSource(samples, format));
+	source->open(QIODevice::ReadOnly);
+	connect(source.get(), &AlarmSource::firstSampleRead, this, &AlarmPlayer::onFirstSampleRead);
+
+	sink.reset(new QAudioSink(device, format));
+	sink->setBufferSize(format.bytesForDuration(OutputBufferUs));
+	connect(sink.get(), &QAudioSink::stateChanged, this, &AlarmPlayer::onStateChanged);
+	sink->start(source.get());
+}
+
+bool AlarmPlayer::loadWav(const QString& path)
+{
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		qWarning() << "Cannot open" << path;
+		return false;
+	}
+
+	const QByteArray wav = file.readAll();
+	if (wav.size() < 12 || !wav.startsWith("RIFF") || wav.mid(8, 4) != "WAVE")
+	{
+		qWarning() << path << "is no WAV file";
+		return false;
+	}
+
+	// Chunks: "fmt " with the format, "data" with the samples
+	qsizetype pos = 12;
+	while (pos + 8 <= wav.size())
+	{
+		const QByteArray id = wav.mid(pos, 4);
+		const qsizetype size = qFromLittleEndian<quint32>(wav.constData() + pos + 4);
+		const char* data = wav.constData() + pos + 8;
+		if (pos + 8 + size > wav.size())
+			break;
+
+		if (id == "fmt " && size >= 16)
+		{
+			const auto sampleFormat = getWavSampleFormat(qFromLittleEndian<quint16>(data), qFromLittleEndian<quint16>(data + 14));
+			format.setSampleFormat(sampleFormat);
+			format.setChannelCount(qFromLittleEndian<quint16>(data + 2));
+			format.setSampleRate(static_cast<int>(qFromLittleEndian<quint32>(data + 4)));
+		}
+		else if (id == "data")
+		{
+			samples = QByteArray(data, size);
+		}
+
+		// Chunks are padded to an even size
+		pos += 8 + size + (size & 1);
+	}
+
+	if (!format.isValid() || samples.isEmpty())
+	{
+		qWarning() << path << "has no supported PCM format or no samples";
+		return false;
+	}
+	return true;
+}
+
+void AlarmPlayer::play()
+{
+	if (!source)
+		return;
+
+	// Opened again after an error
+	if (sink->state() == QAudio::StoppedState)
+		sink->start(source.get());
+	source->rewind();
+}
+
+void AlarmPlayer::onFirstSampleRead(qint64 timeToReadMs)
+{
+	// The first samples play after the audio buffered ahead of them, at most the buffer of the output.
+	const qint64 bufferedMs = format.durationForBytes(static_cast<qint32>(sink->bufferSize())) / 1000;
+	emit firstSampleQueued(timeToReadMs + bufferedMs);
+}
+
+void AlarmPlayer::onStateChanged(QAudio::State state)
+{
+	if (state != QAudio::StoppedState || sink->error() == QAudio::NoError)
+		return;
+
+	// A sound playing now is lost, the output stream is opened again for the next one.
+	qWarning() << "Audio output failed:" << sink->error();
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <QAudio>
+#include <QAudioFormat>
+#include <QAudioSink>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QIODevice>
+#include <QObject>
+#include <QScopedPointer>
+
+#include <atomic>
+
+// Stream of the alarm sound, pulled by the audio output: the samples once after each rewind(), silence before and
+// after, so the output stream never runs dry. The output may read it on a thread of its own.
+class AlarmSource final : public QIODevice
+{
+	Q_OBJECT
+public:
+	AlarmSource(const QByteArray& samples, const QAudioFormat& format, QObject* parent = nullptr);
+
+	// The samples start with the next read
+	void rewind();
+
+	bool isSequential() const override;
+	qint64 bytesAvailable() const override;
+
+signals:
+	// The first samples after rewind() were read, timeToReadMs after it
+	void firstSampleRead(qint64 timeToReadMs);
+
+protected:
+	qint64 readData(char* data, qint64 maxSize) override;
+	qint64 writeData(const char* data, qint64 maxSize) override;
+
+private:
+	const QByteArray samples;
+	QByteArray silenceFrame;
+	const int bytesPerFrame;
+	qsizetype readPos;
+	QElapsedTimer clock;
+	std::atomic<qint64> rewindMs{-1};
+};
+
+// Plays the alarm sound in-process, on a thread of its own (see RingDialog): the WAV from the resources is decoded once
+// (in the format of the audio output) and the output stream pulls it from memory. The stream is kept open (opened
+// again after an error), so a play only rewinds the samples.
+class AlarmPlayer final : public QObject
+{
+	Q_OBJECT
+public:
+	explicit AlarmPlayer(QObject* parent = nullptr);
+
+public slots:
+	// Opens the audio output, called on the thread of the player once it is there
+	void start();
+	// Restarts the sound from the beginning
+	void play();
+
+signals:
+	// Time from play() until the first samples are read by the output, including the audio buffered ahead of them
+	void firstSampleQueued(qint64 timeToFirstSampleMs);
+
+private:
+	bool loadWav(const QString& path);
+	void onFirstSampleRead(qint64 timeToReadMs);
+	void onStateChanged(QAudio::State state);
+
+	QAudioFormat format;
+	QByteArray samples;
+	QScopedPointer<AlarmSource> source;
+	QScopedPointer<QAudioSink> sink;
+};
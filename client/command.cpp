@@ -6,6 +6,7 @@ const QByteArray SpecialResponse::EndMultiResponse = "endMultiResponse";
 const QByteArray SpecialResponse::AutoBuzzOn = "autoBuzzOn";
 const QByteArray SpecialResponse::AutoBuzzOff = "autoBuzzOff";
 
+const QByteArray RingMessage::Timing = "t=";
 const QByteArray RingMessage::Ring = "ring";
 const QByteArray RingMessage::TestRing = "testRing";
 const QByteArray RingMessage::AckRing = "ackRing";
@@ -38,3 +39,42 @@ bool Command::isMultiResponse() const
 	// only action log and raw data are multi-responses
 	return value == getActionLog || value == getRawData;
 }
+
+Command::Priority Command::getPriority() const
+{
+	switch (value)
+	{
+	case buzz:
+	case ackRing:
+		return Actuation;
+
+	case getRawData:
+	case getStartTime:
+	case getActionLog:
+		return Bulk;
+
+	case ping:
+	case autoBuzzOn:
+	case autoBuzzOff:
+	case getAutoBuzz:
+	case testRing:
+	default:
+		return State;
+	}
+}
+
+bool Command::isIdempotent() const
+{
+	switch (value)
+	{
+	case ping:
+	case getAutoBuzz:
+	case getRawData:
+	case getStartTime:
+	case getActionLog:
+		return true;
+
+	default:
+		return false;
+	}
+}
@@ -24,8 +24,20 @@ public:
 	};
 	Q_ENUM_HELPERS(Command)
 
+	// Scheduling class, opening the door never waits on diagnostics traffic
+	enum Priority
+	{
+		Actuation,
+		State,
+		Bulk,
+		NumPriorities
+	};
+
 	bool needsResponse() const;
 	bool isMultiResponse() const;
+	Priority getPriority() const;
+	// A query without side effects, one queued request serves all requesters (the response is broadcast)
+	bool isIdempotent() const;
 };
 
 class SpecialResponse final
@@ -41,6 +53,8 @@ public:
 class RingMessage final
 {
 public:
+	// Rings end with the device times of the input edge and of the publish: "t=<edge>,<publish>"
+	static const QByteArray Timing;
 	static const QByteArray Ring;
 	static const QByteArray TestRing;
 	static const QByteArray AckRing;
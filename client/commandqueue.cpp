@@ -0,0 +1,109 @@
+#include "commandqueue.h"
+
+#include <algorithm>
+
+namespace {
+
+const int MaxQueuedCommands = 16;
+
+// Actuation is sent right away. State and bulk share a few slots in flight, a slow multi-response does not hold back other commands.
+// At most one bulk transfer is in flight, and none while an actuation waits for its response.
+const int MaxCommandsInFlight = 4;
+const int MaxBulkInFlight = 1;
+
+const char* PriorityNames[] = {
+	"actuation",
+	"state",
+	"bulk",
+};
+
+} // namespace
+
+CommandQueue::PushResult CommandQueue::push(const Command& cmd, QList<Command>& evicted)
+{
+	const auto priority = cmd.getPriority();
+	auto& queue = queues[priority];
+
+	if (cmd.isIdempotent())
+	{
+		const bool isQueued = std::any_of(queue.cbegin(), queue.cend(), [&cmd](const QueuedCommand& queued) { return queued.cmd == cmd; });
+		if (isQueued)
+		{
+			++metrics[priority].coalesced;
+			return PushResult::Coalesced;
+		}
+	}
+
+	if (size >= MaxQueuedCommands)
+	{
+		int lowerPriority = Command::NumPriorities - 1;
+		while (lowerPriority > priority && queues[lowerPriority].isEmpty())
+			--lowerPriority;
+
+		if (lowerPriority == priority)
+		{
+			++metrics[priority].rejected;
+			return PushResult::Rejected;
+		}
+
+		evicted.append(queues[lowerPriority].takeLast().cmd);
+		++metrics[lowerPriority].evicted;
+		--size;
+	}
+
+	queue.append(QueuedCommand{cmd, {}});
+	queue.last().sinceQueued.start();
+	maxSize = std::max(maxSize, ++size);
+	return PushResult::Queued;
+}
+
+bool CommandQueue::canSend(Command::Priority priority, const InFlightCounts& inFlight)
+{
+	const int sharedInFlight = inFlight[Command::State] + inFlight[Command::Bulk];
+	switch (priority)
+	{
+	case Command::Actuation:
+		return true;
+	case Command::Bulk:
+		return sharedInFlight < MaxCommandsInFlight && inFlight[Command::Bulk] < MaxBulkInFlight && inFlight[Command::Actuation] == 0;
+	case Command::State:
+	default:
+		return sharedInFlight < MaxCommandsInFlight;
+	}
+}
+
+bool CommandQueue::takeNext(const InFlightCounts& inFlight, Command& cmd)
+{
+	for (int priority = 0; priority < Command::NumPriorities; ++priority)
+	{
+		auto& queue = queues[priority];
+		if (queue.isEmpty() || !canSend(static_cast<Command::Priority>(priority), inFlight))
+			continue;
+
+		const QueuedCommand queued = queue.takeFirst();
+		--size;
+		auto& priorityMetrics = metrics[priority];
+		++priorityMetrics.sent;
+		priorityMetrics.maxWaitMs = std::max(priorityMetrics.maxWaitMs, queued.sinceQueued.elapsed());
+		cmd = queued.cmd;
+		return true;
+	}
+	return false;
+}
+
+QString CommandQueue::getStateStr() const
+{
+	QString state = QString("Command queue: %1 queued, at most %2 of %3").arg(size).arg(maxSize).arg(MaxQueuedCommands);
+	for (int priority = 0; priority < Command::NumPriorities; ++priority)
+	{
+		const auto& priorityMetrics = metrics[priority];
+		state += QString("\n  %1: sent %2, coalesced %3, evicted %4, rejected %5, longest wait %6 ms")
+					 .arg(PriorityNames[priority])
+					 .arg(priorityMetrics.sent)
+					 .arg(priorityMetrics.coalesced)
+					 .arg(priorityMetrics.evicted)
+					 .arg(priorityMetrics.rejected)
+					 .arg(priorityMetrics.maxWaitMs);
+	}
+	return state;
+}
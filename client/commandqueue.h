@@ -0,0 +1,55 @@
+#pragma once
+
+#include "command.h"
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QString>
+
+#include <array>
+
+// Commands waiting to be sent, one queue per priority class.
+// Idempotent queries that are queued already are coalesced, the number of queued commands is bounded.
+class CommandQueue final
+{
+public:
+	enum class PushResult
+	{
+		Queued,
+		Coalesced,
+		Rejected // full with commands of the same or a higher priority
+	};
+
+	// Commands waiting for their response, per priority class
+	using InFlightCounts = std::array<int, Command::NumPriorities>;
+
+	// A full queue makes room for a command by evicting the newest one of a lower priority class.
+	PushResult push(const Command& cmd, QList<Command>& evicted);
+	// Next command that may be sent with the given commands in flight
+	bool takeNext(const InFlightCounts& inFlight, Command& cmd);
+
+	QString getStateStr() const;
+
+private:
+	struct QueuedCommand
+	{
+		Command cmd;
+		QElapsedTimer sinceQueued;
+	};
+
+	struct Metrics
+	{
+		int sent = 0;
+		int coalesced = 0;
+		int evicted = 0;
+		int rejected = 0;
+		qint64 maxWaitMs = 0;
+	};
+
+	static bool canSend(Command::Priority priority, const InFlightCounts& inFlight);
+
+	std::array<QList<QueuedCommand>, Command::NumPriorities> queues;
+	std::array<Metrics, Command::NumPriorities> metrics;
+	int size = 0;
+	int maxSize = 0;
+};
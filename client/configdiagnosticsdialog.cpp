@@ -3,6 +3,7 @@
 
 #include "configstore.h"
 #include "constants.h"
+#include "latencystats.h"
 #include "ringlistener.h"
 
 #include <QMessageBox>
@@ -38,9 +39,10 @@ QVariant CategoryListModel::data(const QModelIndex& index, int role) const
 
 // ---------------------------------------------------------------------------------------------------------
 
-ConfigDiagnosticsDialog::ConfigDiagnosticsDialog(RingListener* ringListener, ConfigStore* cfgStore)
+ConfigDiagnosticsDialog::ConfigDiagnosticsDialog(RingListener* ringListener, ConfigStore* cfgStore, LatencyStats* latencyStats)
 	: CommandClientDialog(ringListener)
 	, cfgStore(cfgStore)
+	, latencyStats(latencyStats)
 	, ringListener(ringListener)
 	, ui(new Ui::ConfigDiagnosticsDialog)
 {
@@ -63,6 +65,7 @@ void ConfigDiagnosticsDialog::establishUiConnections()
 	connect(ui->cmdUpdateRawData, &QPushButton::clicked, this, &ConfigDiagnosticsDialog::updateRawData);
 	connect(ui->cmdUpdateHistory, &QPushButton::clicked, this, &ConfigDiagnosticsDialog::updateActionLog);
 	connect(ui->cmdUpdateStartTime, &QPushButton::clicked, this, &ConfigDiagnosticsDialog::updateStartTime);
+	connect(ui->cmdUpdateLatency, &QPushButton::clicked, this, &ConfigDiagnosticsDialog::updateLatency);
 	connect(ui->cmdChangeAutoBuzz, &QPushButton::clicked, this, &ConfigDiagnosticsDialog::changeAutoBuzz);
 	connect(ui->cmdTestBuzzer, &QPushButton::clicked, this, &ConfigDiagnosticsDialog::testBuzz);
 	connect(ui->cmdTestRing, &QPushButton::clicked, this, &ConfigDiagnosticsDialog::testRing);
@@ -78,6 +81,8 @@ void ConfigDiagnosticsDialog::subscribeToState()
 
 	ui->lblAutoBuzzerState->setText(ringListener->getAutoBuzzStateStr());
 	connect(ringListener, &RingListener::autoBuzzStateChanged, ui->lblAutoBuzzerState, &QLabel::setText);
+
+	connect(ringListener, &RingListener::engineStatsChanged, this, &ConfigDiagnosticsDialog::showLatency);
 }
 
 void ConfigDiagnosticsDialog::placeCenter()
@@ -98,6 +103,7 @@ void ConfigDiagnosticsDialog::initializeCategories()
 	categories.push_back({"Settings", ui->wdgSettings});
 	categories.push_back({"Ring/Buzz log", ui->wdgActionLog});
 	categories.push_back({"Raw data", ui->wdgRawData});
+	categories.push_back({"Latency", ui->wdgLatency});
 	categories.push_back({"About", ui->wdgAbout});
 
 	categoryListModel = QSharedPointer<CategoryListModel>::create(categories);
@@ -184,6 +190,8 @@ void ConfigDiagnosticsDialog::updateSelectedCategory()
 		updateActionLog();
 	else if (selectedCategory.widget == ui->wdgRawData)
 		updateRawData();
+	else if (selectedCategory.widget == ui->wdgLatency)
+		updateLatency();
 }
 
 void ConfigDiagnosticsDialog::updateRawData()
@@ -192,6 +200,19 @@ void ConfigDiagnosticsDialog::updateRawData()
 	sendCommand(Command::getRawData);
 }
 
+void ConfigDiagnosticsDialog::updateLatency()
+{
+	// The state of the MQTT engine comes asynchronously (engineStatsChanged), until then the last one is shown.
+	ringListener->requestEngineStats();
+	showLatency();
+}
+
+void ConfigDiagnosticsDialog::showLatency()
+{
+	ui->txtLatency->setText(latencyStats->getReportStr() + "\n\n" + ringListener->getRttStateStr() + "\n\n"
+							+ ringListener->getCommandQueueStateStr());
+}
+
 void ConfigDiagnosticsDialog::changeAutoBuzz()
 {
 	sendCommand(ringListener->getAutoBuzzState() ? Command::autoBuzzOff : Command::autoBuzzOn);
@@ -11,6 +11,7 @@ class ConfigDiagnosticsDialog;
 
 class Config;
 class ConfigStore;
+class LatencyStats;
 class RingListener;
 
 struct Category final
@@ -39,7 +40,7 @@ class ConfigDiagnosticsDialog final : public CommandClientDialog
 	Q_OBJECT
 
 public:
-	explicit ConfigDiagnosticsDialog(RingListener* ringListener, ConfigStore* cfgStore);
+	explicit ConfigDiagnosticsDialog(RingListener* ringListener, ConfigStore* cfgStore, LatencyStats* latencyStats);
 	~ConfigDiagnosticsDialog();
 
 	void updateSelectedCategory();
@@ -67,12 +68,15 @@ private:
 	void updateRawData();
 	void updateStartTime();
 	void updateActionLog();
+	void updateLatency();
+	void showLatency();
 
 	void establishUiConnections();
 	void subscribeToState();
 	void initializeCategories();
 
 	ConfigStore* const cfgStore;
+	LatencyStats* const latencyStats;
 	RingListener* const ringListener;
 	std::vector<Category> categories;
 	QSharedPointer<CategoryListModel> categoryListModel;
@@ -1,7 +1,6 @@
 #pragma once
 
 inline const char * ConfigFileName = "config.json";
-inline const char * TmpAlarmFile = "alarm.wav";
 inline const int WavPlayIntervalMs = 5000;
 inline const char* DateFormat = "yyyy-MM-dd HH:mm:ss";
 inline const char* Version = "0.2.1";
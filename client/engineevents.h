@@ -0,0 +1,65 @@
+#pragma once
+
+#include "command.h"
+
+#include <QByteArray>
+#include <QMetaType>
+#include <QString>
+
+// Events between the MQTT engine (on its worker thread) and the UI, carried by queued signals.
+// They are immutable once sent and hold only values and implicitly shared Qt types, so a copy for the other thread only counts references.
+
+struct EngineConfig
+{
+	QString brokerAddr;
+	QString wlanPattern;
+};
+
+struct CommandRequestEvent
+{
+	Command::Value cmd = Command::None;
+};
+
+struct CommandResponseEvent
+{
+	Command::Value cmd = Command::None;
+	QByteArray response;
+};
+
+struct RingEvent
+{
+	bool testRing = false;
+	QString ringInput; // empty for a ring on the ring topic itself
+	QByteArray info;   // without the device times
+	qint64 deviceEdgeMs = -1;
+	qint64 devicePublishMs = -1;
+	qint64 receivedMs = -1; // client clock (LatencyStats::nowMs), when the engine got the message
+};
+
+struct ConnectionEvent
+{
+	bool deviceConnected = false;
+	QString stateStr;
+	QString details;
+};
+
+struct ClockSampleEvent
+{
+	qint64 sentMs = 0;
+	qint64 deviceMs = 0;
+	qint64 receivedMs = 0;
+};
+
+struct EngineStatsEvent
+{
+	QString rttStateStr;
+	QString commandQueueStateStr;
+};
+
+Q_DECLARE_METATYPE(EngineConfig)
+Q_DECLARE_METATYPE(CommandRequestEvent)
+Q_DECLARE_METATYPE(CommandResponseEvent)
+Q_DECLARE_METATYPE(RingEvent)
+Q_DECLARE_METATYPE(ConnectionEvent)
+Q_DECLARE_METATYPE(ClockSampleEvent)
+Q_DECLARE_METATYPE(EngineStatsEvent)
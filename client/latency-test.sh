@@ -0,0 +1,48 @@
+#!/bin/bash
+# Latency test with a busy UI, see readme.md: runs the client without and with a blocked UI thread, sends test rings
+# to the device and writes the latency report of each run to latency-busy-<ms>.txt.
+# Usage: ./latency-test.sh <broker host> [<rings per run> [<busy ms> [<client>]]]
+# Needs mosquitto_pub (package mosquitto-clients) and the broker running this version.
+
+broker=$1
+rings=${2:-50}
+busyMs=${3:-500}
+client=${4:-build/doorbell-client}
+
+if [ -z "$broker" ]; then
+  echo "Usage: $0 <broker host> [<rings per run> [<busy ms> [<client>]]]"
+  exit 2
+fi
+
+if pgrep "doorbell-client" > /dev/null; then
+  echo "Stop the running doorbell-client first, its dialog and sound would disturb the test."
+  exit 2
+fi
+
+for ms in 0 $busyMs; do
+  report="latency-busy-$ms.txt"
+  echo "Run with --busy-ui $ms, $rings test rings..."
+  "$client" --busy-ui "$ms" --latency-report "$report" > /dev/null 2>&1 &
+  pid=$!
+
+  # Connect and collect pings for the clock offset to the device
+  sleep 20
+
+  for ((i = 0; i < rings; i++)); do
+    mosquitto_pub -h "$broker" -t cmd -m testRing
+    sleep 3
+    # Closes the dialog, so the next ring starts the alarm sound again
+    mosquitto_pub -h "$broker" -t cmd -m ackRing
+    sleep 1
+  done
+
+  # The report is written every 10 s
+  sleep 12
+  kill "$pid"
+  wait "$pid" 2> /dev/null
+done
+
+for ms in 0 $busyMs; do
+  echo
+  cat "latency-busy-$ms.txt"
+done
@@ -0,0 +1,138 @@
+#include "latencystats.h"
+
+#include <algorithm>
+
+namespace {
+
+// The offset is taken from the ping with the shortest round trip of the recent ones (least queuing delay).
+const int MaxClockSamples = 8;
+const int MaxStageSamples = 200;
+
+const char* StageNames[] = {
+	"edge -> publish",
+	"publish -> receive",
+	"receive -> UI",
+	"receive -> dialog",
+	"receive -> sound",
+	"play -> sample",
+	"edge -> sound",
+};
+
+qint64 percentile(QList<qint64> values, int p)
+{
+	std::sort(values.begin(), values.end());
+	const int index = std::min<int>(values.size() - 1, p * values.size() / 100);
+	return values.at(index);
+}
+
+} // namespace
+
+LatencyStats::LatencyStats() { clock.start(); }
+
+qint64 LatencyStats::nowMs() const { return clock.elapsed(); }
+
+void LatencyStats::addClockSample(qint64 sentMs, qint64 deviceMs, qint64 receivedMs)
+{
+	// The device time restarts with a reboot of the device, older samples are useless then.
+	if (deviceMs < lastDeviceMs)
+		clockSamples.clear();
+	lastDeviceMs = deviceMs;
+
+	// The device time was taken somewhere in the round trip, most likely in the middle.
+	clockSamples.append(ClockSample{receivedMs - sentMs, deviceMs - (sentMs + receivedMs) / 2});
+	if (clockSamples.size() > MaxClockSamples)
+		clockSamples.removeFirst();
+}
+
+const LatencyStats::ClockSample* LatencyStats::getBestClockSample() const
+{
+	const auto it = std::min_element(clockSamples.begin(),
+									 clockSamples.end(),
+									 [](const ClockSample& a, const ClockSample& b) { return a.roundTripMs < b.roundTripMs; });
+	return it == clockSamples.end() ? nullptr : &*it;
+}
+
+void LatencyStats::ringReceived(qint64 deviceEdgeMs, qint64 devicePublishMs, qint64 receivedMs)
+{
+	pendingRing = PendingRing{};
+	pendingRing.receivedMs = receivedMs;
+	pendingRing.dialogShown = false;
+	addSample(ReceiveToUi, nowMs() - receivedMs);
+
+	if (deviceEdgeMs < 0)
+		return;
+
+	addSample(EdgeToPublish, devicePublishMs - deviceEdgeMs);
+
+	const ClockSample* clockSample = getBestClockSample();
+	if (clockSample)
+	{
+		addSample(PublishToReceive, receivedMs - (devicePublishMs - clockSample->offsetMs));
+		pendingRing.edgeMs = deviceEdgeMs - clockSample->offsetMs;
+	}
+}
+
+void LatencyStats::dialogShown()
+{
+	if (pendingRing.dialogShown)
+		return;
+	pendingRing.dialogShown = true;
+	addSample(ReceiveToDialog, nowMs() - pendingRing.receivedMs);
+}
+
+void LatencyStats::ringSoundRequested() { pendingRing.soundRequested = true; }
+
+void LatencyStats::soundStarted(qint64 playMs, qint64 timeToFirstSampleMs)
+{
+	addSample(PlayToSound, timeToFirstSampleMs);
+
+	// Only the sound started for a ring counts for it, the repetitions are ignored.
+	if (!pendingRing.soundRequested || pendingRing.soundStarted)
+		return;
+	pendingRing.soundStarted = true;
+
+	const qint64 soundMs = playMs + timeToFirstSampleMs;
+	addSample(ReceiveToSound, soundMs - pendingRing.receivedMs);
+	if (pendingRing.edgeMs >= 0)
+		addSample(EdgeToSound, soundMs - pendingRing.edgeMs);
+}
+
+void LatencyStats::addSample(Stage stage, qint64 latencyMs)
+{
+	auto& stageSamples = samples[stage];
+	stageSamples.append(latencyMs);
+	if (stageSamples.size() > MaxStageSamples)
+		stageSamples.removeFirst();
+}
+
+QString LatencyStats::getReportStr() const
+{
+	QString report = QString("%1 %2 %3 %4 %5\n").arg("Stage (ms)", -20).arg("n", 6).arg("p50", 8).arg("p95", 8).arg("p99", 8);
+	for (int stage = 0; stage < NumStages; ++stage)
+	{
+		const auto& stageSamples = samples[stage];
+		report += QString("%1 %2").arg(StageNames[stage], -20).arg(stageSamples.size(), 6);
+		if (!stageSamples.isEmpty())
+		{
+			report += QString(" %1 %2 %3")
+						  .arg(percentile(stageSamples, 50), 8)
+						  .arg(percentile(stageSamples, 95), 8)
+						  .arg(percentile(stageSamples, 99), 8);
+		}
+		report += "\n";
+	}
+
+	const ClockSample* clockSample = getBestClockSample();
+	if (clockSample)
+	{
+		report += QString("\nClock offset to the device from %1 pings, best round trip %2 ms (publish -> receive is exact to +/- %3 ms)")
+					  .arg(clockSamples.size())
+					  .arg(clockSample->roundTripMs)
+					  .arg((clockSample->roundTripMs + 1) / 2);
+	}
+	else
+	{
+		report += "\nNo clock offset to the device yet (no ping with device time)";
+	}
+	return report;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QString>
+
+#include <array>
+
+// Ring latency per stage, from the input edge on the device to the alarm sound on this client.
+// Device times (ms since device start) are mapped to the client clock by an offset estimated from ping round trips.
+class LatencyStats final
+{
+public:
+	enum Stage
+	{
+		EdgeToPublish,    // device: input edge until the ring is published
+		PublishToReceive, // network and MQTT broker, uncertain by half the best ping round trip
+		ReceiveToUi,      // client: the MQTT engine thread until the UI thread handles the ring
+		ReceiveToDialog,  // client: ring message until the dialog is shown
+		ReceiveToSound,   // client: ring message until the first sample of the alarm sound (only rings that started it)
+		PlayToSound,      // client: alarm sound started until its first sample (every repetition)
+		EdgeToSound,      // total
+		NumStages
+	};
+
+	LatencyStats();
+
+	// Monotonic client clock in ms
+	qint64 nowMs() const;
+
+	// Ping sent and pong received on the client clock, device time from the pong
+	void addClockSample(qint64 sentMs, qint64 deviceMs, qint64 receivedMs);
+
+	// Stages of a ring, dialog and sound refer to the last received ring (device times are -1 for a ring without timestamps).
+	// Called on the UI thread, with the receive time taken by the MQTT engine.
+	void ringReceived(qint64 deviceEdgeMs, qint64 devicePublishMs, qint64 receivedMs);
+	void dialogShown();
+	// The alarm sound is started for the last ring. A ring while it is repeating already gets no sound stages.
+	void ringSoundRequested();
+	// Sound started at playMs (client clock), its first sample followed after timeToFirstSampleMs
+	void soundStarted(qint64 playMs, qint64 timeToFirstSampleMs);
+
+	QString getReportStr() const;
+
+private:
+	struct ClockSample
+	{
+		qint64 roundTripMs;
+		qint64 offsetMs; // device time - client time
+	};
+
+	struct PendingRing
+	{
+		qint64 edgeMs = -1; // on the client clock, -1 if unknown
+		qint64 receivedMs = -1;
+		bool dialogShown = true;
+		bool soundRequested = false;
+		bool soundStarted = false;
+	};
+
+	const ClockSample* getBestClockSample() const;
+	void addSample(Stage stage, qint64 latencyMs);
+
+	QElapsedTimer clock;
+	QList<ClockSample> clockSamples;
+	qint64 lastDeviceMs = -1;
+	PendingRing pendingRing;
+	std::array<QList<qint64>, NumStages> samples;
+};
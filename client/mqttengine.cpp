@@ -0,0 +1,620 @@
+#include "mqttengine.h"
+
+#include "constants.h"
+#include "latencystats.h"
+
+namespace {
+
+// Ring and ack events come on doorRing/<ring input name>, the auto buzzer state on doorRing itself.
+const QMqttTopicName RingTopic{"doorRing"};
+const QMqttTopicFilter RingTopicFilter{"doorRing/#"};
+const QMqttTopicName CommandTopic{"cmd"};
+const QMqttTopicName ResponseTopic{"response"};
+
+// Commands are sent as "#<id> <command>", the device echoes the id in front of each response.
+const QByteArray CorrelationIdMarker = "#";
+
+const int ReconnectDelay = 5000;
+// A timer that fires later than this (by the wall clock) indicates a suspend of the system
+const int SuspendThreshold = 1000;
+
+// Command timeouts follow the measured round trips, until the first response the initial timeout applies.
+// For multi-responses, the timeout applies until the first and between the following parts.
+const int InitialCommandTimeout = 5000;
+const int MinCommandTimeout = 1000;
+const int MaxCommandTimeout = 10000;
+const int MinMultiResponseTimeout = 2000;
+
+// Without other activity the device is pinged, with a doubling interval while it responds and fast after a missed response.
+// The device is lost after MaxMissedResponses responses in a row are missing, a single lost message is no outage.
+const int MinPingInterval = 1000;
+const int MaxPingInterval = 5000;
+const int MaxMissedResponses = 2;
+
+// "pong", or "pong <token> <device time>" for a ping with a token
+bool isPong(const QByteArray& response)
+{
+	return response == SpecialResponse::Pong || response.startsWith(SpecialResponse::Pong + ' ');
+}
+
+// Splits the device timestamps off the end of a ring message (see RingMessage::Timing).
+void takeRingTiming(QByteArray& message, qint64& edgeMs, qint64& publishMs)
+{
+	const auto pos = message.lastIndexOf(" " + RingMessage::Timing);
+	if (pos < 0)
+		return;
+
+	const auto times = message.mid(pos + 1 + RingMessage::Timing.size()).split(',');
+	if (times.size() != 2)
+		return;
+
+	edgeMs = times.at(0).toLongLong();
+	publishMs = times.at(1).toLongLong();
+	message.truncate(pos);
+}
+
+} // namespace
+
+MqttEngine::MqttEngine(const EngineConfig& config, const LatencyStats* latencyClock)
+	: latencyClock(latencyClock)
+	, config(config)
+	, rttQuick(InitialCommandTimeout, MinCommandTimeout, MaxCommandTimeout)
+	, rttMultiResponse(InitialCommandTimeout, MinMultiResponseTimeout, MaxCommandTimeout)
+{}
+
+void MqttEngine::start()
+{
+	setupTimers();
+	setupMqtt();
+}
+
+void MqttEngine::setupTimers()
+{
+	// Nothing is polled: commands are sent when queued, reconnects, pings and timeouts are single-shot timers.
+	conn.timer.reset(new QTimer);
+	conn.timer->setSingleShot(true);
+	connect(conn.timer.get(), &QTimer::timeout, this, &MqttEngine::onConnectionTimer);
+
+	cmdState.timeoutTimer.reset(new QTimer);
+	cmdState.timeoutTimer->setSingleShot(true);
+	connect(cmdState.timeoutTimer.get(), &QTimer::timeout, this, &MqttEngine::onCommandTimeout);
+}
+
+void MqttEngine::setupMqtt()
+{
+	conn.mqtt.reset(new QMqttClient);
+	const auto* mqttClient = conn.mqtt.get();
+	connect(mqttClient, &QMqttClient::connected, this, &MqttEngine::onMqttConnected);
+	connect(mqttClient, &QMqttClient::messageReceived, this, &MqttEngine::onMessageReceived);
+	connect(mqttClient, &QMqttClient::disconnected, this, &MqttEngine::onMqttDisconnected);
+
+	conn.tsLastConnStateChange = QDateTime::currentDateTime();
+	conn.sinceLastActivity.start();
+
+	// The first SSID (and every change) triggers a connect right away, until then the connection waits.
+	wifiMonitor.reset(new WifiMonitor);
+	connect(wifiMonitor.get(), &WifiMonitor::ssidChanged, this, &MqttEngine::onWifiChanged);
+	wifiMonitor->start();
+	mqttConnect();
+}
+
+int MqttEngine::getConnectionTimerDelay() const
+{
+	// Without activity: reconnect (to the broker or the device) or ping the device
+	return conn.state == Connection::DeviceConnected ? conn.pingInterval : ReconnectDelay;
+}
+
+void MqttEngine::scheduleConnectionTimer()
+{
+	const qint64 remaining = qMax<qint64>(0, getConnectionTimerDelay() - conn.sinceLastActivity.elapsed());
+	conn.wallClockDeadline = QDateTime::currentMSecsSinceEpoch() + remaining;
+	conn.timer->start(static_cast<int>(remaining));
+}
+
+void MqttEngine::onConnectionTimer()
+{
+	// The monotonic clock of the timers stops in suspend, the wall clock does not.
+	const bool resumed = QDateTime::currentMSecsSinceEpoch() - conn.wallClockDeadline > SuspendThreshold;
+
+	// Activity since the timer was started postpones the action.
+	if (conn.sinceLastActivity.elapsed() >= getConnectionTimerDelay())
+	{
+		if (conn.state == Connection::Disconnected)
+		{
+			mqttConnect();
+		}
+		else if (conn.state == Connection::MqttConnected)
+		{
+			establishConnectionToDevice();
+		}
+		else
+		{
+			conn.sinceLastActivity.restart();
+			queueCommand(Command::ping);
+		}
+	}
+
+	if (conn.state == Connection::DeviceConnected && resumed)
+	{
+		// This system was probably in suspend, the auto buzz state is not known anymore
+		queueCommand(Command::getAutoBuzz);
+	}
+
+	scheduleConnectionTimer();
+}
+
+void MqttEngine::dispatchCommands()
+{
+	// Responses handled in here can queue further commands, they are sent by the running loop.
+	if (cmdState.dispatching)
+		return;
+	cmdState.dispatching = true;
+
+	Command cmd;
+	while (cmdState.queue.takeNext(getInFlightCounts(), cmd))
+	{
+		// Require device connection. Only for "ping" we just require the MQTT connection, this command is used to establish the connection.
+		if (conn.state != Connection::DeviceConnected && !(conn.hasMqttConn() && cmd == Command::ping))
+		{
+			handleCommandResponse(cmd, ResponseKind::NotConnected);
+			continue;
+		}
+
+		const quint32 id = cmdState.nextId++;
+		if (cmd.needsResponse())
+		{
+			InFlightCommand& inFlight = cmdState.inFlight[id];
+			inFlight.cmd = cmd;
+			inFlight.sinceSent.start();
+			inFlight.deadline.setRemainingTime(getRttEstimator(cmd).getTimeoutMs());
+		}
+
+		QByteArray payload = cmd.toByteArray();
+		if (!conn.legacyDevice)
+		{
+			payload = CorrelationIdMarker + QByteArray::number(id) + ' ' + payload;
+			// The pong echoes the send time together with the device time, for the clock offset to the device.
+			if (cmd == Command::ping)
+				payload += " " + QByteArray::number(latencyClock->nowMs());
+		}
+		conn.mqtt->publish(CommandTopic, payload);
+	}
+
+	scheduleCommandTimeout();
+	cmdState.dispatching = false;
+}
+
+CommandQueue::InFlightCounts MqttEngine::getInFlightCounts() const
+{
+	CommandQueue::InFlightCounts counts{};
+	for (const auto& inFlight : std::as_const(cmdState.inFlight))
+		++counts[inFlight.cmd.getPriority()];
+	return counts;
+}
+
+void MqttEngine::scheduleCommandTimeout()
+{
+	if (cmdState.inFlight.isEmpty())
+	{
+		cmdState.timeoutTimer->stop();
+		return;
+	}
+
+	QDeadlineTimer earliest{QDeadlineTimer::Forever};
+	for (const auto& inFlight : std::as_const(cmdState.inFlight))
+		earliest = qMin(earliest, inFlight.deadline);
+	cmdState.timeoutTimer->start(static_cast<int>(earliest.remainingTime()));
+}
+
+void MqttEngine::onCommandTimeout()
+{
+	// Taken out of the table first, handling a timeout can send further commands.
+	cmdState.timeoutMissCounted = false;
+	QList<Command> timedOut;
+	for (auto it = cmdState.inFlight.begin(); it != cmdState.inFlight.end();)
+	{
+		if (it->deadline.hasExpired())
+		{
+			timedOut.append(it->cmd);
+			it = cmdState.inFlight.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+
+	for (const auto& cmd : timedOut)
+		handleCommandResponse(cmd, ResponseKind::Timeout);
+
+	// Also reschedules the timer for the commands still in flight.
+	dispatchCommands();
+}
+
+void MqttEngine::onMessageReceived(const QByteArray& message, const QMqttTopicName& topic)
+{
+	const qint64 receivedMs = latencyClock->nowMs();
+
+	const auto raiseRing = [this, &topic, receivedMs](bool testRing, const QByteArray& additionalInfo)
+	{
+		RingEvent event;
+		event.testRing = testRing;
+		// Empty for messages on the ring topic itself
+		event.ringInput = topic.levelCount() > 1 ? topic.levels().at(1) : QString{};
+		event.info = additionalInfo;
+		takeRingTiming(event.info, event.deviceEdgeMs, event.devicePublishMs);
+		event.receivedMs = receivedMs;
+		emit ringReceived(event);
+		conn.sinceLastActivity.restart();
+	};
+
+	const auto updateAutoBuzz = [this](bool autoBuzz)
+	{
+		emit autoBuzzChanged(autoBuzz);
+		conn.sinceLastActivity.restart();
+	};
+
+	if (topic == RingTopic || RingTopicFilter.match(topic))
+	{
+		if (message.startsWith(RingMessage::Ring))
+		{
+			raiseRing(false, message.mid(RingMessage::Ring.size() + 1));
+		}
+		else if (message.startsWith(RingMessage::TestRing))
+		{
+			raiseRing(true, message.mid(RingMessage::TestRing.size() + 1));
+		}
+		else if (message == RingMessage::AutoBuzzOn)
+		{
+			updateAutoBuzz(true);
+		}
+		else if (message == RingMessage::AutoBuzzOff)
+		{
+			updateAutoBuzz(false);
+		}
+		else if (message == RingMessage::AckRing)
+		{
+			emit ackRingReceived();
+		}
+		else
+		{
+			qDebug() << "Unknown message received on ring topic:" << message;
+		}
+	}
+	else if (topic.name() == ResponseTopic)
+	{
+		onCommandResponse(message);
+	}
+}
+
+void MqttEngine::onCommandResponse(const QByteArray& message)
+{
+	// A response without an id in flight is late (the command timed out already) or for another client.
+	const auto idEnd = message.indexOf(' ');
+	bool idValid = false;
+	const quint32 id = message.startsWith(CorrelationIdMarker) && idEnd > 0 ? message.mid(1, idEnd - 1).toUInt(&idValid) : 0;
+	auto it = idValid ? cmdState.inFlight.find(id) : cmdState.inFlight.end();
+	// A legacy device answers in order and without an id, the response is for the command sent first.
+	if (!idValid && conn.legacyDevice)
+	{
+		for (auto candidate = cmdState.inFlight.begin(); candidate != cmdState.inFlight.end(); ++candidate)
+		{
+			if (it == cmdState.inFlight.end() || candidate->sinceSent.elapsed() > it->sinceSent.elapsed())
+				it = candidate;
+		}
+	}
+	if (it == cmdState.inFlight.end())
+	{
+		++cmdState.numUnmatchedResponses;
+		return;
+	}
+
+	const QByteArray response = idValid ? message.mid(idEnd + 1) : message;
+	const Command cmd = it->cmd;
+	RttEstimator& rttEstimator = getRttEstimator(cmd);
+
+	// Round trip until the first response (the parts of a multi-response come in one go)
+	if (!it->gotResponse)
+	{
+		rttEstimator.addSample(it->sinceSent.elapsed());
+		it->gotResponse = true;
+	}
+
+	if (cmd.isMultiResponse() && response != SpecialResponse::EndMultiResponse)
+	{
+		// The timeout applies between the parts.
+		it->deadline.setRemainingTime(rttEstimator.getTimeoutMs());
+		if (!it->multiResponse.isEmpty())
+			it->multiResponse += "\n";
+		it->multiResponse += response;
+
+		conn.sinceLastActivity.restart();
+		scheduleCommandTimeout();
+		return;
+	}
+
+	const QByteArray fullResponse = cmd.isMultiResponse() ? it->multiResponse : response;
+	cmdState.inFlight.erase(it);
+	handleCommandResponse(cmd, ResponseKind::Normal, fullResponse);
+}
+
+void MqttEngine::setMqttDisconnected(const QString& reason)
+{
+	if (conn.hasMqttConn())
+	{
+		conn.tsLastConnStateChange = QDateTime::currentDateTime();
+	}
+	conn.state = Connection::Disconnected;
+	conn.connStateDetails = reason;
+	updateConnState();
+}
+
+void MqttEngine::onWifiChanged(const QString& ssid)
+{
+	qDebug() << "WiFi SSID changed (" + wifiMonitor->getSourceStr() + "):" << ssid;
+	reconnect();
+}
+
+bool MqttEngine::checkForWifi()
+{
+	const auto setWifiDisconnected = [this](const QString& reason)
+	{
+		const QString& additionalReason = ", last check at: " + QDateTime::currentDateTime().toString(DateFormat);
+		setMqttDisconnected(reason + additionalReason);
+	};
+
+	if (!wifiMonitor->isKnown())
+	{
+		setMqttDisconnected("Detecting the WiFi connection...");
+		return false;
+	}
+
+	const QString& wlanSsid = wifiMonitor->getSsid();
+	if (wlanSsid.isEmpty())
+	{
+		setWifiDisconnected("No WiFi connection found!");
+		return false;
+	}
+
+	// Compiled once per pattern
+	const auto& wlanPattern = config.wlanPattern;
+	if (conn.wifiPattern.pattern().isEmpty() || wlanPattern != conn.currentWifiPattern)
+	{
+		conn.currentWifiPattern = wlanPattern;
+		conn.wifiPattern.setPattern("^" + wlanPattern + "$");
+	}
+
+	if (!conn.wifiPattern.match(wlanSsid).hasMatch())
+	{
+		setWifiDisconnected("WiFi SSID (\"" + wlanSsid + "\") does not match pattern (\"" + conn.currentWifiPattern + "\")");
+		return false;
+	}
+
+	return true;
+}
+
+void MqttEngine::updateConnState()
+{
+	scheduleConnectionTimer();
+	emit connectionChanged(ConnectionEvent{conn.state == Connection::DeviceConnected, getConnStateStr(), conn.connStateDetails});
+	qDebug() << "Connection state changed:" << getConnStateStr();
+}
+
+void MqttEngine::reconnect()
+{
+	if (conn.hasMqttConn())
+		conn.mqtt->disconnectFromHost();
+	mqttConnect();
+}
+
+void MqttEngine::mqttConnect()
+{
+	conn.connStateDetails = "Connecting to MQTT broker...";
+	conn.state = Connection::Disconnected;
+	conn.sinceLastActivity.restart();
+	updateConnState();
+
+	if (!checkForWifi())
+		return;
+
+	conn.currentBrokerAddr = config.brokerAddr;
+	conn.mqtt->setHostname(conn.currentBrokerAddr);
+	conn.mqtt->setPort(1883);
+	conn.mqtt->setClientId("DoorbellClient");
+	conn.mqtt->connectToHost();
+}
+
+void MqttEngine::onMqttConnected()
+{
+	qDebug() << "Connected to MQTT broker";
+
+	conn.state = Connection::MqttConnected;
+	conn.connStateDetails = "Only connected to MQTT broker, not to the device";
+	updateConnState();
+
+	auto subscriptions = {QMqttTopicFilter{RingTopic.name()}, RingTopicFilter, QMqttTopicFilter{ResponseTopic.name()}};
+
+	for (const auto& topicFilter : subscriptions)
+	{
+		auto subscription = conn.mqtt->subscribe(topicFilter);
+		if (!subscription)
+		{
+			qDebug() << "Failed to subscribe to topic: " << topicFilter.filter().toStdString();
+			return;
+		}
+	}
+
+	establishConnectionToDevice();
+}
+
+void MqttEngine::establishConnectionToDevice()
+{
+	conn.sinceLastActivity.restart();
+	queueCommand(Command::ping);
+}
+
+void MqttEngine::onMqttDisconnected()
+{
+	qDebug() << "Disconnected from MQTT broker";
+	// Maybe the WiFi is gone or changed, a polled SSID may be outdated.
+	wifiMonitor->refresh();
+	setMqttDisconnected(QString("No connection to broker (") + conn.currentBrokerAddr + ")");
+}
+
+QString MqttEngine::getConnStateStr() const
+{
+	QString rv = (conn.state == Connection::DeviceConnected ? "Connected to" : "Disconnected from") + QString{" device since: "}
+				 + conn.tsLastConnStateChange.toString(DateFormat) + ".";
+
+	if (!conn.connStateDetails.isEmpty())
+		rv += "\nDetails: " + conn.connStateDetails;
+
+	return rv;
+}
+
+void MqttEngine::sendCommand(const CommandRequestEvent& request) { queueCommand(request.cmd); }
+
+void MqttEngine::queueCommand(const Command& command)
+{
+	QList<Command> dropped;
+	if (cmdState.queue.push(command, dropped) == CommandQueue::PushResult::Rejected)
+		dropped.append(command);
+
+	for (const auto& cmd : dropped)
+		handleCommandResponse(cmd, ResponseKind::QueueFull);
+
+	dispatchCommands();
+}
+
+RttEstimator& MqttEngine::getRttEstimator(const Command& cmd) { return cmd.isMultiResponse() ? rttMultiResponse : rttQuick; }
+
+QString MqttEngine::getRttStateStr() const
+{
+	return "Command round trips\nquick commands: " + rttQuick.getStateStr() + "\nmulti-responses: " + rttMultiResponse.getStateStr()
+		   + QString("\nPing interval %1 ms, missed responses: %2, commands in flight: %3, responses not matched: %4")
+				 .arg(conn.pingInterval)
+				 .arg(conn.missedResponses)
+				 .arg(cmdState.inFlight.size())
+				 .arg(cmdState.numUnmatchedResponses);
+}
+
+void MqttEngine::handleCommandResponse(const Command& cmd, ResponseKind responseKind, const QByteArray& response)
+{
+	if (responseKind == ResponseKind::Timeout)
+		getRttEstimator(cmd).backOff();
+
+	handleInternalStateByResponse(cmd, responseKind, response);
+
+	// Forward to other listeners.
+	CommandResponseEvent event{cmd.get(), response};
+	switch (responseKind)
+	{
+	case ResponseKind::Normal:
+		break;
+	case ResponseKind::Timeout:
+		event.response = "[Timeout while sending command '" + cmd.toByteArray() + "']";
+		break;
+	case ResponseKind::NotConnected:
+		event.response = "[Not connected]";
+		break;
+	case ResponseKind::QueueFull:
+		event.response = "[Command queue full]";
+		break;
+	}
+	emit commandResponse(event);
+
+	dispatchCommands();
+}
+
+void MqttEngine::handleInternalStateByResponse(const Command& cmd, ResponseKind responseKind, const QByteArray& response)
+{
+	if (responseKind == ResponseKind::Normal)
+	{
+		conn.sinceLastActivity.restart();
+		conn.missedResponses = 0;
+
+		// Check for auto buzzer response
+		if (cmd == Command::getAutoBuzz)
+		{
+			if (response == SpecialResponse::AutoBuzzOn)
+				emit autoBuzzChanged(true);
+			else if (response == SpecialResponse::AutoBuzzOff)
+				emit autoBuzzChanged(false);
+		}
+
+		// Check if a connection is established (ping -> pong).
+		if (cmd == Command::ping && isPong(response))
+		{
+			const auto pongParts = response.split(' ');
+			if (pongParts.size() == 3)
+				emit clockSampleReceived(ClockSampleEvent{pongParts.at(1).toLongLong(), pongParts.at(2).toLongLong(), latencyClock->nowMs()});
+
+			const bool establishedConnectionNow = (conn.state == Connection::MqttConnected);
+			conn.pingInterval = establishedConnectionNow ? MinPingInterval : qMin(2 * conn.pingInterval, MaxPingInterval);
+
+			if (establishedConnectionNow)
+			{
+				conn.state = Connection::DeviceConnected;
+				conn.tsLastConnStateChange = QDateTime::currentDateTime();
+				conn.connStateDetails = "";
+				queueCommand(Command::getAutoBuzz);
+				updateConnState();
+			}
+		}
+	}
+
+	// Check if the connection to the device is lost (timeout for ANY command or unexpected response to ping).
+	const bool timeout = responseKind == ResponseKind::Timeout;
+
+	// Without a connection, the next ping alternates between the current and the legacy protocol (older firmware, or updated since).
+	if (timeout && cmd == Command::ping && conn.state == Connection::MqttConnected)
+		conn.legacyDevice = !conn.legacyDevice;
+
+	const bool pingWithoutPong = (responseKind == ResponseKind::Normal && cmd == Command::ping && !isPong(response));
+
+	if (timeout && conn.state == Connection::DeviceConnected && !cmdState.timeoutMissCounted)
+	{
+		cmdState.timeoutMissCounted = true;
+		++conn.missedResponses;
+	}
+
+	if (timeout && conn.state == Connection::DeviceConnected && conn.missedResponses < MaxMissedResponses)
+	{
+		// Probe right away, the device is only lost if this ping is missed as well.
+		conn.pingInterval = MinPingInterval;
+		conn.sinceLastActivity.restart();
+		queueCommand(Command::ping);
+		return;
+	}
+
+	if (timeout || pingWithoutPong)
+	{
+		if (timeout)
+			conn.connStateDetails = "Connected to MQTT broker, device not responding";
+		else
+			conn.connStateDetails = "Connected to MQTT broker, unexpected response from device: \"" + response + "\"";
+
+		conn.connStateDetails += ", last try at: " + QDateTime::currentDateTime().toString(DateFormat);
+		updateConnState();
+
+		if (conn.state == Connection::DeviceConnected)
+		{
+			conn.state = Connection::MqttConnected;
+			conn.tsLastConnStateChange = QDateTime::currentDateTime();
+			updateConnState();
+		}
+	}
+}
+
+void MqttEngine::applyConfig(const EngineConfig& newConfig)
+{
+	config = newConfig;
+
+	if (newConfig.brokerAddr != conn.currentBrokerAddr || newConfig.wlanPattern != conn.currentWifiPattern)
+	{
+		conn.mqtt->disconnectFromHost();
+		mqttConnect();
+	}
+}
+
+void MqttEngine::requestStats() { emit statsReady(EngineStatsEvent{getRttStateStr(), cmdState.queue.getStateStr()}); }
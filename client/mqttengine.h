@@ -0,0 +1,146 @@
+#pragma once
+
+#include "command.h"
+#include "commandqueue.h"
+#include "engineevents.h"
+#include "rttestimator.h"
+#include "wifimonitor.h"
+
+#include <QDateTime>
+#include <QDeadlineTimer>
+#include <QElapsedTimer>
+#include <QMap>
+#include <QMqttClient>
+#include <QObject>
+#include <QRandomGenerator>
+#include <QRegularExpression>
+#include <QScopedPointer>
+#include <QTimer>
+
+class LatencyStats;
+
+// Connection to the broker and the device, and the commands to it.
+// Runs on a worker thread of its own, so UI work never delays ring messages, pings or the buzzer.
+// Talks to the UI by queued signals only (see engineevents.h).
+class MqttEngine final : public QObject
+{
+	Q_OBJECT
+public:
+	// The clock of the latency stats is only read (it is never restarted), everything else of them stays with the UI.
+	MqttEngine(const EngineConfig& config, const LatencyStats* latencyClock);
+
+public slots:
+	// Called on the worker thread once the engine is there
+	void start();
+	void sendCommand(const CommandRequestEvent& request);
+	void reconnect();
+	void applyConfig(const EngineConfig& newConfig);
+	void requestStats();
+
+signals:
+	void ringReceived(const RingEvent& event);
+	void ackRingReceived();
+	void autoBuzzChanged(bool autoBuzz);
+	void connectionChanged(const ConnectionEvent& event);
+	void commandResponse(const CommandResponseEvent& event);
+	void clockSampleReceived(const ClockSampleEvent& event);
+	void statsReady(const EngineStatsEvent& event);
+
+private:
+	enum class ResponseKind
+	{
+		Normal,
+		Timeout,
+		NotConnected,
+		QueueFull
+	};
+
+	void setupTimers();
+	void setupMqtt();
+
+	int getConnectionTimerDelay() const;
+	void scheduleConnectionTimer();
+	void onConnectionTimer();
+	void queueCommand(const Command& cmd);
+	void dispatchCommands();
+	CommandQueue::InFlightCounts getInFlightCounts() const;
+	void scheduleCommandTimeout();
+	void onCommandTimeout();
+
+	// Connection handling
+	void onMqttConnected();
+	void onMqttDisconnected();
+	void onMessageReceived(const QByteArray& message, const QMqttTopicName& topic);
+	void onCommandResponse(const QByteArray& message);
+	void handleCommandResponse(const Command& cmd, ResponseKind responseKind, const QByteArray& response = {});
+	void handleInternalStateByResponse(const Command& cmd, ResponseKind responseKind, const QByteArray& response);
+	void mqttConnect();
+	void establishConnectionToDevice();
+	RttEstimator& getRttEstimator(const Command& cmd);
+
+	void onWifiChanged(const QString& ssid);
+	bool checkForWifi();
+
+	QString getConnStateStr() const;
+	QString getRttStateStr() const;
+	void setMqttDisconnected(const QString& reason);
+	void updateConnState();
+
+	const LatencyStats* const latencyClock;
+	EngineConfig config;
+
+	// Round trips per command class, for the command timeouts
+	RttEstimator rttQuick;
+	RttEstimator rttMultiResponse;
+
+	// Created in start(), on the worker thread
+	QScopedPointer<WifiMonitor> wifiMonitor;
+
+	struct InFlightCommand
+	{
+		Command cmd;
+		QElapsedTimer sinceSent;
+		QDeadlineTimer deadline;
+		bool gotResponse = false;
+		QByteArray multiResponse;
+	};
+
+	struct CommandState
+	{
+		CommandQueue queue;
+		// Sent commands waiting for their response, by the correlation id the device echoes
+		QMap<quint32, InFlightCommand> inFlight;
+		// Random start, other clients see the responses as well
+		quint32 nextId = QRandomGenerator::global()->generate();
+		QScopedPointer<QTimer> timeoutTimer; // for the earliest deadline in flight
+		bool timeoutMissCounted = false;     // commands expiring together are one missed response
+		int numUnmatchedResponses = 0;       // late ones and those for other clients
+		bool dispatching = false;
+	} cmdState;
+
+	struct Connection
+	{
+		enum State
+		{
+			Disconnected,
+			MqttConnected,
+			DeviceConnected
+		};
+		bool hasMqttConn() const { return state == MqttConnected || state == DeviceConnected; }
+
+		State state = Disconnected;
+		QScopedPointer<QMqttClient> mqtt;
+		QString currentWifiPattern;
+		QRegularExpression wifiPattern;
+		QString currentBrokerAddr;
+		QString connStateDetails;
+		QElapsedTimer sinceLastActivity;
+		QDateTime tsLastConnStateChange;
+		QScopedPointer<QTimer> timer; // reconnect or ping after a time without activity
+		qint64 wallClockDeadline = 0;
+		int pingInterval = 0;
+		int missedResponses = 0;
+		// Firmware before the correlation ids only knows a plain "ping" and answers without an id
+		bool legacyDevice = false;
+	} conn;
+};
@@ -2,37 +2,75 @@
 
 #include "configstore.h"
 #include "constants.h"
+#include "latencystats.h"
 #include "ringlistener.h"
 
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QDebug>
 #include <QFile>
+#include <QThread>
+
+namespace {
+
+const int BusyUiPeriodMs = 1000;
+const int LatencyReportPeriodMs = 10000;
+
+} // namespace
 
 RingApp::RingApp(int argc, char* argv[])
 	: app(argc, argv)
 	, execDir(QCoreApplication::applicationDirPath() + "/")
 {
-	copyAlarmFile();
 	QApplication::setQuitOnLastWindowClosed(false);
 
 	configStore = QSharedPointer<ConfigStore>::create(this);
+	latencyStats = QSharedPointer<LatencyStats>::create();
 	listener = QSharedPointer<RingListener>::create(this);
+	setupLatencyTest();
 }
 
-QString RingApp::getWavPath() const { return execDir + TmpAlarmFile; }
+void RingApp::setupLatencyTest()
+{
+	// "--busy-ui <ms>" blocks the UI thread for <ms> every second. Ring receipt, pings and the buzzer are handled by
+	// the MQTT engine on its own thread and must not be affected: compare "publish -> receive" and the round trips with "receive -> UI".
+	// "--latency-report <file>" writes the latency report and the round trips to <file> every 10 s, for unattended runs (latency-test.sh).
+	QCommandLineParser parser;
+	const QCommandLineOption busyUiOption("busy-ui", "Block the UI thread for <ms> every second (latency test).", "ms");
+	const QCommandLineOption latencyReportOption("latency-report", "Write the latency report to <file> every 10 s.", "file");
+	parser.addOption(busyUiOption);
+	parser.addOption(latencyReportOption);
+	parser.parse(app.arguments());
+
+	busyUiMs = parser.value(busyUiOption).toInt();
+	if (busyUiMs > 0)
+	{
+		QObject::connect(&busyUiTimer, &QTimer::timeout, [this]() { QThread::msleep(busyUiMs); });
+		busyUiTimer.start(BusyUiPeriodMs);
+	}
+
+	latencyReportPath = parser.value(latencyReportOption);
+	if (latencyReportPath.isEmpty())
+		return;
 
-void RingApp::copyAlarmFile()
+	// The round trips are reported by the engine, the report is written with its answer.
+	QObject::connect(&latencyReportTimer, &QTimer::timeout, [this]() { listener->requestEngineStats(); });
+	QObject::connect(listener.get(), &RingListener::engineStatsChanged, [this]() { writeLatencyReport(); });
+	latencyReportTimer.start(LatencyReportPeriodMs);
+}
+
+void RingApp::writeLatencyReport()
 {
-	QFile resourceFile(":/audio/alarm.wav");
-	if (resourceFile.open(QIODevice::ReadOnly)) {
-		QFile outFile(getWavPath());
-		if (outFile.open(QIODevice::WriteOnly)) {
-			outFile.write(resourceFile.readAll());
-			outFile.close();
-		} else {
-			qDebug() << "Failed to open output file:" << outFile.fileName();
-		}
-		resourceFile.close();
+	QFile file(latencyReportPath);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+	{
+		qWarning() << "Cannot write" << latencyReportPath;
+		return;
 	}
+
+	const QString report = QString("Busy UI: %1 ms every %2 ms\n\n").arg(busyUiMs).arg(BusyUiPeriodMs) + latencyStats->getReportStr()
+						   + "\n\n" + listener->getRttStateStr() + "\n";
+	file.write(report.toUtf8());
 }
 
 int RingApp::run() { return app.exec(); }
@@ -1,8 +1,10 @@
 #pragma once
 
 #include <QApplication>
+#include <QTimer>
 
 class ConfigStore;
+class LatencyStats;
 class RingListener;
 
 class RingApp final
@@ -13,16 +15,22 @@ public:
 	QApplication* getApplication() { return &app; }
 	const QString& getExecDir() const { return execDir; }
 	ConfigStore* getConfigStore() { return configStore.data(); }
-	QString getWavPath() const;
+	LatencyStats* getLatencyStats() { return latencyStats.data(); }
 
 	int run();
 
 private:
-	void copyAlarmFile();
+	void setupLatencyTest();
+	void writeLatencyReport();
 
 	QApplication app;
 	QSharedPointer<ConfigStore> configStore;
+	QSharedPointer<LatencyStats> latencyStats;
 	QSharedPointer<RingListener> listener;
+	QTimer busyUiTimer;
+	int busyUiMs = 0;
+	QTimer latencyReportTimer;
+	QString latencyReportPath;
 
 	const QString execDir;
 };
@@ -1,12 +1,13 @@
 #include "ringdialog.h"
 #include "ui_ringdialog.h"
 
+#include "alarmplayer.h"
 #include "command.h"
 #include "constants.h"
+#include "latencystats.h"
 #include "util.h"
 
 #include <QCloseEvent>
-#include <QProcess>
 #include <QScreen>
 #include <QShowEvent>
 
@@ -16,7 +17,6 @@ RingDialog::RingDialog(RingApp* app, RingListener* ringListener)
 	: CommandClientDialog(ringListener)
 	, ui(new Ui::RingDialog)
 	, ringApp(app)
-	, wavPlayProcess(this)
 {
 	ui->setupUi(this);
 
@@ -33,6 +33,25 @@ RingDialog::RingDialog(RingApp* app, RingListener* ringListener)
 	// Setup connections
 	connect(&wavPlayTimer, &QTimer::timeout, this, &RingDialog::playWav);
 	connect(ui->cmdOkOrOpen, &QPushButton::clicked, this, &RingDialog::okOrOpen);
+	setupAlarmPlayer();
+}
+
+void RingDialog::setupAlarmPlayer()
+{
+	// Without a parent: the player lives on its thread and is deleted there when the thread ends.
+	auto* alarmPlayer = new AlarmPlayer;
+	alarmPlayer->moveToThread(&alarmThread);
+	connect(&alarmThread, &QThread::started, alarmPlayer, &AlarmPlayer::start);
+	connect(&alarmThread, &QThread::finished, alarmPlayer, &QObject::deleteLater);
+
+	connect(this, &RingDialog::alarmPlayRequested, alarmPlayer, &AlarmPlayer::play);
+	connect(alarmPlayer,
+			&AlarmPlayer::firstSampleQueued,
+			this,
+			[this](qint64 timeToFirstSampleMs) { ringApp->getLatencyStats()->soundStarted(lastPlayMs, timeToFirstSampleMs); });
+
+	alarmThread.setObjectName("AlarmPlayer");
+	alarmThread.start(QThread::HighPriority);
 }
 
 void RingDialog::incrementRingCount(bool testRing, const QByteArray& additionalInfo, bool autoBuzzOn)
@@ -58,6 +77,8 @@ void RingDialog::incrementRingCount(bool testRing, const QByteArray& additionalI
 	const int totalRingCount = ringCount + testRingCount;
 	if (!wavPlayTimer.isActive() && totalRingCount > 0)
 	{
+		// Before playing, the first sample may be queued right away.
+		ringApp->getLatencyStats()->ringSoundRequested();
 		playWav();
 		wavPlayTimer.start(WavPlayIntervalMs);
 	}
@@ -72,6 +93,7 @@ void RingDialog::incrementRingCount(bool testRing, const QByteArray& additionalI
 	}
 
 	show();
+	ringApp->getLatencyStats()->dialogShown();
 }
 
 void RingDialog::closeEvent(QCloseEvent * event)
@@ -95,20 +117,8 @@ void RingDialog::closeDialog()
 
 void RingDialog::playWav()
 {
-	#ifdef Q_OS_LINUX
-		wavPlayProcess.start("aplay", { ringApp->getWavPath() });
-
-	#elif defined(Q_OS_WIN)
-		QString command = QStringLiteral(
-			"Add-Type -AssemblyName presentationCore;"
-			"[System.Media.SoundPlayer]::new('%1').PlaySync();"
-		).arg(ringApp->getWavPath().replace("'", "''"));
-
-		QProcess::startDetached("powershell", {
-			"-Command", command
-		});
-
-	#endif
+	lastPlayMs = ringApp->getLatencyStats()->nowMs();
+	emit alarmPlayRequested();
 }
 
 
@@ -126,7 +136,12 @@ void RingDialog::okOrOpen()
 	}
 }
 
-RingDialog::~RingDialog() { delete ui; }
+RingDialog::~RingDialog()
+{
+	alarmThread.quit();
+	alarmThread.wait();
+	delete ui;
+}
 
 void RingDialog::placeTopRight()
 {
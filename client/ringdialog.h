@@ -3,7 +3,7 @@
 #include "commandclient.h"
 
 #include <QMenu>
-#include <QProcess>
+#include <QThread>
 #include <QTimer>
 
 namespace Ui {
@@ -27,6 +27,8 @@ public:
 
 signals:
 	void dialogClosed();
+	// To the alarm player
+	void alarmPlayRequested();
 
 protected:
 	void showEvent(QShowEvent * event) override;
@@ -34,13 +36,16 @@ protected:
 	virtual void onReceiveCommandResponse(const Command& cmd, const QByteArray& response) override;
 
 private:
+	void setupAlarmPlayer();
 	void playWav();
 	void placeTopRight();
 	void okOrOpen();
 
 	Ui::RingDialog * ui;
 	RingApp* const ringApp;
-	QProcess wavPlayProcess;
+	// The alarm sound is played on a thread of its own, a busy UI does not delay its samples.
+	QThread alarmThread;
+	qint64 lastPlayMs = -1;
 	QTimer wavPlayTimer;
 	QByteArray additionalInfos;
 
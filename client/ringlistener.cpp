@@ -2,117 +2,59 @@
 
 #include "configdiagnosticsdialog.h"
 #include "configstore.h"
-#include "constants.h"
+#include "latencystats.h"
+#include "mqttengine.h"
 #include "ringapp.h"
 #include "ringdialog.h"
 #include "util.h"
 
-namespace {
-
-const QMqttTopicName RingTopic{"doorRing"};
-const QMqttTopicName CommandTopic{"cmd"};
-const QMqttTopicName ResponseTopic{"response"};
-
-const int MainLoopCycle = 200;
-const int ReconnectDelay = 5000;
-const int CommandTimeout = 5000;
-const int ActivityRefresh = 20000;
-const int MainLoopTimeout = 1000;
-
-} // namespace
-
 RingListener::RingListener(RingApp* ringApp)
 	: ringApp(ringApp)
 	, cfgStore(ringApp->getConfigStore())
+	, latencyStats(ringApp->getLatencyStats())
 {
-	const auto now = QDateTime::currentDateTime();
-	setupMqtt(now);
+	connection.stateStr = "Starting...";
 	setupTray();
 	setupDialog();
-	setupMainLoop(now);
+	setupEngine();
 }
 
-void RingListener::setupMqtt(const QDateTime& now)
+RingListener::~RingListener()
 {
-	const auto* mqttClient = &conn.mqtt;
-	connect(mqttClient, &QMqttClient::connected, this, &RingListener::onMqttConnected);
-	connect(mqttClient, &QMqttClient::messageReceived, this, &RingListener::onMessageReceived);
-	connect(mqttClient, &QMqttClient::disconnected, this, &RingListener::onMqttDisconnected);
-
-	conn.tsLastConnStateChange = now;
-	conn.tsLastActivity = now;
-	mqttConnect();
+	engineThread.quit();
+	engineThread.wait();
 }
 
-void RingListener::setupMainLoop(const QDateTime& now)
+void RingListener::setupEngine()
 {
-	// Use a timer and not SingleShot, as SingleShot seems not to be robust across restarts.
-	connect(&mainLoop.timer, &QTimer::timeout, this, &RingListener::runMainLoop);
-
-	mainLoop.tsLastRun = now;
-	mainLoop.timer.setInterval(MainLoopCycle);
-	mainLoop.timer.start();
-}
+	// Without a parent: the engine lives on its thread and is deleted there when the thread ends.
+	auto* engine = new MqttEngine(getEngineConfig(), latencyStats);
+	engine->moveToThread(&engineThread);
+	connect(&engineThread, &QThread::started, engine, &MqttEngine::start);
+	connect(&engineThread, &QThread::finished, engine, &QObject::deleteLater);
 
-void RingListener::runMainLoop()
-{
-	const auto now = QDateTime::currentDateTime();
-	mainLoopHandleConnection(now);
-	mainLoopHandleCommands(now);
-}
-
-void RingListener::mainLoopHandleConnection(const QDateTime& now)
-{
-	if (conn.state == Connection::Disconnected)
-	{
-		if (conn.tsLastActivity.msecsTo(now) > ReconnectDelay)
-			mqttConnect();
-	}
-	else if (conn.state == Connection::MqttConnected)
-	{
-		if (conn.tsLastActivity.msecsTo(now) > ReconnectDelay)
-			establishConnectionToDevice();
-	}
-	else if (conn.state == Connection::DeviceConnected && conn.tsLastActivity.msecsTo(now) > ActivityRefresh)
-	{
-		conn.tsLastActivity = now;
-		sendCommand(Command::ping);
-	}
+	// Both directions are queued connections, the objects live on different threads.
+	connect(engine, &MqttEngine::ringReceived, this, &RingListener::onRingReceived);
+	connect(engine, &MqttEngine::ackRingReceived, this, &RingListener::onAckRingReceived);
+	connect(engine, &MqttEngine::autoBuzzChanged, this, &RingListener::setNewAutoBuzzState);
+	connect(engine, &MqttEngine::connectionChanged, this, &RingListener::onConnectionChanged);
+	connect(engine, &MqttEngine::commandResponse, this, &RingListener::onCommandResponse);
+	connect(engine, &MqttEngine::clockSampleReceived, this, &RingListener::onClockSampleReceived);
+	connect(engine, &MqttEngine::statsReady, this, &RingListener::onStatsReady);
 
-	if (conn.state == Connection::DeviceConnected && mainLoop.tsLastRun.msecsTo(now) > MainLoopTimeout)
-	{
-		// This system was probably in suspend, the auto buzz state is not known anymore
-		sendCommand(Command::getAutoBuzz);
-	}
+	connect(this, &RingListener::engineCommandRequested, engine, &MqttEngine::sendCommand);
+	connect(this, &RingListener::engineReconnectRequested, engine, &MqttEngine::reconnect);
+	connect(this, &RingListener::engineConfigChanged, engine, &MqttEngine::applyConfig);
+	connect(this, &RingListener::engineStatsRequested, engine, &MqttEngine::requestStats);
 
-	mainLoop.tsLastRun = now;
+	engineThread.setObjectName("MqttEngine");
+	engineThread.start(QThread::HighPriority);
 }
 
-void RingListener::mainLoopHandleCommands(const QDateTime& now)
+EngineConfig RingListener::getEngineConfig() const
 {
-	if (cmdState.sendRecState == CommandState::Idle && !cmdState.queue.isEmpty())
-	{
-		cmdState.cmdSent = cmdState.queue.takeFirst();
-		if (cmdState.cmdSent.needsResponse())
-		{
-			cmdState.sendRecState = CommandState::WaitForResponse;
-			cmdState.multiResponse.clear();
-		}
-		cmdState.tsCommandSent = now;
-		// Require device connection. Only for "ping" we just require the MQTT connection, this command is used to establish the connection.
-		if (conn.state == Connection::DeviceConnected || (conn.hasMqttConn() && cmdState.cmdSent == Command::ping))
-		{
-			conn.mqtt.publish(CommandTopic, cmdState.cmdSent.toByteArray());
-		}
-		else
-		{
-			handleCommandResponse(cmdState.cmdSent, ResponseKind::NotConnected);
-		}
-	}
-	else if (cmdState.sendRecState == CommandState::WaitForResponse && cmdState.tsCommandSent.msecsTo(now) >= CommandTimeout)
-	{
-		handleCommandResponse(cmdState.cmdSent, ResponseKind::Timeout);
-	}
+	const auto& config = cfgStore->getCurrentConfig();
+	return EngineConfig{config.brokerAddr, config.wlanPattern};
 }
 
 void RingListener::setupDialog()
@@ -120,7 +62,7 @@ void RingListener::setupDialog()
 	ringDlg = QSharedPointer<RingDialog>::create(ringApp, this);
 	connect(ringDlg.get(), &RingDialog::dialogClosed, this, &RingListener::updateIcon);
 
-	cfgDiagDlg = QSharedPointer<ConfigDiagnosticsDialog>::create(this, cfgStore);
+	cfgDiagDlg = QSharedPointer<ConfigDiagnosticsDialog>::create(this, cfgStore, latencyStats);
 }
 
 void RingListener::setupTray()
@@ -185,10 +127,10 @@ void RingListener::Tray::setAutoBuzzChecked(bool isChecked)
 
 void RingListener::updateIcon()
 {
-	if (conn.state != Connection::DeviceConnected)
+	if (!connection.deviceConnected)
 	{
 		tray.sysTray.setIcon(tray.iconOff);
-		tray.sysTray.setToolTip(conn.connStateDetails);
+		tray.sysTray.setToolTip(connection.details);
 	}
 	else if (tray.autoBuzzToggle->isChecked())
 	{
@@ -198,12 +140,12 @@ void RingListener::updateIcon()
 	else if (ringDlg->isVisible())
 	{
 		tray.sysTray.setIcon(tray.iconRing);
-		tray.sysTray.setToolTip("Doorbell ring");
+		tray.sysTray.setToolTip(lastRingInput.isEmpty() ? QString{"Doorbell ring"} : "Doorbell ring at " + lastRingInput);
 	}
 	else
 	{
 		tray.sysTray.setIcon(tray.iconDefault);
-		tray.sysTray.setToolTip(conn.connStateDetails);
+		tray.sysTray.setToolTip(connection.details);
 	}
 }
 
@@ -214,203 +156,55 @@ void RingListener::setNewAutoBuzzState(bool newState)
 	emit autoBuzzStateChanged(getAutoBuzzStateStr());
 }
 
-void RingListener::onMessageReceived(const QByteArray& message, const QMqttTopicName& topic)
+void RingListener::onRingReceived(const RingEvent& event)
 {
-	const auto raiseRing = [this](bool testRing, const QByteArray& additionalInfo)
-	{
-		QByteArray fullAdditionalInfo = testRing ? "Test Ring" : "Ring";
-		if (!additionalInfo.isEmpty())
-			fullAdditionalInfo += " (" + additionalInfo + ")";
-		ringDlg->incrementRingCount(testRing, fullAdditionalInfo, getAutoBuzzState());
-		conn.tsLastActivity = QDateTime::currentDateTime();
-		updateIcon();
-	};
-
-	const auto updateAutoBuzz = [this](bool autoBuzz)
-	{
-		setNewAutoBuzzState(autoBuzz);
-		conn.tsLastActivity = QDateTime::currentDateTime();
-	};
+	latencyStats->ringReceived(event.deviceEdgeMs, event.devicePublishMs, event.receivedMs);
 
-	if (topic.name() == RingTopic)
-	{
-		if (message.startsWith(RingMessage::Ring))
-		{
-			raiseRing(false, message.mid(RingMessage::Ring.size() + 1));
-		}
-		else if (message.startsWith(RingMessage::TestRing))
-		{
-			raiseRing(true, message.mid(RingMessage::TestRing.size() + 1));
-		}
-		else if (message == RingMessage::AutoBuzzOn)
-		{
-			updateAutoBuzz(true);
-		}
-		else if (message == RingMessage::AutoBuzzOff)
-		{
-			updateAutoBuzz(false);
-		}
-		else if (message == RingMessage::AckRing)
-		{
-			if (ringDlg->isVisible())
-				ringDlg->closeDialog();
-		}
-		else
-		{
-			qDebug() << "Unknown message received on ring topic:" << message;
-		}
-	}
-	else if (topic.name() == ResponseTopic)
-	{
-		handleCommandResponse(cmdState.cmdSent, ResponseKind::Normal, message);
-	}
+	QByteArray fullAdditionalInfo = event.testRing ? "Test Ring" : "Ring";
+	if (!event.ringInput.isEmpty())
+		fullAdditionalInfo += " at " + event.ringInput.toUtf8();
+	if (!event.info.isEmpty())
+		fullAdditionalInfo += " (" + event.info + ")";
+	ringDlg->incrementRingCount(event.testRing, fullAdditionalInfo, getAutoBuzzState());
+	lastRingInput = event.ringInput;
+	updateIcon();
 }
 
-QString RingListener::getWlanSsid() const
+void RingListener::onAckRingReceived()
 {
-	QProcess process;
-	
-	#ifdef Q_OS_LINUX
-		process.start("iwgetid", {"-r"});
-	#elif defined(Q_OS_WIN)
-		process.start("netsh", {"wlan", "show", "interfaces"});
-	#endif
-	
-	process.waitForFinished(1000);
-	QString output = process.readAllStandardOutput();
-
-	#ifdef Q_OS_WIN
-	// Extrahiere SSID aus der netsh-Ausgabe
-	QRegularExpression re(R"(^\s*SSID\s*:\s*(.+)$)", QRegularExpression::MultilineOption);
-	QRegularExpressionMatch match = re.match(output);
-	if (match.hasMatch()) {
-		return match.captured(1).trimmed();
-	} else {
-		return "SSID not found";
-	}
-	#else
-	return output.trimmed();
-	#endif
+	if (ringDlg->isVisible())
+		ringDlg->closeDialog();
 }
 
-void RingListener::setMqttDisconnected(const QString& reason)
+void RingListener::onConnectionChanged(const ConnectionEvent& event)
 {
-	if (conn.hasMqttConn())
-	{
-		conn.tsLastConnStateChange = QDateTime::currentDateTime();
-	}
-	conn.state = Connection::Disconnected;
-	conn.connStateDetails = reason;
-	updateConnState();
-}
-
-bool RingListener::checkForWifi()
-{
-	const auto wlanSsid = getWlanSsid();
-
-	const auto setWifiDisconnected = [this](const QString& reason)
-	{
-		const QString& additionalReason = ", last check at: " + QDateTime::currentDateTime().toString(DateFormat);
-		setMqttDisconnected(reason + additionalReason);
-	};
-
-	if (wlanSsid.isEmpty())
-	{
-		setWifiDisconnected("No WiFi connection found!");
-		return false;
-	}
-
-	conn.currentWifiPattern = cfgStore->getCurrentConfig().wlanPattern;
-	QRegularExpression ssidPattern("^" + conn.currentWifiPattern + "$");
-	if (!ssidPattern.match(wlanSsid).hasMatch())
-	{
-		setWifiDisconnected("WiFi SSID (\"" + wlanSsid + "\") does not match pattern (\"" + conn.currentWifiPattern + "\")");
-		return false;
-	}
+	const bool deviceConnectionChanged = event.deviceConnected != connection.deviceConnected;
+	connection = event;
 
-	return true;
-}
-
-void RingListener::updateConnState()
-{
-	emit connStateChanged(getConnStateStr());
+	emit connStateChanged(connection.stateStr);
+	if (deviceConnectionChanged)
+		emit autoBuzzStateChanged(getAutoBuzzStateStr());
 	updateIcon();
-	qDebug() << "Connection state changed:" << getConnStateStr();
-}
-
-void RingListener::reconnect()
-{
-	if (conn.hasMqttConn())
-		conn.mqtt.disconnectFromHost();
-	mqttConnect();
 }
 
-void RingListener::mqttConnect()
-{
-	conn.connStateDetails = "Connecting to MQTT broker...";
-	conn.state = Connection::Disconnected;
-	conn.tsLastActivity = QDateTime::currentDateTime();
-	updateConnState();
-
-	if (!checkForWifi())
-		return;
-
-	conn.currentBrokerAddr = cfgStore->getCurrentConfig().brokerAddr;
-	conn.mqtt.setHostname(conn.currentBrokerAddr);
-	conn.mqtt.setPort(1883);
-	conn.mqtt.setClientId("DoorbellClient");
-	conn.mqtt.connectToHost();
-}
-
-void RingListener::onMqttConnected()
-{
-	qDebug() << "Connected to MQTT broker";
-
-	conn.state = Connection::MqttConnected;
-	conn.connStateDetails = "Only connected to MQTT broker, not to the device";
-	updateConnState();
+void RingListener::onCommandResponse(const CommandResponseEvent& event) { emit receiveCommandResponse(Command{event.cmd}, event.response); }
 
-	auto subscriptions = {RingTopic, ResponseTopic};
-
-	for (const auto& topic : subscriptions)
-	{
-		auto subscription = conn.mqtt.subscribe(QMqttTopicFilter{topic.name()});
-		if (!subscription)
-		{
-			qDebug() << "Failed to subscribe to topic: " << topic.name().toStdString();
-			return;
-		}
-	}
-
-	establishConnectionToDevice();
-}
-
-void RingListener::establishConnectionToDevice()
+void RingListener::onClockSampleReceived(const ClockSampleEvent& event)
 {
-	conn.tsLastActivity = QDateTime::currentDateTime();
-	sendCommand(Command::ping);
+	latencyStats->addClockSample(event.sentMs, event.deviceMs, event.receivedMs);
 }
 
-void RingListener::onMqttDisconnected()
+void RingListener::onStatsReady(const EngineStatsEvent& event)
 {
-	qDebug() << "Disconnected from MQTT broker";
-	setMqttDisconnected(QString("No connection to broker (") + conn.currentBrokerAddr + ")");
+	engineStats = event;
+	emit engineStatsChanged();
 }
 
-QString RingListener::getConnStateStr() const
-{
-	QString rv = (conn.state == Connection::DeviceConnected ? "Connected to" : "Disconnected from") + QString{" device since: "}
-				 + conn.tsLastConnStateChange.toString(DateFormat) + ".";
-
-	if (!conn.connStateDetails.isEmpty())
-		rv += "\nDetails: " + conn.connStateDetails;
-
-	return rv;
-}
+QString RingListener::getConnStateStr() const { return connection.stateStr; }
 
 QString RingListener::getAutoBuzzStateStr() const
 {
-	if (conn.state != Connection::DeviceConnected)
+	if (!connection.deviceConnected)
 	{
 		return "Unknown (not connected)";
 	}
@@ -422,115 +216,14 @@ QString RingListener::getAutoBuzzStateStr() const
 
 bool RingListener::getAutoBuzzState() const { return tray.autoBuzzToggle->isChecked(); }
 
-void RingListener::sendCommand(const Command& command) { cmdState.queue.append(command); }
+QString RingListener::getRttStateStr() const { return engineStats.rttStateStr; }
 
-void RingListener::handleCommandResponse(const Command& cmd, ResponseKind responseKind, const QByteArray& response)
-{
-	handleInternalStateByResponse(cmd, responseKind, response);
+QString RingListener::getCommandQueueStateStr() const { return engineStats.commandQueueStateStr; }
 
-	// Handle non-timeout multi-responses.
-	if (cmd.isMultiResponse() && responseKind == ResponseKind::Normal)
-	{
-		if (response == SpecialResponse::EndMultiResponse)
-		{
-			emit receiveCommandResponse(cmd, cmdState.multiResponse);
-			cmdState.multiResponse.clear();
-			cmdState.sendRecState = CommandState::Idle;
-		}
-		else
-		{
-			// Avoid running into timeout
-			cmdState.tsCommandSent = QDateTime::currentDateTime();
-			if (!cmdState.multiResponse.isEmpty())
-				cmdState.multiResponse += "\n";
-
-			cmdState.multiResponse += response;
-		}
-		return;
-	}
-
-	cmdState.sendRecState = CommandState::Idle;
+void RingListener::requestEngineStats() { emit engineStatsRequested(); }
 
-	// Forward to other listeners.
-	switch (responseKind)
-	{
-	case ResponseKind::Normal:
-		emit receiveCommandResponse(cmd, response);
-		break;
-	case ResponseKind::Timeout:
-		emit receiveCommandResponse(cmd, "[Timeout while sending command '" + cmd.toByteArray() + "']");
-		break;
-	case ResponseKind::NotConnected:
-		emit receiveCommandResponse(cmd, "[Not connected]");
-		break;
-	}
-}
+void RingListener::sendCommand(const Command& command) { emit engineCommandRequested(CommandRequestEvent{command.get()}); }
 
-void RingListener::handleInternalStateByResponse(const Command& cmd, ResponseKind responseKind, const QByteArray& response)
-{
-	const auto now = QDateTime::currentDateTime();
-
-	if (responseKind == ResponseKind::Normal)
-	{
-		conn.tsLastActivity = now;
-
-		// Check for auto buzzer response
-		if (cmd == Command::getAutoBuzz)
-		{
-			if (response == SpecialResponse::AutoBuzzOn)
-				setNewAutoBuzzState(true);
-			else if (response == SpecialResponse::AutoBuzzOff)
-				setNewAutoBuzzState(false);
-		}
-
-		// Check if a connection is established (ping -> pong).
-		if (cmd == Command::ping && response == SpecialResponse::Pong)
-		{
-			const bool establishedConnectionNow = (conn.state == Connection::MqttConnected);
-
-			if (establishedConnectionNow)
-			{
-				conn.state = Connection::DeviceConnected;
-				emit autoBuzzStateChanged(getAutoBuzzStateStr());
-				conn.tsLastConnStateChange = now;
-				conn.connStateDetails = "";
-				sendCommand(Command::getAutoBuzz);
-				updateConnState();
-			}
-		}
-	}
+void RingListener::reconnect() { emit engineReconnectRequested(); }
 
-	// Check if the connection to the device is lost (timeout for ANY command or unexpected response to ping).
-	const bool timeout = responseKind == ResponseKind::Timeout;
-	const bool pingWithoutPong = (cmd == Command::ping && response != SpecialResponse::Pong);
-
-	if (timeout || pingWithoutPong)
-	{
-		if (timeout)
-			conn.connStateDetails = "Connected to MQTT broker, device not responding";
-		else
-			conn.connStateDetails = "Connected to MQTT broker, unexpected response from device: \"" + response + "\"";
-
-		conn.connStateDetails += ", last try at: " + cmdState.tsCommandSent.toString(DateFormat);
-		updateConnState();
-
-		if (conn.state == Connection::DeviceConnected)
-		{
-			conn.state = Connection::MqttConnected;
-			conn.tsLastConnStateChange = QDateTime::currentDateTime();
-			emit autoBuzzStateChanged(getAutoBuzzStateStr());
-			updateConnState();
-		}
-	}
-}
-
-void RingListener::reloadSettings()
-{
-	const auto newConfig = cfgStore->getCurrentConfig();
-
-	if (newConfig.brokerAddr != conn.currentBrokerAddr || newConfig.wlanPattern != conn.currentWifiPattern)
-	{
-		conn.mqtt.disconnectFromHost();
-		mqttConnect();
-	}
-}
+void RingListener::reloadSettings() { emit engineConfigChanged(getEngineConfig()); }
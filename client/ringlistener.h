@@ -1,31 +1,39 @@
 #pragma once
 
 #include "command.h"
+#include "engineevents.h"
 
 #include <QAction>
 #include <QApplication>
 #include <QMenu>
-#include <QMqttClient>
 #include <QObject>
 #include <QSystemTrayIcon>
-#include <QTimer>
+#include <QThread>
 
 class ConfigDiagnosticsDialog;
 class ConfigsSettingsDialog;
 class ConfigStore;
+class LatencyStats;
 class RingApp;
 class RingDialog;
 
+// UI side of the connection: tray icon, ring dialog and the state shown in the diagnostics.
+// The connection and the commands are handled by the MqttEngine on a worker thread, both sides talk by queued signals only.
 class RingListener final : public QObject
 {
 	Q_OBJECT
 public:
 	explicit RingListener(RingApp* app);
+	~RingListener();
 
 	// Interface to Settings&Diagnostics
 	QString getConnStateStr() const;
 	QString getAutoBuzzStateStr() const;
 	bool getAutoBuzzState() const;
+	// Last state reported by the engine, requestEngineStats() asks for an update (engineStatsChanged)
+	QString getRttStateStr() const;
+	QString getCommandQueueStateStr() const;
+	void requestEngineStats();
 	void reloadSettings();
 
 public slots:
@@ -37,84 +45,41 @@ signals:
 	void receiveCommandResponse(const Command& cmd, const QByteArray& response);
 	void connStateChanged(const QString& state);
 	void autoBuzzStateChanged(const QString& state);
+	void engineStatsChanged();
 
-private:
-	void runMainLoop();
-	void mainLoopHandleConnection(const QDateTime& now);
-	void mainLoopHandleCommands(const QDateTime& now);
+	// To the engine
+	void engineCommandRequested(const CommandRequestEvent& request);
+	void engineReconnectRequested();
+	void engineConfigChanged(const EngineConfig& config);
+	void engineStatsRequested();
 
-	void setupMqtt(const QDateTime& now);
+private:
+	void setupEngine();
 	void setupTray();
 	void setupDialog();
-	void setupMainLoop(const QDateTime& now);
-
-	enum class ResponseKind
-	{
-		Normal,
-		Timeout,
-		NotConnected
-	};
-
-	// Connection handling
-	void onMqttConnected();
-	void onMqttDisconnected();
-	void onMessageReceived(const QByteArray& message, const QMqttTopicName& topic);
-	void handleCommandResponse(const Command& cmd, ResponseKind responseKind, const QByteArray& response = {});
-	void handleInternalStateByResponse(const Command& cmd, ResponseKind responseKind, const QByteArray& response);
-	void mqttConnect();
-	void establishConnectionToDevice();
 
-	QString getWlanSsid() const;
-	bool checkForWifi();
+	// Events from the engine
+	void onRingReceived(const RingEvent& event);
+	void onAckRingReceived();
+	void onConnectionChanged(const ConnectionEvent& event);
+	void onCommandResponse(const CommandResponseEvent& event);
+	void onClockSampleReceived(const ClockSampleEvent& event);
+	void onStatsReady(const EngineStatsEvent& event);
 
+	EngineConfig getEngineConfig() const;
 	void updateIcon();
 	void setNewAutoBuzzState(bool newState);
-	void setMqttDisconnected(const QString& reason);
-	void updateConnState();
 
 	QSharedPointer<RingDialog> ringDlg;
 	QSharedPointer<ConfigDiagnosticsDialog> cfgDiagDlg;
 	RingApp* const ringApp;
 	ConfigStore* const cfgStore;
+	LatencyStats* const latencyStats;
+	QString lastRingInput;
 
-	struct MainLoop
-	{
-		QTimer timer;
-		QDateTime tsLastRun;
-	} mainLoop;
-
-	struct CommandState
-	{
-		enum SendRecState
-		{
-			Idle,
-			WaitForResponse
-		};
-		SendRecState sendRecState = SendRecState::Idle;
-		Command cmdSent;
-		QList<Command> queue;
-		QDateTime tsCommandSent;
-		QByteArray multiResponse;
-	} cmdState;
-
-	struct Connection
-	{
-		enum State
-		{
-			Disconnected,
-			MqttConnected,
-			DeviceConnected
-		};
-		bool hasMqttConn() const { return state == MqttConnected || state == DeviceConnected; }
-
-		State state;
-		QMqttClient mqtt;
-		QString currentWifiPattern;
-		QString currentBrokerAddr;
-		QString connStateDetails;
-		QDateTime tsLastActivity;
-		QDateTime tsLastConnStateChange;
-	} conn;
+	QThread engineThread;
+	ConnectionEvent connection;
+	EngineStatsEvent engineStats;
 
 	struct Tray
 	{
@@ -0,0 +1,69 @@
+#include "rttestimator.h"
+
+#include <QStringList>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Gains of RFC 6298
+const double RttGain = 1.0 / 8;
+const double RttVarGain = 1.0 / 4;
+const int RttVarFactor = 4;
+
+const int MaxHistory = 20;
+
+} // namespace
+
+RttEstimator::RttEstimator(int initialTimeoutMs, int minTimeoutMs, int maxTimeoutMs)
+	: minTimeoutMs(minTimeoutMs)
+	, maxTimeoutMs(maxTimeoutMs)
+	, timeoutMs(initialTimeoutMs)
+{}
+
+void RttEstimator::addSample(qint64 rttMs)
+{
+	if (!hasSample)
+	{
+		smoothedRttMs = rttMs;
+		rttVarMs = rttMs / 2.0;
+		hasSample = true;
+	}
+	else
+	{
+		rttVarMs = (1 - RttVarGain) * rttVarMs + RttVarGain * std::abs(smoothedRttMs - rttMs);
+		smoothedRttMs = (1 - RttGain) * smoothedRttMs + RttGain * rttMs;
+	}
+
+	history.append(rttMs);
+	if (history.size() > MaxHistory)
+		history.removeFirst();
+
+	// A new sample also ends a back off.
+	updateTimeout();
+}
+
+void RttEstimator::backOff() { timeoutMs = std::min(2 * timeoutMs, maxTimeoutMs); }
+
+void RttEstimator::updateTimeout()
+{
+	const double timeout = smoothedRttMs + RttVarFactor * rttVarMs;
+	timeoutMs = std::clamp(static_cast<int>(timeout + 0.5), minTimeoutMs, maxTimeoutMs);
+}
+
+QString RttEstimator::getStateStr() const
+{
+	if (!hasSample)
+		return QString("no samples yet, timeout %1 ms").arg(timeoutMs);
+
+	QStringList historyStrs;
+	for (const qint64 rttMs : history)
+		historyStrs.append(QString::number(rttMs));
+
+	return QString("smoothed %1 ms, variation %2 ms, timeout %3 ms\n  last round trips: %4")
+		.arg(qRound(smoothedRttMs))
+		.arg(qRound(rttVarMs))
+		.arg(timeoutMs)
+		.arg(historyStrs.join(' '));
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <QList>
+#include <QString>
+
+// Smoothed round trip time and its variation for the responses of a command class.
+// The timeout follows from both like the TCP retransmission timeout (RFC 6298) and is doubled after each timeout.
+class RttEstimator final
+{
+public:
+	RttEstimator(int initialTimeoutMs, int minTimeoutMs, int maxTimeoutMs);
+
+	void addSample(qint64 rttMs);
+	void backOff();
+
+	int getTimeoutMs() const { return timeoutMs; }
+	QString getStateStr() const;
+
+private:
+	void updateTimeout();
+
+	const int minTimeoutMs;
+	const int maxTimeoutMs;
+	int timeoutMs;
+
+	bool hasSample = false;
+	double smoothedRttMs = 0;
+	double rttVarMs = 0;
+	QList<qint64> history;
+};
@@ -0,0 +1,269 @@
+#include "wifimonitor.h"
+
+#include <QRegularExpression>
+
+#ifdef Q_OS_LINUX
+	#include <QDBusArgument>
+	#include <QDBusConnection>
+	#include <QDBusMessage>
+	#include <QDBusObjectPath>
+	#include <QDBusPendingCallWatcher>
+	#include <QDBusPendingReply>
+	#include <QDBusVariant>
+#endif
+
+namespace {
+
+const QString NmService = "org.freedesktop.NetworkManager";
+const QString NmPath = "/org/freedesktop/NetworkManager";
+const QString NmInterface = "org.freedesktop.NetworkManager";
+const QString NmActiveConnectionInterface = "org.freedesktop.NetworkManager.Connection.Active";
+const QString NmAccessPointInterface = "org.freedesktop.NetworkManager.AccessPoint";
+const QString PropertiesInterface = "org.freedesktop.DBus.Properties";
+const QString WirelessConnectionType = "802-11-wireless";
+const uint ActiveConnectionActivated = 2; // NM_ACTIVE_CONNECTION_STATE_ACTIVATED
+
+// Properties of NetworkManager that change with the WiFi connection
+const QStringList NmConnectionProperties = {"ActiveConnections", "PrimaryConnection", "State"};
+
+// Without WiFi, a connection is found quickly. With WiFi, a change mostly shows as a lost broker connection first (see refresh()).
+const int PollIntervalDisconnected = 5000;
+const int PollIntervalConnected = 60000;
+const int PollTimeout = 1000;
+
+} // namespace
+
+WifiMonitor::WifiMonitor(QObject* parent)
+	: QObject(parent)
+{
+	pollTimer.setSingleShot(true);
+	connect(&pollTimer, &QTimer::timeout, this, &WifiMonitor::poll);
+	connect(&pollProcess, &QProcess::finished, this, &WifiMonitor::onPollFinished);
+	connect(&pollProcess, &QProcess::errorOccurred, this, [this](QProcess::ProcessError error) {
+		// A missing tool does not finish, a hanging one is killed and finishes.
+		if (error == QProcess::FailedToStart)
+			onPollFinished();
+	});
+}
+
+void WifiMonitor::start()
+{
+	useNetworkManager = subscribeNetworkManager();
+	if (useNetworkManager)
+		queryNetworkManager();
+	else
+		startPolling();
+}
+
+void WifiMonitor::refresh()
+{
+	if (useNetworkManager || pollProcess.state() != QProcess::NotRunning)
+		return;
+	pollTimer.stop();
+	poll();
+}
+
+QString WifiMonitor::getSourceStr() const
+{
+	if (useNetworkManager)
+		return "NetworkManager";
+	return QString("polled every %1 s (%2 s while connected)").arg(PollIntervalDisconnected / 1000).arg(PollIntervalConnected / 1000);
+}
+
+void WifiMonitor::setSsid(const QString& newSsid)
+{
+	const bool changed = !known || newSsid != ssid;
+	known = true;
+	ssid = newSsid;
+	if (changed)
+		emit ssidChanged(ssid);
+}
+
+bool WifiMonitor::subscribeNetworkManager()
+{
+#ifdef Q_OS_LINUX
+	return QDBusConnection::systemBus().connect(NmService,
+												NmPath,
+												PropertiesInterface,
+												"PropertiesChanged",
+												this,
+												SLOT(onNetworkManagerChanged(QString, QVariantMap, QStringList)));
+#else
+	return false;
+#endif
+}
+
+void WifiMonitor::onNetworkManagerChanged(const QString& interface, const QVariantMap& changedProperties, const QStringList& invalidatedProperties)
+{
+	Q_UNUSED(invalidatedProperties);
+
+	if (interface != NmInterface)
+		return;
+
+	for (const auto& name : NmConnectionProperties)
+	{
+		if (changedProperties.contains(name))
+		{
+			queryNetworkManager();
+			return;
+		}
+	}
+}
+
+void WifiMonitor::queryNetworkManager()
+{
+	++queryGeneration;
+	pendingReplies = 0;
+	querySsid.clear();
+	getProperty(NmPath, NmInterface, "ActiveConnections", [this](const QVariant& value) { onActiveConnections(value); });
+}
+
+void WifiMonitor::onActiveConnections(const QVariant& value)
+{
+#ifdef Q_OS_LINUX
+	if (!value.isValid())
+	{
+		// NetworkManager is not running (the subscription succeeds anyway)
+		QDBusConnection::systemBus().disconnect(NmService,
+												NmPath,
+												PropertiesInterface,
+												"PropertiesChanged",
+												this,
+												SLOT(onNetworkManagerChanged(QString, QVariantMap, QStringList)));
+		useNetworkManager = false;
+		startPolling();
+		return;
+	}
+
+	const auto activeConnections = qdbus_cast<QList<QDBusObjectPath>>(value);
+	for (const auto& path : activeConnections)
+		getAllProperties(path.path(), NmActiveConnectionInterface, [this](const QVariantMap& properties) { onActiveConnection(properties); });
+#else
+	Q_UNUSED(value);
+#endif
+}
+
+void WifiMonitor::onActiveConnection(const QVariantMap& properties)
+{
+#ifdef Q_OS_LINUX
+	if (properties.value("Type").toString() != WirelessConnectionType || properties.value("State").toUInt() != ActiveConnectionActivated)
+		return;
+
+	const auto accessPoint = properties.value("SpecificObject").value<QDBusObjectPath>();
+	getProperty(accessPoint.path(),
+				NmAccessPointInterface,
+				"Ssid",
+				[this](const QVariant& value)
+				{
+					if (querySsid.isEmpty())
+						querySsid = QString::fromUtf8(value.toByteArray());
+				});
+#else
+	Q_UNUSED(properties);
+#endif
+}
+
+void WifiMonitor::getProperty(const QString& path, const QString& interface, const QString& name, const std::function<void(const QVariant&)>& onReply)
+{
+#ifdef Q_OS_LINUX
+	auto message = QDBusMessage::createMethodCall(NmService, path, PropertiesInterface, "Get");
+	message << interface << name;
+
+	++pendingReplies;
+	auto* watcher = new QDBusPendingCallWatcher(QDBusConnection::systemBus().asyncCall(message), this);
+	connect(watcher,
+			&QDBusPendingCallWatcher::finished,
+			this,
+			[this, onReply, query = queryGeneration](QDBusPendingCallWatcher* watcher)
+			{
+				watcher->deleteLater();
+				if (query != queryGeneration)
+					return;
+
+				const QDBusPendingReply<QDBusVariant> reply = *watcher;
+				onReply(reply.isError() ? QVariant{} : reply.value().variant());
+				replyHandled();
+			});
+#else
+	Q_UNUSED(path);
+	Q_UNUSED(interface);
+	Q_UNUSED(name);
+	Q_UNUSED(onReply);
+#endif
+}
+
+void WifiMonitor::getAllProperties(const QString& path, const QString& interface, const std::function<void(const QVariantMap&)>& onReply)
+{
+#ifdef Q_OS_LINUX
+	auto message = QDBusMessage::createMethodCall(NmService, path, PropertiesInterface, "GetAll");
+	message << interface;
+
+	++pendingReplies;
+	auto* watcher = new QDBusPendingCallWatcher(QDBusConnection::systemBus().asyncCall(message), this);
+	connect(watcher,
+			&QDBusPendingCallWatcher::finished,
+			this,
+			[this, onReply, query = queryGeneration](QDBusPendingCallWatcher* watcher)
+			{
+				watcher->deleteLater();
+				if (query != queryGeneration)
+					return;
+
+				const QDBusPendingReply<QVariantMap> reply = *watcher;
+				if (!reply.isError())
+					onReply(reply.value());
+				replyHandled();
+			});
+#else
+	Q_UNUSED(path);
+	Q_UNUSED(interface);
+	Q_UNUSED(onReply);
+#endif
+}
+
+void WifiMonitor::replyHandled()
+{
+	// The query is complete when no further replies are expected, handlers may have sent further calls.
+	if (--pendingReplies == 0 && useNetworkManager)
+		setSsid(querySsid);
+}
+
+void WifiMonitor::startPolling()
+{
+	if (!pollTimer.isActive() && pollProcess.state() == QProcess::NotRunning)
+		poll();
+}
+
+void WifiMonitor::poll()
+{
+#ifdef Q_OS_LINUX
+	pollProcess.start("iwgetid", {"-r"});
+#elif defined(Q_OS_WIN)
+	pollProcess.start("netsh", {"wlan", "show", "interfaces"});
+#endif
+
+	// Killed if it does not finish in time, finished() follows
+	QTimer::singleShot(PollTimeout,
+					   &pollProcess,
+					   [this]()
+					   {
+						   if (pollProcess.state() != QProcess::NotRunning)
+							   pollProcess.kill();
+					   });
+}
+
+void WifiMonitor::onPollFinished()
+{
+	const QString output = pollProcess.readAllStandardOutput();
+
+#ifdef Q_OS_WIN
+	// Extract the SSID from the netsh output
+	static const QRegularExpression ssidLine(R"(^\s*SSID\s*:\s*(.+)$)", QRegularExpression::MultilineOption);
+	const QRegularExpressionMatch match = ssidLine.match(output);
+	setSsid(match.hasMatch() ? match.captured(1).trimmed() : QString{});
+#else
+	setSsid(output.trimmed());
+#endif
+
+	pollTimer.start(ssid.isEmpty() ? PollIntervalDisconnected : PollIntervalConnected);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <QObject>
+#include <QProcess>
+#include <QString>
+#include <QTimer>
+#include <QVariantMap>
+
+#include <functional>
+
+// SSID of the current WiFi connection, kept up to date in the background.
+// On Linux the state comes from NetworkManager via D-Bus, changes are signalled by it.
+// Without NetworkManager (and on Windows) a tool is polled, asynchronously: often while disconnected, seldom while connected.
+class WifiMonitor final : public QObject
+{
+	Q_OBJECT
+public:
+	explicit WifiMonitor(QObject* parent = nullptr);
+
+	void start();
+	// Polls right away (e.g. the connection to the broker was lost), NetworkManager signals changes by itself
+	void refresh();
+
+	// False until the first query is answered
+	bool isKnown() const { return known; }
+	// Empty without WiFi connection
+	const QString& getSsid() const { return ssid; }
+	QString getSourceStr() const;
+
+signals:
+	void ssidChanged(const QString& ssid);
+
+private slots:
+	void onNetworkManagerChanged(const QString& interface, const QVariantMap& changedProperties, const QStringList& invalidatedProperties);
+
+private:
+	void setSsid(const QString& newSsid);
+
+	// NetworkManager: active connections -> the wireless one that is activated -> its access point -> SSID
+	bool subscribeNetworkManager();
+	void queryNetworkManager();
+	void getProperty(const QString& path, const QString& interface, const QString& name, const std::function<void(const QVariant&)>& onReply);
+	void getAllProperties(const QString& path, const QString& interface, const std::function<void(const QVariantMap&)>& onReply);
+	void onActiveConnections(const QVariant& value);
+	void onActiveConnection(const QVariantMap& properties);
+	void replyHandled();
+
+	// Polling fallback
+	void startPolling();
+	void poll();
+	void onPollFinished();
+
+	bool known = false;
+	QString ssid;
+
+	bool useNetworkManager = false;
+	quint64 queryGeneration = 0; // replies to an older query are dropped
+	int pendingReplies = 0;
+	QString querySsid;
+
+	QProcess pollProcess;
+	QTimer pollTimer;
+};